@@ -0,0 +1,77 @@
+
+
+#include "AccumulationBuffer.h"
+#include "SDL/Exception.h"
+
+#include <algorithm>
+
+
+AccumulationBuffer::AccumulationBuffer(int width, int height)
+	: width(width), height(height), toneMapping(TONEMAP_CLAMP), exposure(1.0f)
+{
+	// rows are padded to whole registers, and one more register at the end lets the last row be
+	// read a register at a time too
+	stride = (width + SimdFloat::Width - 1) / SimdFloat::Width * SimdFloat::Width;
+	std::size_t size = (std::size_t)stride * height + SimdFloat::Width;
+	red.resize(size);
+	green.resize(size);
+	blue.resize(size);
+}
+
+
+void AccumulationBuffer::Clear()
+{
+	std::fill(red.begin(), red.end(), 0.0f);
+	std::fill(green.begin(), green.end(), 0.0f);
+	std::fill(blue.begin(), blue.end(), 0.0f);
+}
+
+
+namespace
+{
+	inline SimdFloat ToneMap(const SimdFloat& colour, const SimdFloat& scale, TONE_MAPPING toneMapping)
+	{
+		SimdFloat c = colour * scale;
+		if (toneMapping == TONEMAP_REINHARD)
+			c = c / (SimdFloat(1.0f) + c);
+		return c;
+	}
+}
+
+
+void AccumulationBuffer::Resolve(SDL::Surface& surface, float scale) const
+{
+	Resolve(surface, 0, 0, width, height, scale);
+}
+
+
+void AccumulationBuffer::Resolve(SDL::Surface& surface, int left, int top, int regionWidth, int regionHeight, float scale) const
+{
+	if (surface.GetWidth() != width || surface.GetHeight() != height)
+		throw SDL::Exception("accumulation buffer and surface differ in size");
+
+	const SimdFloat colourScale(scale * exposure);
+
+	// one tone mapped row at a time, which the surface converts to its own format. The row is tone
+	// mapped from the register the region starts in, so every load is aligned
+	Plane_t redRow(stride), greenRow(stride), blueRow(stride);
+	const int first = left / SimdFloat::Width * SimdFloat::Width;
+
+	surface.Lock();
+
+	for (int y=top; y<top + regionHeight; ++y)
+	{
+		const std::size_t row = (std::size_t)y * stride;
+
+		for (int x=first; x<left + regionWidth; x+=SimdFloat::Width)
+		{
+			ToneMap(SimdFloat::LoadAligned(&red[row + x]), colourScale, toneMapping).StoreAligned(&redRow[x]);
+			ToneMap(SimdFloat::LoadAligned(&green[row + x]), colourScale, toneMapping).StoreAligned(&greenRow[x]);
+			ToneMap(SimdFloat::LoadAligned(&blue[row + x]), colourScale, toneMapping).StoreAligned(&blueRow[x]);
+		}
+
+		surface.WritePixels(left, y, regionWidth, &redRow[left], &greenRow[left], &blueRow[left]);
+	}
+
+	surface.Unlock();
+}
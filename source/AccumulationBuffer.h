@@ -0,0 +1,86 @@
+#ifndef ACCUMULATIONBUFFER_H
+#define ACCUMULATIONBUFFER_H
+
+#include "Vector3.h"
+#include "Simd.h"
+#include "SDL/Surface.h"
+
+#include <vector>
+#include <boost/align/aligned_allocator.hpp>
+
+
+enum TONE_MAPPING
+{
+	// colours above 1 are cut off, as the renderer always did
+	TONEMAP_CLAMP,
+	// c / (1 + c), which brings any brightness into range
+	TONEMAP_REINHARD
+};
+
+
+// Floating point RGB image that render threads write their results into, kept apart from the SDL
+// surface so tracing never touches the surface's pixel format. Each channel is a separate plane of
+// aligned rows, so that Resolve can tone map a whole row of pixels in SIMD registers.
+//
+// Threads may write to different pixels at the same time without locking.
+class AccumulationBuffer
+{
+private:
+	typedef std::vector< float, boost::alignment::aligned_allocator< float, SimdFloat::Alignment > > Plane_t;
+
+	int width, height, stride;
+	Plane_t red, green, blue;
+
+	TONE_MAPPING toneMapping;
+	float exposure;
+
+	AccumulationBuffer(const AccumulationBuffer&);
+	AccumulationBuffer& operator= (const AccumulationBuffer&);
+
+public:
+	AccumulationBuffer(int width, int height);
+
+	inline int GetWidth() const { return width; }
+	inline int GetHeight() const { return height; }
+
+	// sets every pixel to black
+	void Clear();
+
+	inline void SetPixel(int x, int y, const Vector3& colour)
+	{
+		int index = y * stride + x;
+		red[index] = colour.X;
+		green[index] = colour.Y;
+		blue[index] = colour.Z;
+	}
+
+	// adds to the pixel, for images built up from several passes
+	inline void AddPixel(int x, int y, const Vector3& colour)
+	{
+		int index = y * stride + x;
+		red[index] += colour.X;
+		green[index] += colour.Y;
+		blue[index] += colour.Z;
+	}
+
+	inline Vector3 GetPixel(int x, int y) const
+	{
+		int index = y * stride + x;
+		return Vector3(red[index], green[index], blue[index]);
+	}
+
+	inline void SetToneMapping(TONE_MAPPING toneMapping) { this->toneMapping = toneMapping; }
+	inline TONE_MAPPING GetToneMapping() const { return toneMapping; }
+	// every colour is multiplied by this before tone mapping
+	inline void SetExposure(float exposure) { this->exposure = exposure; }
+	inline float GetExposure() const { return exposure; }
+
+	// Tone maps every pixel and writes it to the surface, which must be the same size and not be locked
+	// by anyone else. scale multiplies the colours first, for averaging accumulated passes
+	void Resolve(SDL::Surface& surface, float scale = 1.0f) const;
+	// the same for just a rectangle of the image
+	void Resolve(SDL::Surface& surface, int x, int y, int width, int height, float scale = 1.0f) const;
+};
+
+
+#endif
@@ -0,0 +1,423 @@
+#include "Animation.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Cube.h"
+#include "Box.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+	const float DEGREES_TO_RADIANS = 3.14159265358979f / 180.0f;
+
+
+	// A key's rotation, about its pivot, then its translation
+	class Transform
+	{
+	private:
+		// where the rotation takes each axis
+		Vector3 axisX, axisY, axisZ;
+		Vector3 pivot, translation;
+
+	public:
+		explicit Transform(const Animation::Key& key)
+			: pivot(key.Pivot), translation(key.Translation)
+		{
+			float sx = std::sin(key.Rotation.X * DEGREES_TO_RADIANS), cx = std::cos(key.Rotation.X * DEGREES_TO_RADIANS);
+			float sy = std::sin(key.Rotation.Y * DEGREES_TO_RADIANS), cy = std::cos(key.Rotation.Y * DEGREES_TO_RADIANS);
+			float sz = std::sin(key.Rotation.Z * DEGREES_TO_RADIANS), cz = std::cos(key.Rotation.Z * DEGREES_TO_RADIANS);
+
+			// about X first, then Y, then Z
+			axisX = Vector3(cy * cz, cy * sz, -sy);
+			axisY = Vector3(sx * sy * cz - cx * sz, sx * sy * sz + cx * cz, sx * cy);
+			axisZ = Vector3(cx * sy * cz + sx * sz, cx * sy * sz - sx * cz, cx * cy);
+		}
+
+		// for directions, which only turn
+		inline Vector3 Rotate(const Vector3& direction) const
+		{
+			return axisX * direction.X + axisY * direction.Y + axisZ * direction.Z;
+		}
+
+		inline Vector3 Move(const Vector3& point) const
+		{
+			return Rotate(point - pivot) + pivot + translation;
+		}
+	};
+
+
+	inline Vector3 Lerp(const Vector3& from, const Vector3& to, float t)
+	{
+		return from + (to - from) * t;
+	}
+}
+
+
+// Moves one object, light or the camera. Each keeps what it moves as it was when the track was made
+class Animation::Track
+{
+public:
+	std::vector<Key> Keys;
+
+	virtual ~Track() {}
+
+	virtual const void* GetTarget() const=0;
+	// what the first key rotates about if it gives no pivot
+	virtual Vector3 GetPivot() const=0;
+	virtual void Apply(Scene& scene, const Transform& transform) const=0;
+
+	// the transform at time, between the keys either side of it
+	Key Interpolate(float time) const
+	{
+		if (time <= Keys.front().Time)
+			return Keys.front();
+		if (time >= Keys.back().Time)
+			return Keys.back();
+
+		std::size_t next = 1;
+		while (Keys[next].Time < time)
+			++next;
+
+		const Key& from = Keys[next - 1];
+		const Key& to = Keys[next];
+		float t = to.Time > from.Time ? (time - from.Time) / (to.Time - from.Time) : 1.0f;
+
+		Key key;
+		key.Time = time;
+		key.Rotation = Lerp(from.Rotation, to.Rotation, t);
+		key.Translation = Lerp(from.Translation, to.Translation, t);
+		key.Pivot = Lerp(from.Pivot, to.Pivot, t);
+		key.HasPivot = true;
+		return key;
+	}
+};
+
+
+namespace
+{
+	class SphereTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<Sphere> sphere;
+		Vector3 centre;
+
+	public:
+		explicit SphereTrack(const boost::shared_ptr<Sphere>& sphere) : sphere(sphere), centre(sphere->Centre) {}
+
+		const void* GetTarget() const { return sphere.get(); }
+		Vector3 GetPivot() const { return centre; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			sphere->Centre = transform.Move(centre);
+			scene.UpdateObject(sphere);
+		}
+	};
+
+
+	class PlaneTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<Plane> plane;
+		// the plane's point nearest the origin
+		Vector3 normal, point;
+
+	public:
+		explicit PlaneTrack(const boost::shared_ptr<Plane>& plane)
+			: plane(plane), normal(plane->Normal), point(plane->Normal * -plane->Distance)
+		{}
+
+		const void* GetTarget() const { return plane.get(); }
+		Vector3 GetPivot() const { return point; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			plane->Normal = transform.Rotate(normal);
+			plane->Distance = -Vector3::Dot(plane->Normal, transform.Move(point));
+			scene.UpdateObject(plane);
+		}
+	};
+
+
+	class TriangleTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<Triangle> triangle;
+		Vector3 a, b, c;
+
+	public:
+		explicit TriangleTrack(const boost::shared_ptr<Triangle>& triangle)
+			: triangle(triangle), a(triangle->A), b(triangle->B), c(triangle->C)
+		{}
+
+		const void* GetTarget() const { return triangle.get(); }
+		Vector3 GetPivot() const { return triangle->GetBounds().GetCentre(); }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			triangle->A = transform.Move(a);
+			triangle->B = transform.Move(b);
+			triangle->C = transform.Move(c);
+			scene.UpdateObject(triangle);
+		}
+	};
+
+
+	class CubeTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<Cube> cube;
+		Vector3 axisX, axisY, axisZ, centre;
+
+	public:
+		explicit CubeTrack(const boost::shared_ptr<Cube>& cube)
+			: cube(cube), axisX(cube->AxisX), axisY(cube->AxisY), axisZ(cube->AxisZ), centre(cube->Centre)
+		{}
+
+		const void* GetTarget() const { return cube.get(); }
+		Vector3 GetPivot() const { return centre; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			cube->AxisX = transform.Rotate(axisX);
+			cube->AxisY = transform.Rotate(axisY);
+			cube->AxisZ = transform.Rotate(axisZ);
+			cube->Centre = transform.Move(centre);
+			scene.UpdateObject(cube);
+		}
+	};
+
+
+	// A box stays lined up with the axes, so it only moves: rotating keys carry it around the pivot
+	// without turning it. Animate a cube to turn it
+	class BoxTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<Box> box;
+		Vector3 min, max;
+
+	public:
+		explicit BoxTrack(const boost::shared_ptr<Box>& box)
+			: box(box), min(box->Min), max(box->Max)
+		{}
+
+		const void* GetTarget() const { return box.get(); }
+		Vector3 GetPivot() const { return (min + max) * 0.5f; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			Vector3 offset = transform.Move(GetPivot()) - GetPivot();
+			box->Min = min + offset;
+			box->Max = max + offset;
+			scene.UpdateObject(box);
+		}
+	};
+
+
+	class MeshTrack : public Animation::Track
+	{
+	private:
+		MeshPtr mesh;
+		Mesh::VertexContainer_t vertices, normals;
+		BoundingBox bounds;
+
+	public:
+		explicit MeshTrack(const MeshPtr& mesh)
+			: mesh(mesh),
+			vertices(mesh->GetVertices().data(), mesh->GetVertices().data() + mesh->GetVertices().size()),
+			normals(mesh->GetNormals().data(), mesh->GetNormals().data() + mesh->GetNormals().size()),
+			bounds(mesh->GetBounds())
+		{}
+
+		const void* GetTarget() const { return mesh.get(); }
+		Vector3 GetPivot() const { return bounds.GetCentre(); }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			Mesh::VertexContainer_t moved(vertices.size()), turned(normals.size());
+			for (std::size_t i=0; i<vertices.size(); ++i)
+				moved[i] = transform.Move(vertices[i]);
+			for (std::size_t i=0; i<normals.size(); ++i)
+				turned[i] = transform.Rotate(normals[i]);
+
+			mesh->SetVertices(moved, turned);
+			scene.UpdateObject(mesh);
+		}
+	};
+
+
+	class PointLightTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<PointLight> light;
+		Vector3 position;
+
+	public:
+		explicit PointLightTrack(const boost::shared_ptr<PointLight>& light) : light(light), position(light->Position) {}
+
+		const void* GetTarget() const { return light.get(); }
+		Vector3 GetPivot() const { return position; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			light->Position = transform.Move(position);
+			scene.UpdateLight(light);
+		}
+	};
+
+
+	class DirectionalLightTrack : public Animation::Track
+	{
+	private:
+		boost::shared_ptr<DirectionalLight> light;
+		Vector3 direction;
+
+	public:
+		explicit DirectionalLightTrack(const boost::shared_ptr<DirectionalLight>& light) : light(light), direction(light->Direction) {}
+
+		const void* GetTarget() const { return light.get(); }
+		Vector3 GetPivot() const { return Vector3(); }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			light->Direction = transform.Rotate(direction);
+			scene.UpdateLight(light);
+		}
+	};
+
+
+	// only the position and orientation are animated, so the scene's resolution is kept
+	class CameraTrack : public Animation::Track
+	{
+	private:
+		Vector3 position, forward, up;
+
+	public:
+		explicit CameraTrack(const Camera& camera)
+			: position(camera.GetPosition()), forward(camera.GetForward()), up(camera.GetUp())
+		{}
+
+		const void* GetTarget() const { return NULL; }
+		Vector3 GetPivot() const { return position; }
+
+		void Apply(Scene& scene, const Transform& transform) const
+		{
+			Camera camera = scene.GetCamera();
+			camera.SetPosition(transform.Move(position));
+			camera.SetOrientation(transform.Rotate(forward), transform.Rotate(up));
+			scene.SetCamera(camera);
+		}
+	};
+}
+
+
+Animation::TrackPtr_t Animation::FindTrack(const void* target) const
+{
+	for (std::size_t i=0; i<tracks.size(); ++i)
+	{
+		if (tracks[i]->GetTarget() == target)
+			return tracks[i];
+	}
+	return TrackPtr_t();
+}
+
+
+void Animation::AddKey(Track& track, const Key& key)
+{
+	if (!track.Keys.empty() && key.Time < track.Keys.back().Time)
+		throw SDL::Exception("Keys must be added in order of time");
+
+	track.Keys.push_back(key);
+	if (!key.HasPivot)
+	{
+		track.Keys.back().Pivot = track.Keys.size() > 1 ? track.Keys[track.Keys.size() - 2].Pivot : track.GetPivot();
+		track.Keys.back().HasPivot = true;
+	}
+}
+
+
+void Animation::AddKey(const Scene::ObjectPtr_t& object, const Key& key)
+{
+	TrackPtr_t track = FindTrack(object.get());
+	if (!track)
+	{
+		if (boost::shared_ptr<Sphere> sphere = boost::dynamic_pointer_cast<Sphere>(object))
+			track.reset(new SphereTrack(sphere));
+		else if (boost::shared_ptr<Plane> plane = boost::dynamic_pointer_cast<Plane>(object))
+			track.reset(new PlaneTrack(plane));
+		else if (boost::shared_ptr<Triangle> triangle = boost::dynamic_pointer_cast<Triangle>(object))
+			track.reset(new TriangleTrack(triangle));
+		else if (boost::shared_ptr<Cube> cube = boost::dynamic_pointer_cast<Cube>(object))
+			track.reset(new CubeTrack(cube));
+		else if (boost::shared_ptr<Box> box = boost::dynamic_pointer_cast<Box>(object))
+			track.reset(new BoxTrack(box));
+		else if (MeshPtr mesh = boost::dynamic_pointer_cast<Mesh>(object))
+			track.reset(new MeshTrack(mesh));
+		else
+			throw SDL::Exception("Objects of this type cannot be animated");
+
+		tracks.push_back(track);
+	}
+
+	AddKey(*track, key);
+}
+
+
+void Animation::AddKey(const Scene::LightPtr_t& light, const Key& key)
+{
+	TrackPtr_t track = FindTrack(light.get());
+	if (!track)
+	{
+		if (boost::shared_ptr<PointLight> point = boost::dynamic_pointer_cast<PointLight>(light))
+			track.reset(new PointLightTrack(point));
+		else if (boost::shared_ptr<DirectionalLight> directional = boost::dynamic_pointer_cast<DirectionalLight>(light))
+			track.reset(new DirectionalLightTrack(directional));
+		else
+			throw SDL::Exception("Lights of this type cannot be animated");
+
+		tracks.push_back(track);
+	}
+
+	AddKey(*track, key);
+}
+
+
+void Animation::AddCameraKey(const Camera& camera, const Key& key)
+{
+	if (!cameraTrack)
+	{
+		cameraTrack.reset(new CameraTrack(camera));
+		tracks.push_back(cameraTrack);
+	}
+
+	AddKey(*cameraTrack, key);
+}
+
+
+float Animation::GetStartTime() const
+{
+	float start = tracks.empty() ? 0.0f : tracks[0]->Keys.front().Time;
+	for (std::size_t i=1; i<tracks.size(); ++i)
+		start = std::min(start, tracks[i]->Keys.front().Time);
+	return start;
+}
+
+
+float Animation::GetEndTime() const
+{
+	float end = tracks.empty() ? 0.0f : tracks[0]->Keys.back().Time;
+	for (std::size_t i=1; i<tracks.size(); ++i)
+		end = std::max(end, tracks[i]->Keys.back().Time);
+	return end;
+}
+
+
+void Animation::Apply(Scene& scene, float time) const
+{
+	for (std::size_t i=0; i<tracks.size(); ++i)
+		tracks[i]->Apply(scene, Transform(tracks[i]->Interpolate(time)));
+}
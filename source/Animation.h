@@ -0,0 +1,64 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "Scene.h"
+#include "Vector3.h"
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+
+// Keyframed motion of a scene's objects, lights and camera. Each one animated has a track of keys, a
+// key being a time in seconds and a transform relative to where the thing was when its track was made:
+// a rotation by angles in degrees about the X, Y and Z axes, in that order, about a pivot point, then a
+// translation. Between keys the transforms are interpolated linearly; before the first key and after
+// the last the nearest one holds.
+//
+// Objects are moved by rewriting their geometry from a copy of where they started, so errors do not
+// build up from frame to frame, and the scene is told so it refits its hierarchies around them.
+class Animation
+{
+public:
+	class Key
+	{
+	public:
+		float Time;
+		Vector3 Rotation, Translation;
+		// Without one the key rotates about the previous key's pivot, or for the first key the centre of
+		// the object's bounds (a plane's point nearest the origin), or where the camera or light is
+		Vector3 Pivot;
+		bool HasPivot;
+
+		Key() : Time(0.0f), HasPivot(false) {}
+	};
+
+	class Track;
+	typedef boost::shared_ptr<Track> TrackPtr_t;
+
+private:
+	// the camera's track is also among the others
+	std::vector<TrackPtr_t> tracks;
+	TrackPtr_t cameraTrack;
+
+	TrackPtr_t FindTrack(const void* target) const;
+	void AddKey(Track& track, const Key& key);
+
+public:
+	// Keys must be added in order of time for each track. Objects of a type the animation cannot move
+	// throw an SDL::Exception. The camera's track starts from the camera given with its first key
+	void AddKey(const Scene::ObjectPtr_t& object, const Key& key);
+	void AddKey(const Scene::LightPtr_t& light, const Key& key);
+	void AddCameraKey(const Camera& camera, const Key& key);
+
+	inline bool IsEmpty() const { return tracks.empty(); }
+	// times of the earliest and latest keys
+	float GetStartTime() const;
+	float GetEndTime() const;
+
+	// Moves everything animated to where it is at time and tells the scene what changed. The scene must
+	// not be rendering
+	void Apply(Scene& scene, float time) const;
+};
+
+
+#endif
@@ -0,0 +1,336 @@
+
+
+#include "BVH.h"
+#include "CacheStream.h"
+
+#include <algorithm>
+
+
+namespace
+{
+	const int BIN_COUNT = 16;
+	const float TRAVERSAL_COST = 1.0f;
+	const float INTERSECTION_COST = 1.0f;
+
+
+	inline float GetAxis(const Vector3& vec, int axis)
+	{
+		return axis == 0 ? vec.X : (axis == 1 ? vec.Y : vec.Z);
+	}
+
+
+	class BuildEntry
+	{
+	public:
+		boost::uint32_t Node, Begin, End;
+		int Depth;
+	};
+
+
+	class Bin
+	{
+	public:
+		BoundingBox Bounds;
+		int Count;
+
+		Bin() : Count(0) {}
+	};
+}
+
+
+const boost::uint32_t BVH::NO_PARENT;
+
+
+BVH::BVH()
+	: weightedArea(0.0), buildCost(0.0f)
+{
+}
+
+
+void BVH::Clear()
+{
+	nodes.clear();
+	indices.clear();
+	parents.clear();
+	leaves.clear();
+	weightedArea = 0.0;
+	buildCost = 0.0f;
+}
+
+
+void BVH::Build(const std::vector<BoundingBox>& bounds, int maxLeafSize)
+{
+	Clear();
+
+	if (bounds.empty())
+		return;
+
+	const boost::uint32_t count = (boost::uint32_t)bounds.size();
+
+	std::vector<Vector3> centres(count);
+	indices.resize(count);
+	for (boost::uint32_t i=0; i<count; ++i)
+	{
+		indices[i] = i;
+		centres[i] = bounds[i].GetCentre();
+	}
+
+	nodes.reserve(count * 2);
+	nodes.resize(1);
+
+	std::vector<BuildEntry> work;
+	BuildEntry root = { 0, 0, count, 0 };
+	work.push_back(root);
+
+	while (!work.empty())
+	{
+		BuildEntry entry = work.back();
+		work.pop_back();
+
+		BoundingBox nodeBounds, centreBounds;
+		for (boost::uint32_t i=entry.Begin; i<entry.End; ++i)
+		{
+			nodeBounds.Expand(bounds[indices[i]]);
+			centreBounds.Expand(centres[indices[i]]);
+		}
+
+		nodes[entry.Node].Bounds = nodeBounds;
+		nodes[entry.Node].Offset = entry.Begin;
+		nodes[entry.Node].Count = entry.End - entry.Begin;
+
+		const boost::uint32_t primitiveCount = entry.End - entry.Begin;
+		if ((int)primitiveCount <= maxLeafSize || entry.Depth >= MAX_DEPTH - 1)
+			continue;
+
+		// split along the axis with the widest spread of centres
+		Vector3 extent = centreBounds.Max - centreBounds.Min;
+		int axis = 0;
+		if (extent.Y > extent.X)
+			axis = 1;
+		if (extent.Z > GetAxis(extent, axis))
+			axis = 2;
+
+		const float axisMin = GetAxis(centreBounds.Min, axis);
+		const float axisExtent = GetAxis(extent, axis);
+		if (axisExtent <= 0.0f)
+			continue; // all centres coincide, nothing to gain from splitting
+
+		// bin the centres and evaluate the surface area heuristic at each bin boundary
+		Bin bins[BIN_COUNT];
+		const float binScale = (float)BIN_COUNT / axisExtent;
+		for (boost::uint32_t i=entry.Begin; i<entry.End; ++i)
+		{
+			int bin = std::min(BIN_COUNT - 1, (int)((GetAxis(centres[indices[i]], axis) - axisMin) * binScale));
+			bins[bin].Count++;
+			bins[bin].Bounds.Expand(bounds[indices[i]]);
+		}
+
+		float rightArea[BIN_COUNT];
+		int rightCount[BIN_COUNT];
+		BoundingBox accumulated;
+		int accumulatedCount = 0;
+		for (int i=BIN_COUNT-1; i>0; --i)
+		{
+			accumulated.Expand(bins[i].Bounds);
+			accumulatedCount += bins[i].Count;
+			rightArea[i] = accumulated.GetSurfaceArea();
+			rightCount[i] = accumulatedCount;
+		}
+
+		float bestCost = std::numeric_limits<float>::max();
+		int bestSplit = -1;
+		accumulated = BoundingBox();
+		accumulatedCount = 0;
+		for (int i=1; i<BIN_COUNT; ++i)
+		{
+			accumulated.Expand(bins[i - 1].Bounds);
+			accumulatedCount += bins[i - 1].Count;
+			if (accumulatedCount == 0 || rightCount[i] == 0)
+				continue;
+
+			float cost = accumulated.GetSurfaceArea() * accumulatedCount + rightArea[i] * rightCount[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		const float parentArea = nodeBounds.GetSurfaceArea();
+		const float leafCost = INTERSECTION_COST * primitiveCount;
+		boost::uint32_t middle;
+
+		if (bestSplit >= 0 && parentArea > 0.0f)
+		{
+			float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / parentArea;
+			if (splitCost >= leafCost && (int)primitiveCount <= maxLeafSize * 4)
+				continue; // cheaper to leave as a leaf
+
+			const float splitPosition = axisMin + bestSplit / binScale;
+			middle = (boost::uint32_t)(std::partition(indices.begin() + entry.Begin, indices.begin() + entry.End,
+				[&](boost::uint32_t index) { return GetAxis(centres[index], axis) < splitPosition; }) - indices.begin());
+		}
+		else
+		{
+			middle = entry.Begin;
+		}
+
+		if (middle == entry.Begin || middle == entry.End)
+		{
+			// the heuristic could not separate the primitives, fall back to a median split
+			middle = entry.Begin + primitiveCount / 2;
+			std::nth_element(indices.begin() + entry.Begin, indices.begin() + middle, indices.begin() + entry.End,
+				[&](boost::uint32_t a, boost::uint32_t b) { return GetAxis(centres[a], axis) < GetAxis(centres[b], axis); });
+		}
+
+		boost::uint32_t left = (boost::uint32_t)nodes.size();
+		nodes.resize(nodes.size() + 2);
+		nodes[entry.Node].Offset = left;
+		nodes[entry.Node].Count = 0;
+
+		BuildEntry leftEntry = { left, entry.Begin, middle, entry.Depth + 1 };
+		BuildEntry rightEntry = { left + 1, middle, entry.End, entry.Depth + 1 };
+		work.push_back(rightEntry);
+		work.push_back(leftEntry);
+	}
+
+	Link();
+}
+
+
+double BVH::GetWeightedArea(const Node& node) const
+{
+	const float cost = node.IsLeaf() ? INTERSECTION_COST * node.Count : TRAVERSAL_COST;
+	return (double)node.Bounds.GetSurfaceArea() * cost;
+}
+
+
+// Finds the parents and leaves after a build, and the cost of the new tree
+void BVH::Link()
+{
+	parents.assign(nodes.size(), NO_PARENT);
+	leaves.assign(indices.size(), 0);
+	weightedArea = 0.0;
+
+	for (boost::uint32_t i=0; i<nodes.size(); ++i)
+	{
+		const Node& node = nodes[i];
+		weightedArea += GetWeightedArea(node);
+
+		if (node.IsLeaf())
+		{
+			for (boost::uint32_t j=node.Offset; j<node.Offset + node.Count; ++j)
+				leaves[indices[j]] = i;
+		}
+		else
+		{
+			parents[node.Offset] = i;
+			parents[node.Offset + 1] = i;
+		}
+	}
+
+	buildCost = GetCost();
+}
+
+
+float BVH::GetCost() const
+{
+	if (nodes.empty())
+		return 0.0f;
+
+	float rootArea = nodes[0].Bounds.GetSurfaceArea();
+	return rootArea > 0.0f ? (float)(weightedArea / rootArea) : 0.0f;
+}
+
+
+void BVH::Refit(const std::vector<BoundingBox>& bounds, const std::vector<boost::uint32_t>& changed)
+{
+	assert(nodes.IsOwner());
+
+	for (std::size_t i=0; i<changed.size(); ++i)
+	{
+		boost::uint32_t current = leaves[changed[i]];
+
+		while (current != NO_PARENT)
+		{
+			Node& node = nodes[current];
+
+			BoundingBox nodeBounds;
+			if (node.IsLeaf())
+			{
+				for (boost::uint32_t j=node.Offset; j<node.Offset + node.Count; ++j)
+					nodeBounds.Expand(bounds[indices[j]]);
+			}
+			else
+			{
+				nodeBounds = nodes[node.Offset].Bounds;
+				nodeBounds.Expand(nodes[node.Offset + 1].Bounds);
+			}
+
+			// nothing above can change either. Several primitives in one leaf also end here after the first
+			if (nodeBounds.Min.X == node.Bounds.Min.X && nodeBounds.Min.Y == node.Bounds.Min.Y && nodeBounds.Min.Z == node.Bounds.Min.Z
+				&& nodeBounds.Max.X == node.Bounds.Max.X && nodeBounds.Max.Y == node.Bounds.Max.Y && nodeBounds.Max.Z == node.Bounds.Max.Z)
+				break;
+
+			weightedArea -= GetWeightedArea(node);
+			node.Bounds = nodeBounds;
+			weightedArea += GetWeightedArea(node);
+
+			current = parents[current];
+		}
+	}
+}
+
+
+void BVH::Write(CacheWriter& writer) const
+{
+	writer.WriteArray(nodes);
+	writer.WriteArray(indices);
+	writer.Write(weightedArea);
+	writer.Write(buildCost);
+}
+
+
+void BVH::Map(CacheReader& reader, std::size_t primitiveCount)
+{
+	Clear();
+	reader.MapArray(nodes);
+	reader.MapArray(indices);
+	weightedArea = reader.Read<double>();
+	buildCost = reader.Read<float>();
+
+	reader.CheckIndices(indices, indices.size(), primitiveCount, "Hierarchy refers to a primitive which does not exist");
+
+	// The traversals trust the tree, so it must be one they can walk: children come after their parent,
+	// which rules out cycles, every node but the root has exactly one parent, so no part of the tree is
+	// walked more than once, no node is deeper than the stacks allow, and leaves cover indices that
+	// exist. Build lays trees out like this, parents first. A depth of -1 is a node with no parent yet
+	std::vector<int> depths(nodes.size(), -1);
+	if (!nodes.empty())
+		depths[0] = 0;
+
+	for (std::size_t i=0; i<nodes.size(); ++i)
+	{
+		const Node& node = GetNodes()[i];
+		if (depths[i] < 0)
+			throw reader.Error("Hierarchy node has no parent");
+		if (depths[i] >= MAX_DEPTH)
+			throw reader.Error("Hierarchy is too deep");
+
+		if (node.IsLeaf())
+		{
+			if ((boost::uint64_t)node.Offset + node.Count > indices.size())
+				throw reader.Error("Hierarchy leaf runs past its indices");
+			continue;
+		}
+
+		if (node.Offset <= i || (boost::uint64_t)node.Offset + 1 >= nodes.size())
+			throw reader.Error("Hierarchy node has children outside the tree");
+
+		if (depths[node.Offset] >= 0 || depths[node.Offset + 1] >= 0)
+			throw reader.Error("Hierarchy node has more than one parent");
+
+		depths[node.Offset] = depths[i] + 1;
+		depths[node.Offset + 1] = depths[i] + 1;
+	}
+}
@@ -0,0 +1,414 @@
+
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "BoundingBox.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "PackedArray.h"
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+class CacheWriter;
+class CacheReader;
+
+// Bounding volume hierarchy over an arbitrary list of primitives. The hierarchy only knows about
+// the primitives' bounding boxes; the owner supplies an intersector functor when tracing, which is
+// called with the index of each candidate primitive (as passed to Build).
+class BVH
+{
+public:
+	static const int MAX_DEPTH = 64;
+	static const boost::uint32_t NO_PARENT = 0xffffffff;
+
+	class Node
+	{
+	public:
+		BoundingBox Bounds;
+		// for leaves, Offset is the first entry in the index list and Count is the number of primitives.
+		// for interior nodes Count is 0 and the children are at Offset and Offset + 1
+		boost::uint32_t Offset;
+		boost::uint32_t Count;
+
+		inline bool IsLeaf() const { return Count > 0; }
+	};
+
+	// both can refer to a mapped scene cache instead of holding the tree themselves
+	typedef PackedArray<Node> NodeContainer_t;
+	typedef PackedArray<boost::uint32_t> IndexContainer_t;
+
+private:
+	NodeContainer_t nodes;
+	IndexContainer_t indices;
+
+	// for refitting: the parent of each node (NO_PARENT for the root), the leaf holding each primitive,
+	// and the surface area heuristic cost of the tree kept up to date as nodes change, unscaled by the
+	// root's area
+	std::vector<boost::uint32_t> parents, leaves;
+	double weightedArea;
+	float buildCost;
+
+	void Link();
+	// contribution of a node to weightedArea
+	double GetWeightedArea(const Node& node) const;
+
+	class StackEntry
+	{
+	public:
+		boost::uint32_t Node;
+		float Entry;
+	};
+
+	// adapters from the per primitive intersectors to the per leaf traversals
+	template <class Intersector>
+	class PrimitiveIntersector
+	{
+	private:
+		const IndexContainer_t& indices;
+		Intersector& intersector;
+
+	public:
+		PrimitiveIntersector(const IndexContainer_t& indices, Intersector& intersector) : indices(indices), intersector(intersector) {}
+
+		inline bool operator()(boost::uint32_t first, boost::uint32_t count, float& distance)
+		{
+			bool hit = false;
+			for (boost::uint32_t i=0; i<count; ++i)
+			{
+				if (intersector(indices[first + i], distance))
+					hit = true;
+			}
+			return hit;
+		}
+	};
+
+	template <class Intersector>
+	class AnyPrimitiveIntersector
+	{
+	private:
+		const IndexContainer_t& indices;
+		Intersector& intersector;
+
+	public:
+		AnyPrimitiveIntersector(const IndexContainer_t& indices, Intersector& intersector) : indices(indices), intersector(intersector) {}
+
+		inline bool operator()(boost::uint32_t first, boost::uint32_t count, float maxDistance)
+		{
+			for (boost::uint32_t i=0; i<count; ++i)
+			{
+				if (intersector(indices[first + i], maxDistance))
+					return true;
+			}
+			return false;
+		}
+	};
+
+	template <class Intersector>
+	class PacketPrimitiveIntersector
+	{
+	private:
+		const IndexContainer_t& indices;
+		Intersector& intersector;
+
+	public:
+		PacketPrimitiveIntersector(const IndexContainer_t& indices, Intersector& intersector) : indices(indices), intersector(intersector) {}
+
+		inline SimdMask operator()(boost::uint32_t first, boost::uint32_t count, const SimdMask& lanes, SimdFloat& distance)
+		{
+			SimdMask hit(false);
+			for (boost::uint32_t i=0; i<count; ++i)
+				hit = hit | intersector(indices[first + i], lanes, distance);
+			return hit;
+		}
+	};
+
+public:
+	BVH();
+
+	// Builds the hierarchy using the surface area heuristic. maxLeafSize is the largest number of
+	// primitives that will be placed in a single leaf.
+	void Build(const std::vector<BoundingBox>& bounds, int maxLeafSize = 4);
+	void Clear();
+
+	// Writes the built tree to a scene cache, and reads one back. A tree read back refers to the
+	// cache's memory, which must stay mapped while it is used, and can be traced but not refitted.
+	// primitiveCount is how many primitives it was built over, which its indices are checked against
+	void Write(CacheWriter& writer) const;
+	void Map(CacheReader& reader, std::size_t primitiveCount);
+
+	// Updates the tree after some primitives have moved, without changing its shape: the leaves holding
+	// them are given new bounds, and then their ancestors, stopping where a node's bounds come out the
+	// same. bounds is the whole list as given to Build, already holding the new bounds of the primitives
+	// listed in changed. The work is proportional to the number changed, not the size of the tree
+	void Refit(const std::vector<BoundingBox>& bounds, const std::vector<boost::uint32_t>& changed);
+
+	// Surface area heuristic cost of the tree as it is now, and as it was built. Refitting moved
+	// primitives makes the nodes overlap more and the cost grow, and once it has grown too far the
+	// tree is better rebuilt
+	float GetCost() const;
+	inline float GetBuildCost() const { return buildCost; }
+
+	inline bool IsEmpty() const { return nodes.empty(); }
+	inline const NodeContainer_t& GetNodes() const { return nodes; }
+	inline const IndexContainer_t& GetIndices() const { return indices; }
+	inline BoundingBox GetBounds() const { return nodes.empty() ? BoundingBox() : nodes[0].Bounds; }
+
+
+	// Closest hit traversal. intersector( primitiveIndex, distance ) must return true and lower
+	// distance if it finds a nearer hit than the distance it was given. Children are visited front
+	// to back and skipped once they are further away than the nearest hit so far.
+	template <class Intersector>
+	bool Intersect(const Ray& ray, float& distance, Intersector& intersector) const
+	{
+		PrimitiveIntersector<Intersector> leafIntersector(indices, intersector);
+		return IntersectLeaves(ray, distance, leafIntersector);
+	}
+
+	// Closest hit traversal which hands over whole leaves. intersector( first, count, distance ) is
+	// given the range of the index list covered by the leaf, for owners which store their primitives
+	// in index list order and can test a leaf's primitives together
+	template <class LeafIntersector>
+	bool IntersectLeaves(const Ray& ray, float& distance, LeafIntersector& intersector) const
+	{
+		if (nodes.empty())
+			return false;
+
+		Vector3 invDirection = BoundingBox::GetInverseDirection(ray.Direction);
+
+		float entry;
+		if (!nodes[0].Bounds.Intersect(ray.Origin, invDirection, distance, entry))
+			return false;
+
+		StackEntry stack[MAX_DEPTH];
+		int stackSize = 0;
+		boost::uint32_t current = 0;
+		bool hit = false;
+
+		while (true)
+		{
+			const Node& node = nodes[current];
+
+			if (node.IsLeaf())
+			{
+				if (intersector(node.Offset, node.Count, distance))
+					hit = true;
+			}
+			else
+			{
+				float entryLeft, entryRight;
+				bool hitLeft = nodes[node.Offset].Bounds.Intersect(ray.Origin, invDirection, distance, entryLeft);
+				bool hitRight = nodes[node.Offset + 1].Bounds.Intersect(ray.Origin, invDirection, distance, entryRight);
+
+				if (hitLeft && hitRight)
+				{
+					// descend into the nearer child and come back for the other one later
+					if (entryLeft <= entryRight)
+					{
+						stack[stackSize].Node = node.Offset + 1;
+						stack[stackSize].Entry = entryRight;
+						current = node.Offset;
+					}
+					else
+					{
+						stack[stackSize].Node = node.Offset;
+						stack[stackSize].Entry = entryLeft;
+						current = node.Offset + 1;
+					}
+					++stackSize;
+					continue;
+				}
+				else if (hitLeft)
+				{
+					current = node.Offset;
+					continue;
+				}
+				else if (hitRight)
+				{
+					current = node.Offset + 1;
+					continue;
+				}
+			}
+
+			// pop the next node which is still closer than the nearest hit
+			while (stackSize > 0 && stack[stackSize - 1].Entry >= distance)
+				--stackSize;
+
+			if (stackSize == 0)
+				break;
+
+			current = stack[--stackSize].Node;
+		}
+
+		return hit;
+	}
+
+
+	// Closest hit traversal for a packet of rays. A node is visited if any active lane hits it closer
+	// than that lane's nearest hit, and the intersector is called with the lanes that reached the leaf:
+	// intersector( primitiveIndex, lanes, distance ) lowers distance in the lanes it hits and returns
+	// them. Returns the lanes that hit anything.
+	template <class Intersector>
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, Intersector& intersector) const
+	{
+		PacketPrimitiveIntersector<Intersector> leafIntersector(indices, intersector);
+		return IntersectPacketLeaves(packet, active, distance, leafIntersector);
+	}
+
+	// Packet traversal handing over whole leaves, as intersector( first, count, lanes, distance )
+	template <class LeafIntersector>
+	SimdMask IntersectPacketLeaves(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, LeafIntersector& intersector) const
+	{
+		SimdMask hit(false);
+		if (nodes.empty() || !active.Any())
+			return hit;
+
+		SimdVector3 invDirection = BoundingBox::GetInverseDirection(packet.Direction);
+
+		SimdFloat entry;
+		SimdMask lanes = active & nodes[0].Bounds.Intersect(packet.Origin, invDirection, distance, entry);
+		if (!lanes.Any())
+			return hit;
+
+		// the lanes which reached each node are kept alongside it, so leaves only trace those
+		StackEntry stack[MAX_DEPTH];
+		SimdMask stackLanes[MAX_DEPTH];
+		int stackSize = 0;
+		boost::uint32_t current = 0;
+
+		while (true)
+		{
+			const Node& node = nodes[current];
+
+			if (node.IsLeaf())
+				hit = hit | intersector(node.Offset, node.Count, lanes, distance);
+			else
+			{
+				SimdFloat entryLeft, entryRight;
+				SimdMask hitLeft = lanes & nodes[node.Offset].Bounds.Intersect(packet.Origin, invDirection, distance, entryLeft);
+				SimdMask hitRight = lanes & nodes[node.Offset + 1].Bounds.Intersect(packet.Origin, invDirection, distance, entryRight);
+
+				if (hitLeft.Any() && hitRight.Any())
+				{
+					// the child the packet reaches first is traced first
+					const float infinity = std::numeric_limits<float>::infinity();
+					float nearLeft = SimdFloat::HorizontalMin(SimdFloat::Select(hitLeft, entryLeft, infinity));
+					float nearRight = SimdFloat::HorizontalMin(SimdFloat::Select(hitRight, entryRight, infinity));
+
+					if (nearLeft <= nearRight)
+					{
+						stack[stackSize].Node = node.Offset + 1;
+						stack[stackSize].Entry = nearRight;
+						stackLanes[stackSize] = hitRight;
+						current = node.Offset;
+						lanes = hitLeft;
+					}
+					else
+					{
+						stack[stackSize].Node = node.Offset;
+						stack[stackSize].Entry = nearLeft;
+						stackLanes[stackSize] = hitLeft;
+						current = node.Offset + 1;
+						lanes = hitRight;
+					}
+					++stackSize;
+					continue;
+				}
+				else if (hitLeft.Any())
+				{
+					current = node.Offset;
+					lanes = hitLeft;
+					continue;
+				}
+				else if (hitRight.Any())
+				{
+					current = node.Offset + 1;
+					lanes = hitRight;
+					continue;
+				}
+			}
+
+			// pop the next node which some lane could still reach before its nearest hit
+			float furthest = SimdFloat::HorizontalMax(SimdFloat::Select(active, distance, -std::numeric_limits<float>::infinity()));
+			while (stackSize > 0 && stack[stackSize - 1].Entry >= furthest)
+				--stackSize;
+
+			if (stackSize == 0)
+				break;
+
+			--stackSize;
+			current = stack[stackSize].Node;
+			lanes = stackLanes[stackSize];
+		}
+
+		return hit;
+	}
+
+
+	// Any hit traversal for occlusion queries. intersector( primitiveIndex, maxDistance ) returns true
+	// if the primitive blocks the ray, which ends the traversal immediately. Nodes are visited in
+	// whatever order is cheapest since any hit will do.
+	template <class Intersector>
+	bool IntersectAny(const Ray& ray, float maxDistance, Intersector& intersector) const
+	{
+		AnyPrimitiveIntersector<Intersector> leafIntersector(indices, intersector);
+		return IntersectAnyLeaves(ray, maxDistance, leafIntersector);
+	}
+
+	// Any hit traversal handing over whole leaves, as intersector( first, count, maxDistance )
+	template <class LeafIntersector>
+	bool IntersectAnyLeaves(const Ray& ray, float maxDistance, LeafIntersector& intersector) const
+	{
+		if (nodes.empty())
+			return false;
+
+		Vector3 invDirection = BoundingBox::GetInverseDirection(ray.Direction);
+
+		float entry;
+		if (!nodes[0].Bounds.Intersect(ray.Origin, invDirection, maxDistance, entry))
+			return false;
+
+		boost::uint32_t stack[MAX_DEPTH];
+		int stackSize = 0;
+		boost::uint32_t current = 0;
+
+		while (true)
+		{
+			const Node& node = nodes[current];
+
+			if (node.IsLeaf())
+			{
+				if (intersector(node.Offset, node.Count, maxDistance))
+					return true;
+			}
+			else
+			{
+				bool hitLeft = nodes[node.Offset].Bounds.Intersect(ray.Origin, invDirection, maxDistance, entry);
+				bool hitRight = nodes[node.Offset + 1].Bounds.Intersect(ray.Origin, invDirection, maxDistance, entry);
+
+				if (hitLeft)
+				{
+					if (hitRight)
+						stack[stackSize++] = node.Offset + 1;
+					current = node.Offset;
+					continue;
+				}
+				else if (hitRight)
+				{
+					current = node.Offset + 1;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+				return false;
+
+			current = stack[--stackSize];
+		}
+	}
+};
+
+
+#endif
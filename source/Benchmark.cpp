@@ -0,0 +1,258 @@
+#include "Benchmark.h"
+#include "BenchmarkScenes.h"
+#include "CacheMissCounter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+
+using namespace boost::placeholders;
+
+
+const int SPHERE_FIELD_COUNT = 10000;
+const int MESH_SEGMENTS = 510; // 520k triangles
+
+
+namespace
+{
+	typedef boost::chrono::steady_clock Clock_t;
+	typedef boost::chrono::duration<double, boost::milli> Milliseconds_t;
+
+
+	void BuildDemo(Scene& scene)
+	{
+		BuildDemoScene( scene );
+	}
+
+
+	// nearest rank percentile of sorted values
+	double Percentile(const std::vector<double>& sorted, double percent)
+	{
+		std::size_t rank = (std::size_t)std::ceil( percent / 100.0 * sorted.size() );
+		return sorted[ std::max<std::size_t>( rank, 1 ) - 1 ];
+	}
+}
+
+
+Benchmark::Benchmark(int width, int height, int frames, unsigned int threadCount)
+	: width(width), height(height), frames(frames), threadCount(threadCount), packets(true), antialiasing(1),
+	tileOrder(ORDER_ROWS), pixelOrder(ORDER_ROWS), compareOrders(false), tileSplitting(true)
+{
+}
+
+
+void Benchmark::AddStandardScenes()
+{
+	AddScene( "demo", &BuildDemo );
+	AddScene( "spheres", boost::bind( &BuildSphereFieldScene, _1, SPHERE_FIELD_COUNT ) );
+	AddScene( "mesh", boost::bind( &BuildMeshScene, _1, MESH_SEGMENTS ) );
+	AddScene( "mirrors", &BuildMirrorScene );
+}
+
+
+void Benchmark::AddScene(const std::string& name, const SceneBuilder_t& build)
+{
+	scenes.push_back( Entry( name, build ) );
+}
+
+
+bool Benchmark::HasScene(const std::string& name) const
+{
+	for (EntryContainer_t::const_iterator i=scenes.begin(); i!=scenes.end(); ++i)
+	{
+		if (i->Name == name)
+			return true;
+	}
+
+	return false;
+}
+
+
+void Benchmark::Run(const std::string& name, std::ostream& output) const
+{
+	std::ios_base::fmtflags flags = output.flags();
+	output << std::fixed << std::setprecision( 3 );
+
+	output << "{\n";
+	output << "  \"width\": " << width << ",\n";
+	output << "  \"height\": " << height << ",\n";
+	output << "  \"frames\": " << frames << ",\n";
+	output << "  \"packet_size\": " << (packets ? RayPacket::Size : 1) << ",\n";
+	output << "  \"antialiasing\": " << antialiasing << ",\n";
+	output << "  \"threads\": " << TileScheduler::ResolveThreadCount( threadCount ) << ",\n";
+	output << "  \"tile_order\": \"" << SpaceFillingCurve::GetName( tileOrder ) << "\",\n";
+	output << "  \"pixel_order\": \"" << SpaceFillingCurve::GetName( pixelOrder ) << "\",\n";
+	output << "  \"tile_splitting\": " << ( tileSplitting ? "true" : "false" ) << ",\n";
+	output << "  \"cache_counters\": " << ( CacheMissCounter( false ).IsAvailable() ? "true" : "false" ) << ",\n";
+	output << "  \"scenes\": [";
+
+	bool first = true;
+	for (EntryContainer_t::const_iterator i=scenes.begin(); i!=scenes.end(); ++i)
+	{
+		if (!name.empty() && i->Name != name)
+			continue;
+
+		output << (first ? "\n" : ",\n");
+		RunScene( *i, output );
+		first = false;
+	}
+
+	output << "\n  ]\n}\n";
+	output.flags( flags );
+}
+
+
+void Benchmark::RunScene(const Entry& entry, std::ostream& output) const
+{
+	SDL::SurfacePtr frameBuffer = SDL::Surface::CreateRGBSurface( 0, width, height, 32,
+		0x00ff0000, 0x0000ff00, 0x000000ff, 0 );
+
+	Clock_t::time_point buildStart = Clock_t::now();
+	Scene scene( SDL::WindowPtr(), frameBuffer, threadCount );
+	scene.SetPacketTracing( packets );
+	scene.SetAntialiasing( antialiasing );
+	scene.SetTileOrder( tileOrder );
+	scene.SetPixelOrder( pixelOrder );
+	scene.SetTileSplitting( tileSplitting );
+	entry.Build( scene );
+	double buildTime = Milliseconds_t( Clock_t::now() - buildStart ).count();
+
+	// the first frame also builds the hierarchy, so it is reported on its own
+	Clock_t::time_point firstStart = Clock_t::now();
+	scene.Render();
+	double firstFrameTime = Milliseconds_t( Clock_t::now() - firstStart ).count();
+
+	std::vector<double> frameTimes;
+	RenderStatistics rays;
+	scene.ResetSchedulerStatistics();
+	for (int frame=0; frame<frames; ++frame)
+	{
+		Clock_t::time_point start = Clock_t::now();
+		scene.Render();
+		frameTimes.push_back( Milliseconds_t( Clock_t::now() - start ).count() );
+		rays += scene.GetStatistics();
+	}
+
+	double totalTime = 0.0;
+	for (std::size_t i=0; i<frameTimes.size(); ++i)
+		totalTime += frameTimes[i];
+
+	std::vector<double> sorted = frameTimes;
+	std::sort( sorted.begin(), sorted.end() );
+	double seconds = totalTime / 1000.0;
+	const SchedulerStatistics& work = scene.GetSchedulerStatistics();
+
+	output << "    {\n";
+	output << "      \"name\": \"" << entry.Name << "\",\n";
+	output << "      \"objects\": " << scene.GetObjectCount() << ",\n";
+	output << "      \"build_ms\": " << buildTime << ",\n";
+	output << "      \"first_frame_ms\": " << firstFrameTime << ",\n";
+	output << "      \"primary_rays\": " << rays.PrimaryRays << ",\n";
+	output << "      \"shadow_rays\": " << rays.ShadowRays << ",\n";
+	output << "      \"reflection_rays\": " << rays.ReflectionRays << ",\n";
+	output << "      \"antialias_rays\": " << rays.AntialiasRays << ",\n";
+	output << "      \"primary_rays_per_sec\": " << rays.PrimaryRays / seconds << ",\n";
+	output << "      \"total_rays_per_sec\": " << rays.GetTotalRays() / seconds << ",\n";
+	output << "      \"frame_ms\": {\n";
+	output << "        \"mean\": " << totalTime / frames << ",\n";
+	output << "        \"min\": " << sorted.front() << ",\n";
+	output << "        \"p50\": " << Percentile( sorted, 50.0 ) << ",\n";
+	output << "        \"p90\": " << Percentile( sorted, 90.0 ) << ",\n";
+	output << "        \"p99\": " << Percentile( sorted, 99.0 ) << ",\n";
+	output << "        \"max\": " << sorted.back() << "\n";
+	output << "      },\n";
+	// the share of the threads' time spent waiting for the others at the end of each pass
+	output << "      \"scheduler\": {\n";
+	output << "        \"tasks_per_frame\": " << (double)work.Tasks / frames << ",\n";
+	output << "        \"split_tiles_per_frame\": " << (double)work.SplitTiles / frames << ",\n";
+	output << "        \"steals_per_frame\": " << (double)work.Steals / frames << ",\n";
+	output << "        \"idle_percent\": " << ( work.ThreadSeconds > 0.0 ? 100.0 * ( work.ThreadSeconds - work.BusySeconds ) / work.ThreadSeconds : 0.0 ) << "\n";
+	output << "      }";
+
+	if ( compareOrders )
+	{
+		const CURVE_ORDER orders[] = { ORDER_ROWS, ORDER_MORTON, ORDER_HILBERT };
+		std::vector<OrderResult> results;
+		for ( std::size_t i=0; i<sizeof( orders ) / sizeof( orders[0] ); ++i )
+			results.push_back( MeasureOrder( entry, orders[i] ) );
+
+		// relative to rows, the order the renderer always used
+		const OrderResult& rows = results.front();
+		bool counted = CacheMissCounter( false ).IsAvailable();
+
+		output << ",\n      \"orders\": [";
+		for ( std::size_t i=0; i<results.size(); ++i )
+		{
+			const OrderResult& result = results[i];
+			output << ( i == 0 ? "\n" : ",\n" );
+			output << "        {\n";
+			output << "          \"order\": \"" << SpaceFillingCurve::GetName( result.Order ) << "\",\n";
+			output << "          \"frame_ms\": " << result.FrameTime << ",\n";
+			output << "          \"total_rays_per_sec\": " << result.RaysPerSecond << ",\n";
+			output << "          \"speedup_vs_rows\": " << rows.FrameTime / result.FrameTime << ",\n";
+			if ( counted )
+			{
+				output << "          \"cache_misses_per_frame\": " << result.CacheMisses << ",\n";
+				output << "          \"cache_misses_vs_rows_percent\": " << ( rows.CacheMisses > 0.0 ? 100.0 * ( result.CacheMisses - rows.CacheMisses ) / rows.CacheMisses : 0.0 ) << "\n";
+			}
+			else
+			{
+				output << "          \"cache_misses_per_frame\": null,\n";
+				output << "          \"cache_misses_vs_rows_percent\": null\n";
+			}
+			output << "        }";
+		}
+		output << "\n      ]";
+	}
+
+	output << "\n    }";
+	output.flush();
+}
+
+
+// Renders the scene with tiles and pixels both in the order given, in a scene of its own: the counters
+// only take in the misses of the render threads once they have exited, which they do with the scene.
+// The misses of this thread, building the scene and its hierarchy, are taken out
+Benchmark::OrderResult Benchmark::MeasureOrder(const Entry& entry, CURVE_ORDER order) const
+{
+	OrderResult result = OrderResult();
+	result.Order = order;
+
+	CacheMissCounter all( true ), own( false );
+	RenderStatistics rays;
+	double totalTime = 0.0;
+	{
+		SDL::SurfacePtr frameBuffer = SDL::Surface::CreateRGBSurface( 0, width, height, 32,
+			0x00ff0000, 0x0000ff00, 0x000000ff, 0 );
+
+		Scene scene( SDL::WindowPtr(), frameBuffer, threadCount );
+		scene.SetPacketTracing( packets );
+		scene.SetAntialiasing( antialiasing );
+		scene.SetTileOrder( order );
+		scene.SetPixelOrder( order );
+		scene.SetTileSplitting( tileSplitting );
+		entry.Build( scene );
+		scene.Render();
+
+		for (int frame=0; frame<frames; ++frame)
+		{
+			Clock_t::time_point start = Clock_t::now();
+			scene.Render();
+			totalTime += Milliseconds_t( Clock_t::now() - start ).count();
+			rays += scene.GetStatistics();
+		}
+	}
+
+	// the untimed first frame was traced too. This thread's count is read first, so it is no more than
+	// its share of the other
+	boost::uint64_t ownMisses = own.Read();
+	boost::uint64_t allMisses = all.Read();
+	result.CacheMisses = (double)( allMisses - std::min( ownMisses, allMisses ) ) / ( frames + 1 );
+	result.FrameTime = totalTime / frames;
+	result.RaysPerSecond = rays.GetTotalRays() / ( totalTime / 1000.0 );
+	return result;
+}
@@ -0,0 +1,82 @@
+
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "Scene.h"
+
+
+// Renders a fixed set of scenes offscreen and reports ray throughput and frame time percentiles as
+// JSON, so runs on different machines or revisions can be compared by a script.
+class Benchmark
+{
+public:
+	typedef boost::function<void (Scene&)> SceneBuilder_t;
+
+private:
+	class Entry
+	{
+	public:
+		std::string Name;
+		SceneBuilder_t Build;
+
+		Entry(const std::string& name, const SceneBuilder_t& build) : Name(name), Build(build) {}
+	};
+
+	typedef std::vector<Entry> EntryContainer_t;
+
+	// one scene rendered in one order, for comparing them
+	class OrderResult
+	{
+	public:
+		CURVE_ORDER Order;
+		double FrameTime, RaysPerSecond;
+		// cache misses of the render threads per frame, or 0 without the counters
+		double CacheMisses;
+	};
+
+	int width, height, frames;
+	unsigned int threadCount;
+	bool packets;
+	int antialiasing;
+	CURVE_ORDER tileOrder, pixelOrder;
+	bool compareOrders;
+	bool tileSplitting;
+	EntryContainer_t scenes;
+
+	void RunScene(const Entry& entry, std::ostream& output) const;
+	OrderResult MeasureOrder(const Entry& entry, CURVE_ORDER order) const;
+
+public:
+	// frames is the number of timed frames per scene; one untimed frame is rendered first
+	Benchmark(int width, int height, int frames, unsigned int threadCount = 0);
+
+	// the standard scenes: demo, spheres, mesh and mirrors
+	void AddStandardScenes();
+	void AddScene(const std::string& name, const SceneBuilder_t& build);
+
+	bool HasScene(const std::string& name) const;
+	inline void SetPacketTracing(bool on) { packets = on; }
+	// samples per edge pixel, as Scene::SetAntialiasing
+	inline void SetAntialiasing(int samples) { antialiasing = samples; }
+	// the orders the scenes are traced in, as Scene::SetTileOrder and Scene::SetPixelOrder
+	inline void SetTileOrder(CURVE_ORDER order) { tileOrder = order; }
+	inline void SetPixelOrder(CURVE_ORDER order) { pixelOrder = order; }
+	// Also renders each scene with both orders set to each curve in turn, and reports the frame time,
+	// ray throughput and, where the processor's counters can be read, cache misses of each
+	inline void SetCompareOrders(bool on) { compareOrders = on; }
+	// as Scene::SetTileSplitting
+	inline void SetTileSplitting(bool on) { tileSplitting = on; }
+
+	// Runs the named scene, or every scene if name is empty, and writes the report to output
+	void Run(const std::string& name, std::ostream& output) const;
+};
+
+
+#endif
@@ -0,0 +1,195 @@
+#include "BenchmarkScenes.h"
+#include "Mesh.h"
+
+#include <cmath>
+
+
+namespace
+{
+	// small deterministic generator, so the scenes don't depend on the standard library's rand()
+	class Random
+	{
+	private:
+		boost::uint32_t state;
+
+	public:
+		explicit Random(boost::uint32_t seed) : state(seed) {}
+
+		// uniform in [min, max)
+		float Next(float min, float max)
+		{
+			state = state * 1664525u + 1013904223u;
+			return min + (max - min) * (float)(state >> 8) / 16777216.0f;
+		}
+	};
+
+
+	void AddFloor(Scene& scene, float height)
+	{
+		Plane* plane = new Plane( 0, 1, 0, height );
+		plane->Material.Diffuse = 1.0f;
+		plane->Material.Color = SDL::Color( 255, 255, 255, 255 );
+		scene.AddObject( Scene::ObjectPtr_t( plane ) );
+	}
+
+
+	void AddPointLight(Scene& scene, const Vector3& position)
+	{
+		PointLight* light = new PointLight();
+		light->Position = position;
+		scene.AddLight( Scene::LightPtr_t( light ) );
+	}
+}
+
+
+boost::shared_ptr<Sphere> BuildDemoScene(Scene& scene)
+{
+	Plane* plane = new Plane( 0, 1, -0.05f, 250.0f );
+	plane->Material.Reflectivity = 0.0f;
+	plane->Material.Diffuse = 1.0f;
+	plane->Material.Color = SDL::Color( 255, 255, 255, 255 );
+	scene.AddObject( Scene::ObjectPtr_t( plane ) );
+
+	Sphere* sphere = new Sphere();
+	sphere->Radius = 150.0f;
+	sphere->Material.Color = SDL::Color( 150, 50, 50, 0 );
+	sphere->Material.Diffuse = 0.5f;
+	sphere->Material.Specular = 0.5f;
+	sphere->Material.Reflectivity = 1.0f;
+	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
+
+	sphere = new Sphere();
+	boost::shared_ptr<Sphere> movable(sphere);
+	sphere->Radius = 100.0f;
+	sphere->Centre = Vector3( 100.0f, 250.0f, 100.0f );
+	sphere->Material.Color = SDL::Color( 20, 150, 20, 0 );
+	sphere->Material.Diffuse = 1.0f;
+	sphere->Material.Specular = 1.0f;
+	sphere->Material.Reflectivity = 1.0f;
+	scene.AddObject( movable );
+
+	sphere = new Sphere();
+	sphere->Radius = 60.0f;
+	sphere->Material.Reflectivity = 1.0f;
+	sphere->Material.Specular = 1.0f;
+	sphere->Centre = Vector3( 350.0f, -50.0f, 180.0f );
+	sphere->Material.Color = SDL::Color( 20, 20, 150, 0 );
+	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
+
+	sphere = new Sphere();
+	sphere->Radius = 150.0f;
+	sphere->Centre = Vector3( -300.0f, 50.0f, 100.0f );
+	sphere->Material.Color = SDL::Color( 50, 50, 50, 0 );
+	sphere->Material.Diffuse = 1.0f;
+	sphere->Material.Specular = 1.0f;
+	sphere->Material.Reflectivity = 1.0f;
+	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
+
+	AddPointLight( scene, Vector3( 50.0f, 500.0f, -100.0f ) );
+
+	return movable;
+}
+
+
+void BuildSphereFieldScene(Scene& scene, int sphereCount)
+{
+	Random random( 12345 );
+
+	AddFloor( scene, 500.0f );
+
+	for (int i=0; i<sphereCount; ++i)
+	{
+		Sphere* sphere = new Sphere();
+		sphere->Centre = Vector3( random.Next( -700.0f, 700.0f ), random.Next( -450.0f, 450.0f ), random.Next( 0.0f, 4000.0f ) );
+		sphere->Radius = random.Next( 5.0f, 20.0f );
+		sphere->Material.Color = SDL::Color( (Uint8)random.Next( 50.0f, 255.0f ), (Uint8)random.Next( 50.0f, 255.0f ), (Uint8)random.Next( 50.0f, 255.0f ), 0 );
+		sphere->Material.Diffuse = 1.0f;
+		sphere->Material.Specular = 0.5f;
+		sphere->Material.Reflectivity = random.Next( 0.0f, 1.0f ) < 0.2f ? 0.5f : 0.0f;
+		scene.AddObject( Scene::ObjectPtr_t( sphere ) );
+	}
+
+	AddPointLight( scene, Vector3( 0.0f, 1000.0f, -1000.0f ) );
+}
+
+
+void BuildMeshScene(Scene& scene, int segments)
+{
+	const float PI = 3.14159265f;
+	const float MAJOR_RADIUS = 220.0f, MINOR_RADIUS = 90.0f;
+
+	Mesh::VertexContainer_t vertices, normals;
+	Mesh::IndexContainer_t indices;
+	vertices.reserve( segments * segments );
+	normals.reserve( segments * segments );
+	indices.reserve( segments * segments * 6 );
+
+	for (int i=0; i<segments; ++i)
+	{
+		float u = 2.0f * PI * i / segments;
+		for (int j=0; j<segments; ++j)
+		{
+			float v = 2.0f * PI * j / segments;
+			// the torus is tilted towards the camera so both its faces and the hole are visible
+			Vector3 normal( cosf( u ) * cosf( v ), sinf( v ), sinf( u ) * cosf( v ) );
+			Vector3 centre( cosf( u ) * MAJOR_RADIUS, 0.0f, sinf( u ) * MAJOR_RADIUS );
+			Vector3 point = centre + normal * MINOR_RADIUS;
+
+			float c = cosf( 1.0f ), s = sinf( 1.0f );
+			vertices.push_back( Vector3( point.X, point.Y * c - point.Z * s, point.Y * s + point.Z * c ) );
+			normals.push_back( Vector3( normal.X, normal.Y * c - normal.Z * s, normal.Y * s + normal.Z * c ) );
+
+			boost::uint32_t a = i * segments + j;
+			boost::uint32_t b = ((i + 1) % segments) * segments + j;
+			boost::uint32_t c0 = ((i + 1) % segments) * segments + (j + 1) % segments;
+			boost::uint32_t d = i * segments + (j + 1) % segments;
+			indices.push_back( a ); indices.push_back( b ); indices.push_back( c0 );
+			indices.push_back( a ); indices.push_back( c0 ); indices.push_back( d );
+		}
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->SetGeometry( vertices, indices, normals, indices );
+	mesh->Material.Color = SDL::Color( 200, 120, 40, 0 );
+	mesh->Material.Diffuse = 1.0f;
+	mesh->Material.Specular = 1.0f;
+	mesh->Material.Reflectivity = 0.3f;
+	scene.AddObject( Scene::ObjectPtr_t( mesh ) );
+
+	AddFloor( scene, 400.0f );
+	AddPointLight( scene, Vector3( 200.0f, 800.0f, -400.0f ) );
+}
+
+
+void BuildMirrorScene(Scene& scene)
+{
+	// mirrors on both sides and behind the spheres
+	const Vector3 MIRRORS[] = { Vector3( 1, 0, 0 ), Vector3( -1, 0, 0 ), Vector3( 0, 0, -1 ) };
+	for (int i=0; i<3; ++i)
+	{
+		Plane* plane = new Plane( MIRRORS[i].X, MIRRORS[i].Y, MIRRORS[i].Z, 600.0f );
+		plane->Material.Color = SDL::Color( 230, 230, 255, 0 );
+		plane->Material.Diffuse = 0.1f;
+		plane->Material.Reflectivity = 1.0f;
+		scene.AddObject( Scene::ObjectPtr_t( plane ) );
+	}
+
+	AddFloor( scene, 400.0f );
+
+	for (int x=-2; x<=2; ++x)
+	{
+		for (int y=-1; y<=1; ++y)
+		{
+			Sphere* sphere = new Sphere();
+			sphere->Centre = Vector3( x * 220.0f, y * 220.0f, 200.0f + (x + y) * 60.0f );
+			sphere->Radius = 90.0f;
+			sphere->Material.Color = SDL::Color( 120 + x * 30, 120 + y * 60, 200, 0 );
+			sphere->Material.Diffuse = 0.3f;
+			sphere->Material.Specular = 1.0f;
+			sphere->Material.Reflectivity = 1.0f;
+			scene.AddObject( Scene::ObjectPtr_t( sphere ) );
+		}
+	}
+
+	AddPointLight( scene, Vector3( 0.0f, 350.0f, -200.0f ) );
+}
@@ -0,0 +1,29 @@
+
+
+#ifndef BENCHMARKSCENES_H
+#define BENCHMARKSCENES_H
+
+#include <boost/shared_ptr.hpp>
+
+#include "Scene.h"
+#include "Sphere.h"
+
+
+// Builders for the standard scenes. The demo scene is the one shown by the interactive viewer;
+// the rest exist to stress one part of the renderer each and are used by the benchmark.
+
+// Plane, four reflective spheres and a point light. Returns the sphere the viewer moves around
+boost::shared_ptr<Sphere> BuildDemoScene(Scene& scene);
+
+// A field of small spheres spread through the view volume, placed from a fixed seed so every run
+// renders the same image
+void BuildSphereFieldScene(Scene& scene, int sphereCount);
+
+// A finely tessellated torus standing on a plane. segments^2 * 2 triangles
+void BuildMeshScene(Scene& scene, int segments);
+
+// Reflective spheres between facing mirrors, so most rays bounce until the recursion limit
+void BuildMirrorScene(Scene& scene);
+
+
+#endif
@@ -0,0 +1,222 @@
+
+
+#ifndef BOUNDINGBOX_H
+#define BOUNDINGBOX_H
+
+#include "Vector3.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+// Axis aligned bounding box. A default constructed box is empty and contains nothing.
+class BoundingBox
+{
+public:
+	Vector3 Min, Max;
+
+
+	inline BoundingBox()
+		: Min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+			Max(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max())
+	{}
+
+
+	inline BoundingBox(const Vector3& min, const Vector3& max)
+		: Min(min), Max(max)
+	{}
+
+
+	// Box used by objects that have no finite extent, such as planes
+	static inline BoundingBox Infinite()
+	{
+		const float inf = std::numeric_limits<float>::infinity();
+		return BoundingBox(Vector3(-inf, -inf, -inf), Vector3(inf, inf, inf));
+	}
+
+
+	inline bool IsEmpty() const
+	{
+		return Min.X > Max.X || Min.Y > Max.Y || Min.Z > Max.Z;
+	}
+
+
+	inline bool IsFinite() const
+	{
+		return Max.X - Min.X < std::numeric_limits<float>::max()
+			&& Max.Y - Min.Y < std::numeric_limits<float>::max()
+			&& Max.Z - Min.Z < std::numeric_limits<float>::max();
+	}
+
+
+	inline void Expand(const Vector3& point)
+	{
+		Min.X = std::min(Min.X, point.X);
+		Min.Y = std::min(Min.Y, point.Y);
+		Min.Z = std::min(Min.Z, point.Z);
+		Max.X = std::max(Max.X, point.X);
+		Max.Y = std::max(Max.Y, point.Y);
+		Max.Z = std::max(Max.Z, point.Z);
+	}
+
+
+	inline void Expand(const BoundingBox& box)
+	{
+		Min.X = std::min(Min.X, box.Min.X);
+		Min.Y = std::min(Min.Y, box.Min.Y);
+		Min.Z = std::min(Min.Z, box.Min.Z);
+		Max.X = std::max(Max.X, box.Max.X);
+		Max.Y = std::max(Max.Y, box.Max.Y);
+		Max.Z = std::max(Max.Z, box.Max.Z);
+	}
+
+
+	inline Vector3 GetCentre() const
+	{
+		return (Min + Max) * 0.5f;
+	}
+
+
+	inline float GetSurfaceArea() const
+	{
+		if (IsEmpty())
+			return 0.0f;
+		Vector3 size = Max - Min;
+		return 2.0f * (size.X * size.Y + size.Y * size.Z + size.Z * size.X);
+	}
+
+
+	// Slab test against a ray, given the reciprocal of its direction. Succeeds if the ray enters
+	// the box before maxDistance, and returns the entry distance (which is negative if the ray
+	// starts inside the box).
+	inline bool Intersect(const Vector3& origin, const Vector3& invDirection, float maxDistance, float& entry) const
+	{
+		float tx1 = (Min.X - origin.X) * invDirection.X;
+		float tx2 = (Max.X - origin.X) * invDirection.X;
+		float tmin = std::min(tx1, tx2);
+		float tmax = std::max(tx1, tx2);
+
+		float ty1 = (Min.Y - origin.Y) * invDirection.Y;
+		float ty2 = (Max.Y - origin.Y) * invDirection.Y;
+		tmin = std::max(tmin, std::min(ty1, ty2));
+		tmax = std::min(tmax, std::max(ty1, ty2));
+
+		float tz1 = (Min.Z - origin.Z) * invDirection.Z;
+		float tz2 = (Max.Z - origin.Z) * invDirection.Z;
+		tmin = std::max(tmin, std::min(tz1, tz2));
+		tmax = std::min(tmax, std::max(tz1, tz2));
+
+		entry = tmin;
+		return tmax >= std::max(tmin, 0.0f) && tmin < maxDistance;
+	}
+
+	// The same test for a packet of rays, one per lane
+	inline SimdMask Intersect(const SimdVector3& origin, const SimdVector3& invDirection, const SimdFloat& maxDistance, SimdFloat& entry) const
+	{
+		SimdFloat tx1 = (SimdFloat(Min.X) - origin.X) * invDirection.X;
+		SimdFloat tx2 = (SimdFloat(Max.X) - origin.X) * invDirection.X;
+		SimdFloat tmin = SimdFloat::Min(tx1, tx2);
+		SimdFloat tmax = SimdFloat::Max(tx1, tx2);
+
+		SimdFloat ty1 = (SimdFloat(Min.Y) - origin.Y) * invDirection.Y;
+		SimdFloat ty2 = (SimdFloat(Max.Y) - origin.Y) * invDirection.Y;
+		tmin = SimdFloat::Max(tmin, SimdFloat::Min(ty1, ty2));
+		tmax = SimdFloat::Min(tmax, SimdFloat::Max(ty1, ty2));
+
+		SimdFloat tz1 = (SimdFloat(Min.Z) - origin.Z) * invDirection.Z;
+		SimdFloat tz2 = (SimdFloat(Max.Z) - origin.Z) * invDirection.Z;
+		tmin = SimdFloat::Max(tmin, SimdFloat::Min(tz1, tz2));
+		tmax = SimdFloat::Min(tmax, SimdFloat::Max(tz1, tz2));
+
+		entry = tmin;
+		return (tmax >= SimdFloat::Max(tmin, 0.0f)) & (tmin < maxDistance);
+	}
+
+
+	// Outward normal of the face of a box that a point on it is on, given the point's offset from the
+	// box's centre and the box's half size, both along the box's own axes. The face is the one the point
+	// is furthest out towards for the box's size; a flat box has no size along an axis, and its points
+	// are all on the face across that axis
+	static inline Vector3 GetFaceNormal(const Vector3& offset, const Vector3& halfSize)
+	{
+		float x = GetFaceReach(offset.X, halfSize.X);
+		float y = GetFaceReach(offset.Y, halfSize.Y);
+		float z = GetFaceReach(offset.Z, halfSize.Z);
+
+		if (x >= y && x >= z)
+			return Vector3(offset.X < 0.0f ? -1.0f : 1.0f, 0.0f, 0.0f);
+		if (y >= z)
+			return Vector3(0.0f, offset.Y < 0.0f ? -1.0f : 1.0f, 0.0f);
+		return Vector3(0.0f, 0.0f, offset.Z < 0.0f ? -1.0f : 1.0f);
+	}
+
+	static inline float GetFaceReach(float offset, float halfSize)
+	{
+		return halfSize > 0.0f ? std::fabs(offset) / halfSize : std::numeric_limits<float>::infinity();
+	}
+
+
+	// Reciprocal of a ray direction for the slab tests. Zero components are nudged away from zero, as
+	// an infinite reciprocal gives NaN for rays that start exactly on a box face
+	static inline Vector3 GetInverseDirection(const Vector3& direction)
+	{
+		return Vector3(SafeReciprocal(direction.X), SafeReciprocal(direction.Y), SafeReciprocal(direction.Z));
+	}
+
+	static inline float SafeReciprocal(float value)
+	{
+		const float tiny = 1.0e-20f;
+		if (value > -tiny && value < tiny)
+			value = value < 0.0f ? -tiny : tiny;
+		return 1.0f / value;
+	}
+
+	static inline SimdVector3 GetInverseDirection(const SimdVector3& direction)
+	{
+		return SimdVector3(SafeReciprocal(direction.X), SafeReciprocal(direction.Y), SafeReciprocal(direction.Z));
+	}
+
+	static inline SimdFloat SafeReciprocal(const SimdFloat& value)
+	{
+		const SimdFloat tiny(1.0e-20f);
+		SimdMask small = (value > -tiny) & (value < tiny);
+		SimdFloat nudged = SimdFloat::Select(value < 0.0f, -tiny, tiny);
+		return SimdFloat(1.0f) / SimdFloat::Select(small, nudged, value);
+	}
+
+
+	// The distances along a ray, given the reciprocal of its direction from GetInverseDirection, at
+	// which it enters and leaves the box. The ray hits the box if exit is no less than either entry or 0.
+	// A ray parallel to a pair of faces gets huge distances for them, which the min and max sort out
+	// without a branch
+	inline void Clip(const Vector3& origin, const Vector3& invDirection, float& entry, float& exit) const
+	{
+		float tx1 = (Min.X - origin.X) * invDirection.X;
+		float tx2 = (Max.X - origin.X) * invDirection.X;
+		float ty1 = (Min.Y - origin.Y) * invDirection.Y;
+		float ty2 = (Max.Y - origin.Y) * invDirection.Y;
+		float tz1 = (Min.Z - origin.Z) * invDirection.Z;
+		float tz2 = (Max.Z - origin.Z) * invDirection.Z;
+
+		entry = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+		exit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+	}
+
+	// The same for a packet of rays, one per lane
+	inline void Clip(const SimdVector3& origin, const SimdVector3& invDirection, SimdFloat& entry, SimdFloat& exit) const
+	{
+		SimdFloat tx1 = (SimdFloat(Min.X) - origin.X) * invDirection.X;
+		SimdFloat tx2 = (SimdFloat(Max.X) - origin.X) * invDirection.X;
+		SimdFloat ty1 = (SimdFloat(Min.Y) - origin.Y) * invDirection.Y;
+		SimdFloat ty2 = (SimdFloat(Max.Y) - origin.Y) * invDirection.Y;
+		SimdFloat tz1 = (SimdFloat(Min.Z) - origin.Z) * invDirection.Z;
+		SimdFloat tz2 = (SimdFloat(Max.Z) - origin.Z) * invDirection.Z;
+
+		entry = SimdFloat::Max(SimdFloat::Max(SimdFloat::Min(tx1, tx2), SimdFloat::Min(ty1, ty2)), SimdFloat::Min(tz1, tz2));
+		exit = SimdFloat::Min(SimdFloat::Min(SimdFloat::Max(tx1, tx2), SimdFloat::Max(ty1, ty2)), SimdFloat::Max(tz1, tz2));
+	}
+};
+
+
+#endif
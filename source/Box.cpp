@@ -0,0 +1,66 @@
+#include "Box.h"
+
+
+Box::Box()
+{
+}
+
+
+Box::Box(const Vector3& min, const Vector3& max)
+	: Min(min), Max(max)
+{
+}
+
+
+bool Box::Trace(const Ray& ray, float& distance) const
+{
+	float entry, exit;
+	BoundingBox(Min, Max).Clip(ray.Origin, BoundingBox::GetInverseDirection(ray.Direction), entry, exit);
+	if (entry < 0.0f || exit < entry)
+		return false;
+
+	distance = entry;
+	return true;
+}
+
+
+bool Box::Occludes(const Ray& ray, float maxDistance) const
+{
+	float distance;
+	return Trace(ray, distance) && distance < maxDistance;
+}
+
+
+SimdMask Box::TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+{
+	SimdFloat entry, exit;
+	BoundingBox(Min, Max).Clip(packet.Origin, BoundingBox::GetInverseDirection(packet.Direction), entry, exit);
+
+	SimdMask hit = active & (entry >= 0.0f) & (exit >= entry) & (entry < distance);
+	distance = SimdFloat::Select(hit, entry, distance);
+	return hit;
+}
+
+
+Vector3 Box::GetFaceNormal(const Vector3& point) const
+{
+	return BoundingBox::GetFaceNormal(point - (Min + Max) * 0.5f, (Max - Min) * 0.5f);
+}
+
+
+Vector3 Box::GetNormal(const Ray& ray, float distance) const
+{
+	return GetFaceNormal(ray.Origin + ray.Direction * distance);
+}
+
+
+void Box::CompleteHit(const Ray& ray, HitRecord& hit) const
+{
+	hit.Normal = GetFaceNormal(hit.Point);
+}
+
+
+BoundingBox Box::GetBounds() const
+{
+	return BoundingBox(Min, Max);
+}
@@ -0,0 +1,33 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include "Object.h"
+#include "Vector3.h"
+
+
+// A box lined up with the world's axes: a Cube that needs no change of frame to trace, so its slab
+// test is just that of its bounds. As the bounds are the box itself, a hierarchy of them wastes
+// nothing, which suits bulk blocky geometry such as voxels or buildings.
+class Box : public Object
+{
+private:
+	Vector3 GetFaceNormal(const Vector3& point) const;
+
+public:
+	Vector3 Min, Max;
+
+	Box();
+	Box(const Vector3& min, const Vector3& max);
+
+	// the distance the ray enters the box at; as for a Cube, a ray starting inside misses it
+	virtual bool Trace(const Ray& ray, float& distance) const;
+	virtual bool Occludes(const Ray& ray, float maxDistance) const;
+	virtual SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const;
+	// the outward normal of the face hit
+	virtual Vector3 GetNormal(const Ray& ray, float distance) const;
+	virtual void CompleteHit(const Ray& ray, HitRecord& hit) const;
+	virtual BoundingBox GetBounds() const;
+};
+
+
+#endif
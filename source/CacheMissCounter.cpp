@@ -0,0 +1,62 @@
+#include "CacheMissCounter.h"
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(__linux__)
+
+CacheMissCounter::CacheMissCounter(bool threads)
+{
+	perf_event_attr attributes;
+	std::memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	attributes.inherit = threads ? 1 : 0;
+
+	// this thread, on any processor; there is no wrapper for the call
+	descriptor = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+
+CacheMissCounter::~CacheMissCounter()
+{
+	if (descriptor >= 0)
+		close(descriptor);
+}
+
+
+boost::uint64_t CacheMissCounter::Read() const
+{
+	boost::uint64_t count = 0;
+	if (descriptor >= 0 && read(descriptor, &count, sizeof(count)) != (ssize_t)sizeof(count))
+		count = 0;
+	return count;
+}
+
+#else
+
+CacheMissCounter::CacheMissCounter(bool threads)
+	: descriptor(-1)
+{
+}
+
+
+CacheMissCounter::~CacheMissCounter()
+{
+}
+
+
+boost::uint64_t CacheMissCounter::Read() const
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef CACHEMISSCOUNTER_H
+#define CACHEMISSCOUNTER_H
+
+#include <boost/cstdint.hpp>
+
+
+// Counts the processor's last level cache misses in user code, through the Linux performance counters.
+// Elsewhere, or where the counters are not available (in many virtual machines, or with
+// perf_event_paranoid set too high), IsAvailable is false and the count stays 0.
+//
+// The counter is for the thread that made it. With threads set, threads that thread starts afterwards
+// are counted too, but only once they have exited, so a render's misses are read after its scene, and
+// with it its render threads, is gone.
+class CacheMissCounter
+{
+private:
+	int descriptor;
+
+	CacheMissCounter(const CacheMissCounter&);
+	CacheMissCounter& operator= (const CacheMissCounter&);
+
+public:
+	explicit CacheMissCounter(bool threads);
+	~CacheMissCounter();
+
+	inline bool IsAvailable() const { return descriptor >= 0; }
+	// misses since the counter was made
+	boost::uint64_t Read() const;
+};
+
+
+#endif
@@ -0,0 +1,43 @@
+#include "CacheStream.h"
+
+#include <sstream>
+
+
+const std::size_t CacheWriter::ALIGNMENT;
+
+
+void CacheWriter::WriteBytes(const void* data, std::size_t size)
+{
+	if (size > 0 && !stream.write(static_cast<const char*>(data), size))
+		throw SDL::Exception("Could not write scene cache");
+	offset += size;
+}
+
+
+void CacheWriter::Align()
+{
+	static const char ZEROES[ALIGNMENT] = {};
+	std::size_t padding = (std::size_t)((ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT);
+	WriteBytes(ZEROES, padding);
+}
+
+
+SDL::Exception CacheReader::Error(const std::string& message) const
+{
+	std::ostringstream stream;
+	stream << fileName << " (offset " << (position - begin) << "): " << message;
+	return SDL::Exception(stream.str());
+}
+
+
+const char* CacheReader::Take(std::size_t size, std::size_t alignment)
+{
+	std::size_t offset = position - begin;
+	std::size_t padding = (alignment - offset % alignment) % alignment;
+	if (padding > (std::size_t)(end - position) || size > (std::size_t)(end - position) - padding)
+		throw Error("Unexpected end of file");
+
+	const char* data = position + padding;
+	position = data + size;
+	return data;
+}
@@ -0,0 +1,118 @@
+#ifndef CACHESTREAM_H
+#define CACHESTREAM_H
+
+#include "PackedArray.h"
+#include "SDL/Exception.h"
+
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+// The scene cache is a sequence of plain values and arrays, each array its length followed by its
+// elements starting on an ALIGNMENT boundary. Arrays are read back as pointers into the mapped file,
+// so loading them costs nothing until their pages are first touched.
+class CacheWriter
+{
+public:
+	static const std::size_t ALIGNMENT = 64;
+
+private:
+	std::ostream& stream;
+	boost::uint64_t offset;
+
+	void WriteBytes(const void* data, std::size_t size);
+	void Align();
+
+public:
+	explicit CacheWriter(std::ostream& stream) : stream(stream), offset(0) {}
+
+	template <class T>
+	inline void Write(const T& value)
+	{
+		WriteBytes(&value, sizeof(T));
+	}
+
+	template <class T>
+	void WriteArray(const T* elements, std::size_t count)
+	{
+		Write<boost::uint64_t>(count);
+		Align();
+		WriteBytes(elements, count * sizeof(T));
+	}
+
+	template <class T>
+	inline void WriteArray(const std::vector<T>& elements)
+	{
+		WriteArray(elements.empty() ? NULL : &elements[0], elements.size());
+	}
+
+	template <class T>
+	inline void WriteArray(const PackedArray<T>& elements)
+	{
+		WriteArray(elements.data(), elements.size());
+	}
+};
+
+
+// Reads what CacheWriter wrote from memory, normally a mapped file. Running off the end throws
+class CacheReader
+{
+private:
+	const char* begin;
+	const char* position;
+	const char* end;
+	const std::string& fileName;
+
+	const char* Take(std::size_t size, std::size_t alignment);
+
+public:
+	CacheReader(const char* begin, const char* end, const std::string& fileName)
+		: begin(begin), position(begin), end(end), fileName(fileName)
+	{}
+
+	SDL::Exception Error(const std::string& message) const;
+
+	template <class T>
+	inline T Read()
+	{
+		T value;
+		std::memcpy(&value, Take(sizeof(T), 1), sizeof(T));
+		return value;
+	}
+
+	// the array's elements where they lie
+	template <class T>
+	const T* ReadArray(std::size_t& count)
+	{
+		boost::uint64_t length = Read<boost::uint64_t>();
+		if (length > (boost::uint64_t)(end - begin) / sizeof(T))
+			throw Error("Array runs past the end of the file");
+		count = (std::size_t)length;
+		return reinterpret_cast<const T*>(Take(count * sizeof(T), CacheWriter::ALIGNMENT));
+	}
+
+	template <class T>
+	void MapArray(PackedArray<T>& array)
+	{
+		std::size_t count;
+		const T* elements = ReadArray<T>(count);
+		array.Refer(elements, count);
+	}
+
+	// Throws unless the first count indices are all below limit. Anything indexed with what was read is
+	// checked like this first, as a cache need not come from this machine
+	void CheckIndices(const PackedArray<boost::uint32_t>& indices, std::size_t count, std::size_t limit, const char* message) const
+	{
+		for (std::size_t i=0; i<count; ++i)
+		{
+			if (indices[i] >= limit)
+				throw Error(message);
+		}
+	}
+};
+
+
+#endif
@@ -0,0 +1,112 @@
+
+
+#include "Camera.h"
+#include "SDL/Exception.h"
+
+
+const double PI = 3.14159265358979323846;
+// distance of the image plane in pixels for the default view, from before the camera could be set up
+const double DEFAULT_PLANE_DISTANCE = 10000.0;
+const float DEFAULT_VIEW_DISTANCE = 36000.0f;
+// the square of the sine of the smallest angle between up and forward the camera can be turned by
+const float MIN_UP_ANGLE_SQ = 1.0e-12f;
+
+
+Camera::Camera(int width, int height)
+	: position(0.0f, 0.0f, -16000.0f), viewDistance(DEFAULT_VIEW_DISTANCE)
+{
+	this->width = width;
+	this->height = height;
+	fieldOfView = (float)(2.0 * atan((height / 2.0) / DEFAULT_PLANE_DISTANCE) * 180.0 / PI);
+	aspectRatio = (float)width / (float)height;
+	SetOrientation(Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f));
+}
+
+
+void Camera::SetResolution(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	aspectRatio = (float)width / (float)height;
+	Update();
+}
+
+
+void Camera::SetOrientation(const Vector3& forward, const Vector3& up)
+{
+	// written so that NaNs fail the tests too
+	if (!(forward.LengthSq() > 0.0f))
+		throw SDL::Exception("Camera must have a direction to look in");
+
+	Vector3 direction = Vector3::Normalize(forward);
+	Vector3 side = Vector3::Cross(up, direction);
+	if (!(side.LengthSq() > MIN_UP_ANGLE_SQ * up.LengthSq()))
+		throw SDL::Exception("Camera up must not be along the direction it looks in");
+
+	this->forward = direction;
+	right = Vector3::Normalize(side);
+	this->up = Vector3::Cross(this->forward, right);
+	Update();
+}
+
+
+void Camera::LookAt(const Vector3& target, const Vector3& up)
+{
+	SetOrientation(target - position, up);
+}
+
+
+void Camera::SetFieldOfView(float degrees)
+{
+	if (!(degrees > 0.0f && degrees < 180.0f))
+		throw SDL::Exception("Camera field of view must be between 0 and 180 degrees");
+	fieldOfView = degrees;
+	Update();
+}
+
+
+void Camera::SetAspectRatio(float aspectRatio)
+{
+	if (!(aspectRatio > 0.0f))
+		throw SDL::Exception("Camera aspect ratio must be positive");
+	this->aspectRatio = aspectRatio;
+	Update();
+}
+
+
+void Camera::SetViewDistance(float distance)
+{
+	if (!(distance > 0.0f))
+		throw SDL::Exception("Camera view distance must be positive");
+	viewDistance = distance;
+}
+
+
+void Camera::Update()
+{
+	halfWidth = (float)width / 2.0f;
+	halfHeight = (float)height / 2.0f;
+
+	// in double, so the default field of view gives back a plane distance of exactly 10000
+	double planeDistance = (height / 2.0) / tan(fieldOfView * PI / 360.0);
+	float horizontalScale = aspectRatio / ((float)width / (float)height);
+
+	toPlane = forward * (float)planeDistance;
+	rightStep = right * horizontalScale;
+	upStep = up;
+}
+
+
+bool Camera::Project(const Vector3& point, float& x, float& y) const
+{
+	Vector3 offset = point - position;
+	float depth = Vector3::Dot(offset, forward);
+	if (depth <= 0.0f)
+		return false;
+
+	// the direction to the point, scaled to reach the image plane, in pixels across and up it
+	float scale = Vector3::Dot(toPlane, forward) / depth;
+	x = Vector3::Dot(offset, right) * scale / Vector3::Dot(rightStep, right) + halfWidth;
+	y = halfHeight - Vector3::Dot(offset, up) * scale;
+	return true;
+}
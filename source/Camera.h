@@ -0,0 +1,91 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "Vector3.h"
+#include "Ray.h"
+#include "Simd.h"
+
+
+// A pinhole camera. Primary ray directions are worked out per pixel as they are needed, from the
+// position, orientation, field of view and aspect ratio, so nothing has to be stored per pixel.
+//
+// The default camera is the view the renderer has always had: at (0, 0, -16000) looking down +Z
+// with +Y up, and a field of view that puts the image plane 10000 pixels in front of it.
+class Camera
+{
+private:
+	int width, height;
+	Vector3 position, forward, right, up;
+	float fieldOfView, aspectRatio, viewDistance;
+
+	// the image plane is toPlane in front of the camera; moving one pixel right or up on it moves by
+	// rightStep or upStep
+	Vector3 toPlane, rightStep, upStep;
+	float halfWidth, halfHeight;
+
+	void Update();
+
+public:
+	Camera(int width, int height);
+
+	// size of the image in pixels. Keeps the field of view, and sets the aspect ratio to match
+	void SetResolution(int width, int height);
+	inline int GetWidth() const { return width; }
+	inline int GetHeight() const { return height; }
+
+	inline void SetPosition(const Vector3& position) { this->position = position; }
+	inline const Vector3& GetPosition() const { return position; }
+
+	// Points the camera along forward, turned about it so that up points as near to up as it can. These
+	// and the other setters throw for a view they cannot make: no forward direction, an up along it, a
+	// field of view outside 0 to 180 degrees, or an aspect ratio or view distance that is not positive
+	void SetOrientation(const Vector3& forward, const Vector3& up);
+	void LookAt(const Vector3& target, const Vector3& up);
+	inline const Vector3& GetForward() const { return forward; }
+	inline const Vector3& GetUp() const { return up; }
+
+	// vertical field of view in degrees
+	void SetFieldOfView(float degrees);
+	inline float GetFieldOfView() const { return fieldOfView; }
+
+	// width over height of the view. Anything but the image's own stretches the pixels horizontally
+	void SetAspectRatio(float aspectRatio);
+	inline float GetAspectRatio() const { return aspectRatio; }
+
+	// primary rays only find objects closer than this
+	void SetViewDistance(float distance);
+	inline float GetViewDistance() const { return viewDistance; }
+
+	// unit direction of the ray through pixel (x, y)
+	inline Vector3 GetDirection(float x, float y) const
+	{
+		float planeX = x - halfWidth;
+		float planeY = -(y - halfHeight);
+		return Vector3::Normalize(rightStep * planeX + upStep * planeY + toPlane);
+	}
+
+	// the same for one pixel per lane, giving exactly the directions GetDirection does
+	inline SimdVector3 GetDirections(const SimdFloat& x, const SimdFloat& y) const
+	{
+		SimdFloat planeX = x - SimdFloat(halfWidth);
+		SimdFloat planeY = -(y - SimdFloat(halfHeight));
+		SimdVector3 direction = SimdVector3(rightStep) * planeX + SimdVector3(upStep) * planeY + SimdVector3(toPlane);
+		SimdFloat length = SimdFloat::Sqrt(direction.LengthSq());
+		return SimdVector3(direction.X / length, direction.Y / length, direction.Z / length);
+	}
+
+	// The inverse of GetDirection: the pixel position a point in the scene appears at. False for points
+	// which are not in front of the camera
+	bool Project(const Vector3& point, float& x, float& y) const;
+
+	inline Ray GetRay(int x, int y) const
+	{
+		Ray ray;
+		ray.Origin = position;
+		ray.Direction = GetDirection((float)x, (float)y);
+		return ray;
+	}
+};
+
+
+#endif
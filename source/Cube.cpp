@@ -1,72 +1,116 @@
 
 #include "Cube.h"
-#include "Plane.h"
+
+#include <cmath>
+
+
+namespace
+{
+	// the square of the sine of the smallest angle between up and the look direction that orients a cube
+	const float MIN_UP_ANGLE_SQ = 1.0e-12f;
+}
 
 
 Cube::Cube()
+	: AxisX(1.0f, 0.0f, 0.0f), AxisY(0.0f, 1.0f, 0.0f), AxisZ(0.0f, 0.0f, 1.0f), ExtentX(0.0f), ExtentY(0.0f), ExtentZ(0.0f)
 {
 }
 
 
 Cube::Cube(const Vector3& centre, const Vector3& lookDirection, const Vector3& upDirection, float extentX, float extentY, float extentZ)
-  : Centre(centre), AxisY(upDirection), AxisZ(lookDirection), ExtentX(extentX), ExtentY(extentY), ExtentZ(extentZ)
+  : Centre(centre), ExtentX(extentX), ExtentY(extentY), ExtentZ(extentZ)
+{
+	// written so that NaNs fail the tests too
+	if (!(lookDirection.LengthSq() > 0.0f))
+		throw SDL::Exception("Cube must have a direction to face");
+
+	AxisZ = Vector3::Normalize(lookDirection);
+	Vector3 side = Vector3::Cross(AxisZ, upDirection);
+	if (!(side.LengthSq() > MIN_UP_ANGLE_SQ * upDirection.LengthSq()))
+		throw SDL::Exception("Cube up must not be along the direction it faces");
+
+	AxisX = Vector3::Normalize(side);
+	AxisY = Vector3::Cross(AxisX, AxisZ);
+}
+
+
+// Finds where the ray enters the box, returning false if it misses, or starts inside or past it
+inline bool Cube::Clip(const Ray& ray, float& entry) const
 {
-	AxisX = Vector3::Cross(lookDirection, upDirection);
+	Vector3 offset = ray.Origin - Centre;
+	Vector3 origin(Vector3::Dot(offset, AxisX), Vector3::Dot(offset, AxisY), Vector3::Dot(offset, AxisZ));
+	Vector3 direction(Vector3::Dot(ray.Direction, AxisX), Vector3::Dot(ray.Direction, AxisY), Vector3::Dot(ray.Direction, AxisZ));
+
+	Vector3 extent(ExtentX, ExtentY, ExtentZ);
+	float exit;
+	BoundingBox(extent * -1.0f, extent).Clip(origin, BoundingBox::GetInverseDirection(direction), entry, exit);
+	return entry >= 0.0f && exit >= entry;
 }
 
 
 bool Cube::Trace(const Ray& ray, float& distance) const
 {
-  float fWdU[3], fAWdU[3], fDdU[3], fADdU[3], fAWxDdU[3], fRhs;
-
-  Vector3 kDiff = ray.Origin - Centre;
-
-  fWdU[0] = Vector3::Dot(ray.Direction, GetAxis(0));
-  fAWdU[0] = fabs(fWdU[0]);
-  fDdU[0] = Vector3::Dot(kDiff, GetAxis(0));
-  fADdU[0] = fabs(fDdU[0]);
-  if ( fADdU[0] > GetExtent(0) && fDdU[0]*fWdU[0] >= 0.0f )
-      return false;
-
-  fWdU[1] = Vector3::Dot(ray.Direction, GetAxis(1));
-  fAWdU[1] = fabs(fWdU[1]);
-  fDdU[1] = Vector3::Dot(kDiff, GetAxis(1));
-  fADdU[1] = fabs(fDdU[1]);
-  if ( fADdU[1] > GetExtent(1) && fDdU[1]*fWdU[1] >= 0.0f )
-      return false;
-
-  fWdU[2] = Vector3::Dot(ray.Direction, GetAxis(2));
-  fAWdU[2] = fabs(fWdU[2]);
-  fDdU[2] = Vector3::Dot(kDiff, GetAxis(2));
-  fADdU[2] = fabs(fDdU[2]);
-  if ( fADdU[2] > GetExtent(2) && fDdU[2]*fWdU[2] >= 0.0f )
-      return false;
-
-  Vector3 kWxD = Vector3::Cross(ray.Direction, kDiff);
-
-  fAWxDdU[0] = fabs(Vector3::Dot(kWxD, GetAxis(0)));
-  fRhs = GetExtent(1)*fAWdU[2] + GetExtent(2)*fAWdU[1];
-  if ( fAWxDdU[0] > fRhs )
-      return false;
-
-  fAWxDdU[1] = fabs(Vector3::Dot(kWxD, GetAxis(1)));
-  fRhs = GetExtent(0)*fAWdU[2] + GetExtent(2)*fAWdU[0];
-  if ( fAWxDdU[1] > fRhs )
-      return false;
-
-  fAWxDdU[2] = fabs(Vector3::Dot(kWxD, GetAxis(2)));
-  fRhs = GetExtent(0)*fAWdU[1] + GetExtent(1)*fAWdU[0];
-  if ( fAWxDdU[2] > fRhs )
-      return false;
-
-	distance = fRhs;
-
-	return true;
+	return Clip(ray, distance);
+}
+
+
+bool Cube::Occludes(const Ray& ray, float maxDistance) const
+{
+	float entry;
+	return Clip(ray, entry) && entry < maxDistance;
+}
+
+
+SimdMask Cube::TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+{
+	SimdVector3 axisX(AxisX), axisY(AxisY), axisZ(AxisZ);
+	SimdVector3 offset = packet.Origin - SimdVector3(Centre);
+	SimdVector3 origin(SimdVector3::Dot(offset, axisX), SimdVector3::Dot(offset, axisY), SimdVector3::Dot(offset, axisZ));
+	SimdVector3 direction(SimdVector3::Dot(packet.Direction, axisX), SimdVector3::Dot(packet.Direction, axisY), SimdVector3::Dot(packet.Direction, axisZ));
+
+	Vector3 extent(ExtentX, ExtentY, ExtentZ);
+	SimdFloat entry, exit;
+	BoundingBox(extent * -1.0f, extent).Clip(origin, BoundingBox::GetInverseDirection(direction), entry, exit);
+
+	SimdMask hit = active & (entry >= 0.0f) & (exit >= entry) & (entry < distance);
+	distance = SimdFloat::Select(hit, entry, distance);
+	return hit;
+}
+
+
+Vector3 Cube::GetFaceNormal(const Vector3& point) const
+{
+	Vector3 offset = point - Centre;
+	Vector3 local(Vector3::Dot(offset, AxisX), Vector3::Dot(offset, AxisY), Vector3::Dot(offset, AxisZ));
+	Vector3 normal = BoundingBox::GetFaceNormal(local, Vector3(ExtentX, ExtentY, ExtentZ));
+
+	// back out of the box's frame
+	return AxisX * normal.X + AxisY * normal.Y + AxisZ * normal.Z;
 }
 
 
 Vector3 Cube::GetNormal(const Ray& ray, float distance) const
 {
-	return Vector3();
+	return GetFaceNormal(ray.Origin + ray.Direction * distance);
 }
 
+
+void Cube::CompleteHit(const Ray& ray, HitRecord& hit) const
+{
+	hit.Normal = GetFaceNormal(hit.Point);
+}
+
+
+BoundingBox Cube::GetBounds() const
+{
+	// project each scaled axis onto the world axes to get the half size of the enclosing box
+	Vector3 halfSize;
+	for (int i=0; i<3; ++i)
+	{
+		const Vector3& axis = GetAxis(i);
+		halfSize.X += fabs(axis.X) * GetExtent(i);
+		halfSize.Y += fabs(axis.Y) * GetExtent(i);
+		halfSize.Z += fabs(axis.Z) * GetExtent(i);
+	}
+	return BoundingBox(Centre - halfSize, Centre + halfSize);
+}
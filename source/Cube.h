@@ -11,21 +11,36 @@
 using namespace SDL;
 
 
+// A box at any orientation. It is traced with a slab test in its own frame: the ray is taken onto
+// its axes, where the box is just the bounds of its extents. The axes must be unit length and at right
+// angles to each other, as the constructor makes them; it throws rather than guess at an orientation
+// when the look direction is zero or up is along it. Box is the cheaper case of one lined up with the
+// world's axes.
 class Cube : public Object
 {
 private:
-
+	bool Clip(const Ray& ray, float& entry) const;
+	Vector3 GetFaceNormal(const Vector3& point) const;
 
 public:
 	Vector3 AxisX, AxisY, AxisZ, Centre;
+	// half the size along each axis
 	float ExtentX, ExtentY, ExtentZ;
 	
 	
 	Cube();
+	// up need not be square to the look direction; it only picks the box's roll about it
 	Cube(const Vector3& centre, const Vector3& lookDirection, const Vector3& upDirection, float extentX, float extentY, float extentZ);
 
+	// The distance the ray enters the box at. A ray starting inside misses it, as one leaving the
+	// surface may start just inside it by a rounding error
 	virtual bool Trace(const Ray& ray, float& distance) const;
+	virtual bool Occludes(const Ray& ray, float maxDistance) const;
+	virtual SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const;
+	// the outward normal of the face hit
 	virtual Vector3 GetNormal(const Ray& ray, float distance) const;
+	virtual void CompleteHit(const Ray& ray, HitRecord& hit) const;
+	virtual BoundingBox GetBounds() const;
 
 	inline float GetExtent(int i) const
 	{
@@ -5,25 +5,56 @@
 #include "SDL/Surface.h"
 
 #include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
 
 #include "Scene.h"
 #include "Sphere.h"
 #include "Cube.h"
 #include "Triangle.h"
+#include "ImageWriter.h"
+#include "Benchmark.h"
+#include "BenchmarkScenes.h"
+#include "SceneFile.h"
+#include "SceneCache.h"
+#include "Animation.h"
+#include "FramePipeline.h"
+#include "RenderCheckpoint.h"
+#include "RenderCoordinator.h"
+#include "RenderWorker.h"
 
 
+#ifdef _MSC_VER
 #pragma comment(lib, "SDL2main.lib")
 #pragma comment(lib, "SDL2.lib")
+#endif
 
 using namespace SDL;
 using namespace boost::placeholders;
 
+// how long the event loop waits for input before checking on a progressive render
+const int RENDER_POLL_MS = 10;
 
-Sphere* sphere1 = NULL;
+boost::shared_ptr<Sphere> sphere1;
 
 
-void OnKeyUp(const SDL::KeyboardEvent& event)
+void OnKeyUp(Scene& scene, const SDL::KeyboardEvent& event)
 {
+	// scenes loaded from a file have nothing to move
+	if (!sphere1)
+		return;
+
+	// the render threads may be reading the sphere
+	scene.InterruptRender();
+
 	switch (event.GetKey())
 	{
 	case SDLK_w:
@@ -38,7 +69,11 @@ void OnKeyUp(const SDL::KeyboardEvent& event)
 	case SDLK_d:
 		sphere1->Centre.Y += 20.0f;
 		break;
+	default:
+		return;
 	}
+
+	scene.UpdateObject(sphere1);
 }
 
 
@@ -49,74 +84,558 @@ void OnQuit(const QuitEvent& event)
 }
 
 
-int main(int argc, char* argv[])
+class Options
+{
+public:
+	bool Headless;
+	int Frames;
+	bool Animate;
+	float FramesPerSecond;
+	std::string Output;
+	std::string SceneFileName, CacheFileName;
+	int Width, Height;
+	unsigned int Threads;
+	bool Packets;
+	int MaxDepth;
+	float MinContribution;
+	int Antialiasing;
+	float AntialiasingThreshold;
+	CURVE_ORDER TileOrder, PixelOrder;
+	bool TileSplitting;
+	bool Benchmark;
+	int BenchmarkFrames;
+	bool BenchmarkOrders;
+	std::string BenchmarkScene, BenchmarkOutput;
+	std::string CoordinatorAddress, WorkerAddress;
+	int Workers;
+	int WorkerTimeout;
+	std::string CheckpointFileName;
+	int CheckpointInterval;
+	bool Resume;
+
+	Options()
+		: Headless(false), Frames(1), Animate(false), FramesPerSecond(24.0f), Output("frame.png"), Width(640), Height(480), Threads(0),
+		Packets(true), MaxDepth(6), MinContribution(0.5f / 255.0f), Antialiasing(1), AntialiasingThreshold(0.1f),
+		TileOrder(ORDER_ROWS), PixelOrder(ORDER_ROWS), TileSplitting(true), Benchmark(false), BenchmarkFrames(10), BenchmarkOrders(false), Workers(1), WorkerTimeout(60),
+		CheckpointInterval(60), Resume(false)
+	{}
+};
+
+
+void PrintUsage()
+{
+	std::cerr <<
+		"usage: raytrace [options]\n"
+		"  --headless          render offscreen without opening a window, then exit\n"
+		"  --frames N          number of frames to render in headless mode (default 1)\n"
+		"  --animate           render the keyed animation in the scene file offscreen, from its first key\n"
+		"                      to its last, then exit\n"
+		"  --fps F             frames per second of animation (default 24)\n"
+		"  --scene FILE        load the scene from a scene description file or scene cache instead of\n"
+		"                      the demo scene\n"
+		"  --write-cache FILE  save the scene as a scene cache, which loads without parsing, then exit\n"
+		"  --output FILE       image to write offscreen; .ppm, .png or .bmp (default frame.png).\n"
+		"                      A %d or %0Nd in the name is replaced with the frame number, and %%\n"
+		"                      with a percent sign; otherwise the number is added before the\n"
+		"                      extension when N > 1\n"
+		"  --width W           frame width (default 640)\n"
+		"  --height H          frame height (default 480)\n"
+		"  --threads T         render threads, 0 for one per hardware thread (default 0)\n"
+		"  --scalar            trace every primary ray on its own instead of in SIMD packets\n"
+		"  --max-depth N       longest chain of rays per pixel, 1 for no reflections (default 6)\n"
+		"  --min-contribution C stop following reflections that add less than C to a pixel's\n"
+		"                      colour, 0 to always go to the full depth (default 1/510)\n"
+		"  --antialias N       trace N rays (4, 9, 16 ... 64) in pixels on edges, 1 for off (default 1)\n"
+		"  --antialias-threshold T colour difference between neighbours that counts as an edge (default 0.1)\n"
+		"  --tile-order O      order tiles are traced in: rows, morton or hilbert (default rows)\n"
+		"  --pixel-order O     order the pixels of each tile are traced in, the same choices (default rows)\n"
+		"  --no-tile-splitting never split tiles that took much longer than the rest last frame\n"
+		"  --benchmark         render the benchmark scenes offscreen and print a JSON report\n"
+		"  --benchmark-scene S run only scene S: demo, spheres, mesh or mirrors (default all)\n"
+		"  --benchmark-frames N timed frames per benchmark scene (default 10)\n"
+		"  --benchmark-output FILE write the benchmark report to FILE instead of stdout\n"
+		"  --benchmark-orders  also render each scene in each tile and pixel order, and report their\n"
+		"                      speed and, where the processor's counters are readable, cache misses\n"
+		"  --coordinator ADDR  render offscreen on worker processes connecting to ADDR, HOST:PORT or\n"
+		"                      unix:PATH, instead of on this one's threads. With no HOST only workers on\n"
+		"                      this machine can connect\n"
+		"  --workers N         workers to wait for before the first frame (default 1)\n"
+		"  --worker-timeout S  seconds a worker may take over a batch of tiles before they are given to\n"
+		"                      another (default 60)\n"
+		"  --worker ADDR       trace tiles for the coordinator at ADDR until it is done, then exit\n"
+		"  --checkpoint FILE   render one frame offscreen, saving progress to FILE as it goes so a\n"
+		"                      stopped render can be resumed. FILE is removed once the frame is complete\n"
+		"  --checkpoint-interval S seconds between checkpoints (default 60)\n"
+		"  --resume            carry on from the checkpoint in the --checkpoint FILE\n";
+}
+
+
+// Puts the frame number into an output name with a %d or %0Nd in it, %% being a percent sign. The
+// number is substituted here rather than the name used as a printf format, so returns false for any
+// other use of %. numbered is set to whether the name had a place for the number
+bool ExpandFramePattern(const std::string& pattern, int frame, std::string& result, bool& numbered)
+{
+	result.clear();
+	numbered = false;
+
+	for (std::string::size_type i=0; i<pattern.size(); ++i)
+	{
+		if (pattern[i] != '%')
+		{
+			result += pattern[i];
+			continue;
+		}
+
+		if (++i < pattern.size() && pattern[i] == '%')
+		{
+			result += '%';
+			continue;
+		}
+
+		// the padded width is at most two digits
+		int width = 0, digits = 0;
+		if (i < pattern.size() && pattern[i] == '0')
+		{
+			for (++i; i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9'; ++i, ++digits)
+				width = width * 10 + (pattern[i] - '0');
+		}
+
+		if (numbered || i >= pattern.size() || pattern[i] != 'd' || digits > 2)
+			return false;
+
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%0*d", width, frame);
+		result += buffer;
+		numbered = true;
+	}
+
+	return true;
+}
+
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+	for (int i=1; i<argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless")
+			options.Headless = true;
+		else if (arg == "--frames" && hasValue)
+			options.Frames = atoi(argv[++i]);
+		else if (arg == "--animate")
+			options.Animate = true;
+		else if (arg == "--fps" && hasValue)
+			options.FramesPerSecond = (float)atof(argv[++i]);
+		else if (arg == "--scene" && hasValue)
+			options.SceneFileName = argv[++i];
+		else if (arg == "--write-cache" && hasValue)
+			options.CacheFileName = argv[++i];
+		else if (arg == "--output" && hasValue)
+			options.Output = argv[++i];
+		else if (arg == "--width" && hasValue)
+			options.Width = atoi(argv[++i]);
+		else if (arg == "--height" && hasValue)
+			options.Height = atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue)
+			options.Threads = (unsigned int)atoi(argv[++i]);
+		else if (arg == "--scalar")
+			options.Packets = false;
+		else if (arg == "--max-depth" && hasValue)
+			options.MaxDepth = atoi(argv[++i]);
+		else if (arg == "--min-contribution" && hasValue)
+			options.MinContribution = (float)atof(argv[++i]);
+		else if (arg == "--antialias" && hasValue)
+			options.Antialiasing = atoi(argv[++i]);
+		else if (arg == "--antialias-threshold" && hasValue)
+			options.AntialiasingThreshold = (float)atof(argv[++i]);
+		else if (arg == "--tile-order" && hasValue && SpaceFillingCurve::Parse(argv[i + 1], options.TileOrder))
+			++i;
+		else if (arg == "--pixel-order" && hasValue && SpaceFillingCurve::Parse(argv[i + 1], options.PixelOrder))
+			++i;
+		else if (arg == "--no-tile-splitting")
+			options.TileSplitting = false;
+		else if (arg == "--benchmark")
+			options.Benchmark = true;
+		else if (arg == "--benchmark-orders")
+			options.BenchmarkOrders = true;
+		else if (arg == "--benchmark-scene" && hasValue)
+			options.BenchmarkScene = argv[++i];
+		else if (arg == "--benchmark-frames" && hasValue)
+			options.BenchmarkFrames = atoi(argv[++i]);
+		else if (arg == "--benchmark-output" && hasValue)
+			options.BenchmarkOutput = argv[++i];
+		else if (arg == "--coordinator" && hasValue)
+			options.CoordinatorAddress = argv[++i];
+		else if (arg == "--workers" && hasValue)
+			options.Workers = atoi(argv[++i]);
+		else if (arg == "--worker-timeout" && hasValue)
+			options.WorkerTimeout = atoi(argv[++i]);
+		else if (arg == "--worker" && hasValue)
+			options.WorkerAddress = argv[++i];
+		else if (arg == "--checkpoint" && hasValue)
+			options.CheckpointFileName = argv[++i];
+		else if (arg == "--checkpoint-interval" && hasValue)
+			options.CheckpointInterval = atoi(argv[++i]);
+		else if (arg == "--resume")
+			options.Resume = true;
+		else
+		{
+			std::cerr << "unrecognised argument: " << arg << "\n";
+			return false;
+		}
+	}
+
+	if (options.Frames < 1 || options.BenchmarkFrames < 1 || options.Width < 1 || options.Height < 1)
+	{
+		std::cerr << "frames, width and height must be positive\n";
+		return false;
+	}
+
+	if (options.Animate && (options.SceneFileName.empty() || !(options.FramesPerSecond > 0.0f)))
+	{
+		std::cerr << "animation needs a scene file and a positive frame rate\n";
+		return false;
+	}
+
+	if (!options.CoordinatorAddress.empty() && (options.Animate || options.Workers < 1 || options.WorkerTimeout < 1))
+	{
+		std::cerr << "a coordinator renders still frames, and needs a positive worker count and timeout\n";
+		return false;
+	}
+
+	if (options.Resume && options.CheckpointFileName.empty())
+	{
+		std::cerr << "resuming needs a --checkpoint file\n";
+		return false;
+	}
+
+	// a checkpoint is of one frame, rendered here
+	if (!options.CheckpointFileName.empty() && (options.Frames != 1 || options.Animate || !options.CoordinatorAddress.empty() || options.CheckpointInterval < 1))
+	{
+		std::cerr << "a checkpoint is of a single frame rendered on this machine, with a positive interval\n";
+		return false;
+	}
+
+	if (options.MaxDepth < 1 || options.MinContribution < 0.0f)
+	{
+		std::cerr << "max depth must be positive and min contribution not negative\n";
+		return false;
+	}
+
+	std::string expanded;
+	bool numbered;
+	if (!ExpandFramePattern(options.Output, 0, expanded, numbered))
+	{
+		std::cerr << "the output name may only have one %d or %0Nd in it, and %% for a percent sign\n";
+		return false;
+	}
+
+	if (!ImageWriter::IsSupported(options.Output))
+	{
+		std::cerr << "unsupported output format: " << options.Output << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+std::string GetFrameFileName(const std::string& pattern, int frame, int frameCount)
+{
+	// the pattern was checked along with the other options
+	std::string result;
+	bool numbered;
+	ExpandFramePattern(pattern, frame, result, numbered);
+
+	if (numbered || frameCount == 1)
+		return result;
+
+	char buffer[32];
+	std::string::size_type dot = result.rfind('.');
+	snprintf(buffer, sizeof(buffer), "_%04d", frame);
+	return result.substr(0, dot) + buffer + result.substr(dot);
+}
+
+
+void ConfigureScene(const Options& options, Scene& scene)
+{
+	scene.SetPacketTracing(options.Packets);
+	scene.SetMaxDepth(options.MaxDepth);
+	scene.SetContributionThreshold(options.MinContribution);
+	scene.SetAntialiasing(options.Antialiasing);
+	scene.SetAntialiasingThreshold(options.AntialiasingThreshold);
+	scene.SetTileOrder(options.TileOrder);
+	scene.SetPixelOrder(options.PixelOrder);
+	scene.SetTileSplitting(options.TileSplitting);
+}
+
+
+// the scene file if one was given, otherwise the demo scene with its movable sphere. The file's keys
+// are added to animation if there is one
+void LoadScene(const Options& options, Scene& scene, Animation* animation = NULL)
+{
+	if (options.SceneFileName.empty())
+	{
+		sphere1 = BuildDemoScene(scene);
+		return;
+	}
+
+	typedef boost::chrono::steady_clock Clock_t;
+	Clock_t::time_point start = Clock_t::now();
+	if (SceneCache::IsCache(options.SceneFileName))
+	{
+		if (animation)
+			throw SDL::Exception("Scene caches hold no animation; use the scene file");
+		SceneCache::Load(options.SceneFileName, scene);
+	}
+	else
+	{
+		SceneFile::Load(options.SceneFileName, scene, animation);
+	}
+	double loadTime = boost::chrono::duration<double, boost::milli>(Clock_t::now() - start).count();
+	printf("loaded %s: %u objects in %.2f ms\n", options.SceneFileName.c_str(), (unsigned int)scene.GetObjectCount(), loadTime);
+}
+
+
+int RunHeadless(const Options& options)
+{
+	typedef boost::chrono::steady_clock Clock_t;
+	typedef boost::chrono::duration<double, boost::milli> Milliseconds_t;
+
+	// no video subsystem, so this works on machines without a display
+	const auto initPtr = SDL::Init::Create(0);
+	SurfacePtr frameBuffer = Surface::CreateRGBSurface(0, options.Width, options.Height, 32,
+		0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+
+	Scene scene(WindowPtr(), frameBuffer, options.Threads);
+	ConfigureScene(options, scene);
+	LoadScene(options, scene);
+
+	if (!options.CheckpointFileName.empty())
+		scene.SetCheckpoint(boost::make_shared<RenderCheckpoint>(options.CheckpointFileName, options.CheckpointInterval, options.Resume));
+
+	// the workers get the scene as it is now, so it must be loaded and configured first
+	boost::shared_ptr<RenderCoordinator> coordinator;
+	if (!options.CoordinatorAddress.empty())
+	{
+		coordinator.reset(new RenderCoordinator(scene, options.CoordinatorAddress, options.WorkerTimeout));
+		printf("waiting for %d workers on %s\n", options.Workers, options.CoordinatorAddress.c_str());
+		coordinator->WaitForWorkers(options.Workers);
+	}
+
+	double totalRender = 0.0, minRender = 0.0, maxRender = 0.0;
+	Clock_t::time_point start = Clock_t::now();
+
+	for (int frame=1; frame<=options.Frames; ++frame)
+	{
+		Clock_t::time_point renderStart = Clock_t::now();
+		if (coordinator)
+			coordinator->Render();
+		else
+			scene.Render();
+		Clock_t::time_point renderEnd = Clock_t::now();
+
+		std::string fileName = GetFrameFileName(options.Output, frame, options.Frames);
+		ImageWriter::Save(frameBuffer, fileName);
+		Clock_t::time_point writeEnd = Clock_t::now();
+
+		double renderTime = Milliseconds_t(renderEnd - renderStart).count();
+		double writeTime = Milliseconds_t(writeEnd - renderEnd).count();
+		totalRender += renderTime;
+		minRender = frame == 1 ? renderTime : std::min(minRender, renderTime);
+		maxRender = frame == 1 ? renderTime : std::max(maxRender, renderTime);
+
+		printf("frame %d/%d: render %.2f ms, write %.2f ms -> %s\n", frame, options.Frames, renderTime, writeTime, fileName.c_str());
+	}
+
+	double total = Milliseconds_t(Clock_t::now() - start).count();
+	printf("%d frames at %dx%d: total %.2f ms, render avg %.2f ms, min %.2f ms, max %.2f ms\n",
+		options.Frames, options.Width, options.Height, total, totalRender / options.Frames, minRender, maxRender);
+
+	return 0;
+}
+
+
+int RunAnimation(const Options& options)
+{
+	const auto initPtr = SDL::Init::Create(0);
+
+	// the pipeline poses one copy of the scene for the next frame while the other is traced
+	SurfacePtr frameBuffers[2];
+	boost::shared_ptr<Scene> scenes[2];
+	Animation animations[2];
+	for (int i=0; i<2; ++i)
+	{
+		frameBuffers[i] = Surface::CreateRGBSurface(0, options.Width, options.Height, 32,
+			0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		scenes[i].reset(new Scene(WindowPtr(), frameBuffers[i], options.Threads));
+		ConfigureScene(options, *scenes[i]);
+		LoadScene(options, *scenes[i], &animations[i]);
+	}
+
+	if (animations[0].IsEmpty())
+		throw SDL::Exception(options.SceneFileName + " has no keys to animate");
+
+	// every frame from the first key to the last, the last rounded to the nearest frame
+	float start = animations[0].GetStartTime();
+	int frameCount = (int)((animations[0].GetEndTime() - start) * options.FramesPerSecond + 0.5f) + 1;
+	std::vector<float> times(frameCount);
+	std::vector<std::string> fileNames(frameCount);
+	for (int frame=0; frame<frameCount; ++frame)
+	{
+		times[frame] = start + frame / options.FramesPerSecond;
+		fileNames[frame] = GetFrameFileName(options.Output, frame + 1, frameCount);
+	}
+
+	FramePipeline pipeline(*scenes[0], animations[0], *scenes[1], animations[1]);
+	pipeline.Run(times, fileNames);
+
+	double total = pipeline.GetTotalTime(), render = pipeline.GetRenderTime();
+	printf("%d frames at %dx%d: total %.2f ms, render %.2f ms (%.1f%% of total), %.2f ms per frame\n",
+		frameCount, options.Width, options.Height, total, render, 100.0 * render / total, total / frameCount);
+
+	return 0;
+}
+
+
+int RunWriteCache(const Options& options)
+{
+	typedef boost::chrono::steady_clock Clock_t;
+	typedef boost::chrono::duration<double, boost::milli> Milliseconds_t;
+
+	const auto initPtr = SDL::Init::Create(0);
+	SurfacePtr frameBuffer = Surface::CreateRGBSurface(0, options.Width, options.Height, 32,
+		0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+
+	Scene scene(WindowPtr(), frameBuffer, options.Threads);
+	LoadScene(options, scene);
+
+	Clock_t::time_point start = Clock_t::now();
+	SceneCache::Save(options.CacheFileName, scene);
+	printf("wrote %s in %.2f ms\n", options.CacheFileName.c_str(), Milliseconds_t(Clock_t::now() - start).count());
+
+	return 0;
+}
+
+
+int RunWorker(const Options& options)
+{
+	const auto initPtr = SDL::Init::Create(0);
+
+	RenderWorker worker(options.WorkerAddress, options.Threads);
+	worker.Run();
+
+	return 0;
+}
+
+
+int RunBenchmark(const Options& options)
+{
+	const auto initPtr = SDL::Init::Create(0);
+
+	Benchmark benchmark(options.Width, options.Height, options.BenchmarkFrames, options.Threads);
+	benchmark.SetPacketTracing(options.Packets);
+	benchmark.SetAntialiasing(options.Antialiasing);
+	benchmark.SetTileOrder(options.TileOrder);
+	benchmark.SetPixelOrder(options.PixelOrder);
+	benchmark.SetTileSplitting(options.TileSplitting);
+	benchmark.SetCompareOrders(options.BenchmarkOrders);
+	benchmark.AddStandardScenes();
+
+	if (!options.BenchmarkScene.empty() && !benchmark.HasScene(options.BenchmarkScene))
+	{
+		std::cerr << "unknown benchmark scene: " << options.BenchmarkScene << "\n";
+		return 2;
+	}
+
+	if (options.BenchmarkOutput.empty())
+	{
+		benchmark.Run(options.BenchmarkScene, std::cout);
+		return 0;
+	}
+
+	std::ofstream output(options.BenchmarkOutput.c_str());
+	if (!output)
+		throw SDL::Exception("could not open " + options.BenchmarkOutput);
+
+	benchmark.Run(options.BenchmarkScene, output);
+	return 0;
+}
+
+
+int RunInteractive(const Options& options)
 {
 	const auto initPtr = SDL::Init::Create();
-	auto window = WindowPtr(new Window("RayTracer", 640, 480));
+	auto window = WindowPtr(new Window("RayTracer", options.Width, options.Height));
 
 	window->Quit.connect(boost::bind(&OnQuit, _1));
 
-	Scene scene(window, window->GetSurface());
-
-
-	Plane* plane = new Plane( 0, 1, -0.05f, 250.0f );
-	plane->Material.Reflectivity = 0.0f;
-	plane->Material.Diffuse = 1.0f;
-	plane->Material.Color = Color( 255, 255, 255, 255 );
-	scene.AddObject( Scene::ObjectPtr_t( plane ) );
-
-	Sphere* sphere = new Sphere();
-	sphere->Radius = 150.0f;
-	sphere->Material.Color = SDL::Color( 150, 50, 50, 0 );
-	sphere->Material.Diffuse = 0.5f;
-	sphere->Material.Specular = 0.5f;
-	sphere->Material.Reflectivity = 1.0f;
-	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
-
-	sphere = new Sphere();
-	sphere1 = sphere;
-	sphere->Radius = 100.0f;
-	sphere->Centre = Vector3( 100.0f, 250.0f, 100.0f );
-	sphere->Material.Color = SDL::Color( 20, 150, 20, 0 );
-	sphere->Material.Diffuse = 1.0f;
-	sphere->Material.Specular = 1.0f;
-	sphere->Material.Reflectivity = 1.0f;
-	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
-
-	sphere = new Sphere();
-	sphere->Radius = 60.0f;
-	sphere->Material.Reflectivity = 1.0f;
-	sphere->Material.Specular = 1.0f;
-	sphere->Centre = Vector3( 350.0f, -50.0f, 180.0f );
-	sphere->Material.Color = SDL::Color( 20, 20, 150, 0 );
-	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
-
-	sphere = new Sphere();
-	sphere->Radius = 150.0f;
-	sphere->Centre = Vector3( -300.0f, 50.0f, 100.0f );
-	sphere->Material.Color = SDL::Color( 50, 50, 50, 0 );
-	sphere->Material.Diffuse = 1.0f;
-	sphere->Material.Specular = 1.0f;
-	sphere->Material.Reflectivity = 1.0f;
-	scene.AddObject( Scene::ObjectPtr_t( sphere ) );
-
-	PointLight* light = new PointLight();
-//	light->Direction = Vector3( -1, 0, 0 );
-	light->Position = Vector3( 50.0f, 500.0f, -100.0f );
-
-	scene.AddLight( Scene::LightPtr_t( light ) );
-
-	scene.Render();
-	window->UpdateSurface();
-
-	window->KeyUp.connect( boost::bind( &OnKeyUp, _1 ) );
+	Scene scene(window, window->GetSurface(), options.Threads);
+	ConfigureScene(options, scene);
+	LoadScene(options, scene);
+
+	window->KeyUp.connect( boost::bind( &OnKeyUp, boost::ref( scene ), _1 ) );
+
+	// the image is refined between events, and starts over whenever a key changes the scene
+	scene.StartRender();
 
 	while(true)
 	{
-		window->WaitForEvent();
+		if (scene.IsRendering())
+		{
+			window->WaitForEvent(RENDER_POLL_MS);
+			scene.PollRender();
+		}
+		else
+		{
+			window->WaitForEvent();
+		}
 	}
 
 	return 0;
 }
 
 
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	try
+	{
+		if (options.Benchmark)
+			return RunBenchmark(options);
+
+		if (!options.CacheFileName.empty())
+			return RunWriteCache(options);
+
+		if (!options.WorkerAddress.empty())
+			return RunWorker(options);
+
+		if (options.Animate)
+			return RunAnimation(options);
+
+		if (!options.CoordinatorAddress.empty() || !options.CheckpointFileName.empty())
+			return RunHeadless(options);
+
+		return options.Headless ? RunHeadless(options) : RunInteractive(options);
+	}
+	catch (const SDL::Exception& e)
+	{
+		std::cerr << "error: " << e.GetMessage() << "\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+	}
+
+	return 1;
+}
+
+
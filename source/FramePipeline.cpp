@@ -0,0 +1,140 @@
+#include "FramePipeline.h"
+#include "ImageWriter.h"
+
+#include <cstdio>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+
+namespace
+{
+	typedef boost::chrono::steady_clock Clock_t;
+	typedef boost::chrono::duration<double, boost::milli> Milliseconds_t;
+
+	// how many steps behind the frame being posed each stage works
+	const int UPDATE_LAG = 0;
+	const int RENDER_LAG = 1;
+	const int WRITE_LAG = 2;
+}
+
+
+FramePipeline::FramePipeline(Scene& first, const Animation& firstAnimation, Scene& second, const Animation& secondAnimation)
+	: times(NULL), fileNames(NULL), totalTime(0.0)
+{
+	scenes[0] = &first;
+	scenes[1] = &second;
+	animations[0] = &firstAnimation;
+	animations[1] = &secondAnimation;
+}
+
+
+void FramePipeline::Run(const std::vector<float>& times, const std::vector<std::string>& fileNames)
+{
+	this->times = &times;
+	this->fileNames = &fileNames;
+	frames.assign(times.size(), FrameTimes());
+	error.clear();
+
+	Clock_t::time_point start = Clock_t::now();
+
+	boost::barrier barrier(3);
+	boost::thread updater(boost::bind(&FramePipeline::RunStage, this, &FramePipeline::UpdateFrame, UPDATE_LAG, boost::ref(barrier)));
+	boost::thread writer(boost::bind(&FramePipeline::RunStage, this, &FramePipeline::WriteFrame, WRITE_LAG, boost::ref(barrier)));
+	RunStage(&FramePipeline::TraceFrame, RENDER_LAG, barrier);
+	updater.join();
+	writer.join();
+
+	totalTime = Milliseconds_t(Clock_t::now() - start).count();
+
+	if (!error.empty())
+		throw SDL::Exception(error);
+}
+
+
+double FramePipeline::GetRenderTime() const
+{
+	double total = 0.0;
+	for (std::size_t i=0; i<frames.size(); ++i)
+		total += frames[i].Render;
+	return total;
+}
+
+
+bool FramePipeline::HasFailed()
+{
+	boost::mutex::scoped_lock lock(errorMutex);
+	return !error.empty();
+}
+
+
+// Works on the frame lag steps behind the one being posed, for each step until the last frame has been
+// written, and waits for the other stages at the end of every step. The frames posed and written in a
+// step are both in the scene not being traced
+void FramePipeline::RunStage(void (FramePipeline::*stage)(int), int lag, boost::barrier& barrier)
+{
+	const int frameCount = (int)frames.size();
+
+	for (int step=0; step<frameCount+WRITE_LAG; ++step)
+	{
+		int frame = step - lag;
+		if (frame >= 0 && frame < frameCount && !HasFailed())
+		{
+			std::string message;
+			try
+			{
+				(this->*stage)(frame);
+			}
+			catch (const SDL::Exception& e)
+			{
+				message = e.GetMessage();
+			}
+			catch (const std::exception& e)
+			{
+				message = e.what();
+			}
+
+			if (!message.empty())
+			{
+				boost::mutex::scoped_lock lock(errorMutex);
+				if (error.empty())
+					error = message;
+			}
+		}
+
+		// a stage which failed keeps turning up here, so the others are not left waiting for it
+		barrier.wait();
+	}
+}
+
+
+void FramePipeline::UpdateFrame(int frame)
+{
+	Clock_t::time_point start = Clock_t::now();
+
+	Scene& scene = *scenes[frame % 2];
+	animations[frame % 2]->Apply(scene, (*times)[frame]);
+	scene.UpdateHierarchy();
+
+	frames[frame].Update = Milliseconds_t(Clock_t::now() - start).count();
+}
+
+
+void FramePipeline::TraceFrame(int frame)
+{
+	Clock_t::time_point start = Clock_t::now();
+	scenes[frame % 2]->Render();
+	frames[frame].Render = Milliseconds_t(Clock_t::now() - start).count();
+}
+
+
+void FramePipeline::WriteFrame(int frame)
+{
+	Clock_t::time_point start = Clock_t::now();
+	ImageWriter::Save(scenes[frame % 2]->GetFrameBuffer(), (*fileNames)[frame]);
+	frames[frame].Write = Milliseconds_t(Clock_t::now() - start).count();
+
+	const FrameTimes& times = frames[frame];
+	printf("frame %d/%d: update %.2f ms, render %.2f ms, write %.2f ms -> %s\n", frame + 1, (int)frames.size(),
+		times.Update, times.Render, times.Write, (*fileNames)[frame].c_str());
+}
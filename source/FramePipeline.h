@@ -0,0 +1,63 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include "Scene.h"
+#include "Animation.h"
+
+#include <string>
+#include <vector>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/mutex.hpp>
+
+
+// Renders the frames of an animation in three stages which run at once on their own threads, each a
+// frame behind the one before: while frame N is traced, frame N+1 is posed and its hierarchies
+// refitted, and frame N-1 is encoded and written. The trace only waits for the other two when they
+// take longer than it, so rendering an animation costs about what tracing its frames does.
+//
+// Posing a frame cannot touch the scene being traced, so there are two copies of the scene, loaded the
+// same way, and the frames alternate between them. Posing leaves a scene's frame buffer alone, so
+// frame N-1 is written from its scene while that is posed for frame N+1.
+class FramePipeline
+{
+private:
+	class FrameTimes
+	{
+	public:
+		double Update, Render, Write;
+
+		FrameTimes() : Update(0.0), Render(0.0), Write(0.0) {}
+	};
+
+	Scene* scenes[2];
+	const Animation* animations[2];
+
+	const std::vector<float>* times;
+	const std::vector<std::string>* fileNames;
+	std::vector<FrameTimes> frames;
+	double totalTime;
+
+	// the first error a stage hit, after which the stages stop working but keep in step
+	std::string error;
+	boost::mutex errorMutex;
+
+	bool HasFailed();
+	void RunStage(void (FramePipeline::*stage)(int), int lag, boost::barrier& barrier);
+	void UpdateFrame(int frame);
+	void TraceFrame(int frame);
+	void WriteFrame(int frame);
+
+public:
+	FramePipeline(Scene& first, const Animation& firstAnimation, Scene& second, const Animation& secondAnimation);
+
+	// Renders a frame at each of times, in seconds, and writes it to the file name with the same index,
+	// printing a line for each as it is written. Throws the first error any stage had
+	void Run(const std::vector<float>& times, const std::vector<std::string>& fileNames);
+
+	// time spent tracing frames, and in the whole of the last Run, in milliseconds
+	double GetRenderTime() const;
+	inline double GetTotalTime() const { return totalTime; }
+};
+
+
+#endif
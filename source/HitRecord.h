@@ -0,0 +1,36 @@
+#ifndef HITRECORD_H
+#define HITRECORD_H
+
+#include "Vector3.h"
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+
+class Object;
+
+
+// Everything the shading code needs to know about where a ray hit. Tracing finds the distance,
+// object and primitive; the point, normal and surface coordinates are then filled in once, for the
+// closest hit only.
+class HitRecord
+{
+public:
+	float Distance;
+	Vector3 Point, Normal;
+	// surface coordinates: barycentric for triangles (relative to the second and third corners),
+	// longitude and latitude over 0 to 1 for spheres, 0 where an object has none
+	float U, V;
+	// triangle within a mesh, or 0
+	boost::uint32_t PrimitiveId;
+	const ::Object* Object;
+	// which of the scene's primitive groups the object is in, so finishing the hit needs no virtual call
+	int Group;
+
+	inline HitRecord()
+		: Distance(0.0f), U(0.0f), V(0.0f), PrimitiveId(0), Object(NULL), Group(0)
+	{}
+};
+
+
+#endif
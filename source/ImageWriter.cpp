@@ -0,0 +1,210 @@
+
+
+#include "ImageWriter.h"
+#include "SDL/Exception.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+
+namespace
+{
+	std::string GetExtension(const std::string& fileName)
+	{
+		std::string::size_type dot = fileName.rfind('.');
+		if (dot == std::string::npos)
+			return std::string();
+
+		std::string extension = fileName.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+
+
+	void WriteFile(const std::string& fileName, const ImageWriter::Buffer_t& data)
+	{
+		std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+			throw SDL::Exception("Could not open " + fileName + " for writing");
+
+		if (!data.empty())
+			file.write((const char*)&data[0], data.size());
+
+		if (!file)
+			throw SDL::Exception("Could not write " + fileName);
+	}
+
+
+	void AppendBigEndian(ImageWriter::Buffer_t& buffer, boost::uint32_t value)
+	{
+		buffer.push_back((boost::uint8_t)(value >> 24));
+		buffer.push_back((boost::uint8_t)(value >> 16));
+		buffer.push_back((boost::uint8_t)(value >> 8));
+		buffer.push_back((boost::uint8_t)value);
+	}
+
+
+	class CrcTable
+	{
+	public:
+		boost::uint32_t Entries[256];
+
+		CrcTable()
+		{
+			for (boost::uint32_t n=0; n<256; ++n)
+			{
+				boost::uint32_t c = n;
+				for (int k=0; k<8; ++k)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				Entries[n] = c;
+			}
+		}
+	};
+
+
+	boost::uint32_t Crc32(const boost::uint8_t* data, std::size_t length, boost::uint32_t crc = 0)
+	{
+		static const CrcTable table;
+
+		crc = ~crc;
+		for (std::size_t i=0; i<length; ++i)
+			crc = table.Entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+
+	void AppendChunk(ImageWriter::Buffer_t& png, const char* type, const ImageWriter::Buffer_t& data)
+	{
+		AppendBigEndian(png, (boost::uint32_t)data.size());
+		std::size_t start = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		AppendBigEndian(png, Crc32(&png[start], png.size() - start));
+	}
+}
+
+
+bool ImageWriter::IsSupported(const std::string& fileName)
+{
+	std::string extension = GetExtension(fileName);
+	return extension == "ppm" || extension == "png" || extension == "bmp";
+}
+
+
+void ImageWriter::Save(const SDL::SurfacePtr& surface, const std::string& fileName)
+{
+	std::string extension = GetExtension(fileName);
+
+	if (extension == "ppm")
+		SavePPM(surface, fileName);
+	else if (extension == "png")
+		SavePNG(surface, fileName);
+	else if (extension == "bmp")
+		SaveBMP(surface, fileName);
+	else
+		throw SDL::Exception("Unsupported image format: " + fileName);
+}
+
+
+ImageWriter::Buffer_t ImageWriter::ReadRGB(const SDL::SurfacePtr& surface)
+{
+	const int width = surface->GetWidth();
+	const int height = surface->GetHeight();
+	Buffer_t rgb(width * height * 3);
+
+	surface->Lock();
+
+	for (int y=0; y<height; ++y)
+		surface->ReadRGB(0, y, width, &rgb[y * width * 3]);
+
+	surface->Unlock();
+	return rgb;
+}
+
+
+void ImageWriter::SavePPM(const SDL::SurfacePtr& surface, const std::string& fileName)
+{
+	std::ostringstream header;
+	header << "P6\n" << surface->GetWidth() << " " << surface->GetHeight() << "\n255\n";
+	const std::string headerText = header.str();
+
+	Buffer_t data(headerText.begin(), headerText.end());
+	Buffer_t rgb = ReadRGB(surface);
+	data.insert(data.end(), rgb.begin(), rgb.end());
+
+	WriteFile(fileName, data);
+}
+
+
+void ImageWriter::SavePNG(const SDL::SurfacePtr& surface, const std::string& fileName)
+{
+	const boost::uint32_t width = surface->GetWidth();
+	const boost::uint32_t height = surface->GetHeight();
+	Buffer_t rgb = ReadRGB(surface);
+
+	// each scanline is prefixed with filter type 0 (none)
+	const std::size_t rowBytes = width * 3;
+	Buffer_t raw;
+	raw.reserve((rowBytes + 1) * height);
+	for (boost::uint32_t y=0; y<height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb.begin() + y * rowBytes, rgb.begin() + (y + 1) * rowBytes);
+	}
+
+	// zlib stream made of uncompressed deflate blocks. Rendered frames are written for speed rather
+	// than size, and this avoids depending on zlib
+	Buffer_t zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+
+	const std::size_t maxBlock = 65535;
+	std::size_t offset = 0;
+	do
+	{
+		std::size_t length = std::min(maxBlock, raw.size() - offset);
+		bool last = offset + length == raw.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((boost::uint8_t)(length & 0xff));
+		zlib.push_back((boost::uint8_t)(length >> 8));
+		zlib.push_back((boost::uint8_t)(~length & 0xff));
+		zlib.push_back((boost::uint8_t)((~length >> 8) & 0xff));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	}
+	while (offset < raw.size());
+
+	boost::uint32_t a = 1, b = 0;
+	for (std::size_t i=0; i<raw.size(); ++i)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	AppendBigEndian(zlib, (b << 16) | a);
+
+	Buffer_t header;
+	AppendBigEndian(header, width);
+	AppendBigEndian(header, height);
+	header.push_back(8); // bit depth
+	header.push_back(2); // colour type RGB
+	header.push_back(0); // compression
+	header.push_back(0); // filter
+	header.push_back(0); // interlace
+
+	static const boost::uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	Buffer_t png(signature, signature + 8);
+	AppendChunk(png, "IHDR", header);
+	AppendChunk(png, "IDAT", zlib);
+	AppendChunk(png, "IEND", Buffer_t());
+
+	WriteFile(fileName, png);
+}
+
+
+void ImageWriter::SaveBMP(const SDL::SurfacePtr& surface, const std::string& fileName)
+{
+	surface->SaveBMP(fileName);
+}
@@ -0,0 +1,33 @@
+
+
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include "SDL/Surface.h"
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+// Writes surfaces to image files without needing a window or any image library.
+class ImageWriter
+{
+public:
+	typedef std::vector<boost::uint8_t> Buffer_t;
+
+	// Picks the format from the file extension: .ppm, .png or .bmp
+	static void Save(const SDL::SurfacePtr& surface, const std::string& fileName);
+
+	static void SavePPM(const SDL::SurfacePtr& surface, const std::string& fileName);
+	static void SavePNG(const SDL::SurfacePtr& surface, const std::string& fileName);
+	static void SaveBMP(const SDL::SurfacePtr& surface, const std::string& fileName);
+
+	static bool IsSupported(const std::string& fileName);
+
+	// Packed 8 bit RGB copy of the surface, top row first
+	static Buffer_t ReadRGB(const SDL::SurfacePtr& surface);
+};
+
+
+#endif
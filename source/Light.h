@@ -22,7 +22,7 @@ public:
 
 	SDL::Color Colour;
 
-	virtual LIGHT_TYPE GetLightType() const = 0 {}
+	virtual LIGHT_TYPE GetLightType() const = 0;
 };
 
 
@@ -1,6 +1,74 @@
 
 
 #include "Mesh.h"
+#include "Triangle.h"
+#include "ParseState.h"
+#include "CacheStream.h"
+
+#include <cmath>
+
+
+namespace
+{
+	// the mesh's hierarchy is built again once moving its vertices has made it this many times more costly
+	const float REBUILD_THRESHOLD = 1.5f;
+
+
+	// parses a 1-based (or negative, relative) OBJ index and returns it 0-based
+	bool ParseIndex(ParseState& state, std::size_t count, boost::uint32_t& index)
+	{
+		const char* p = state.Position;
+		bool negative = false;
+		if (p < state.End && *p == '-')
+		{
+			negative = true;
+			++p;
+		}
+
+		if (p >= state.End || !ParseState::IsDigit(*p))
+			return false;
+
+		// no index can be more than the count, so there is no need to read any further
+		long long value = 0;
+		while (p < state.End && ParseState::IsDigit(*p))
+		{
+			value = value * 10 + (*p++ - '0');
+			if (value > (long long)count)
+				throw state.Error("Index out of range");
+		}
+		state.Position = p;
+
+		long long resolved = negative ? (long long)count - value : value - 1;
+		if (resolved < 0 || resolved >= (long long)count)
+			throw state.Error("Index out of range");
+
+		index = (boost::uint32_t)resolved;
+		return true;
+	}
+
+
+	// reads one face corner of the form v, v/vt, v//vn or v/vt/vn
+	void ParseCorner(ParseState& state, std::size_t vertexCount, std::size_t normalCount, boost::uint32_t& vertex, boost::uint32_t& normal, bool& hasNormal)
+	{
+		if (!ParseIndex(state, vertexCount, vertex))
+			throw state.Error("Expected a vertex index");
+
+		hasNormal = false;
+		if (state.Position < state.End && *state.Position == '/')
+		{
+			++state.Position;
+			// texture coordinates are not used, skip them
+			while (state.Position < state.End && (ParseState::IsDigit(*state.Position) || *state.Position == '-'))
+				++state.Position;
+
+			if (state.Position < state.End && *state.Position == '/')
+			{
+				++state.Position;
+				hasNormal = ParseIndex(state, normalCount, normal);
+			}
+		}
+	}
+}
 
 
 Mesh::Mesh()
@@ -8,14 +76,268 @@ Mesh::Mesh()
 }
 
 
+MeshPtr Mesh::Load(const std::string& fileName)
+{
+	std::vector<char> buffer;
+	ParseState::ReadFile(fileName, buffer);
+
+	const char* begin = buffer.empty() ? NULL : &buffer[0];
+	ParseState state(begin, begin + buffer.size(), fileName);
+
+	VertexContainer_t vertices, normals;
+	IndexContainer_t indices, normalIndices;
+	bool allFacesHaveNormals = true;
+
+	// a rough guess at the number of vertices, to avoid most of the reallocation
+	vertices.reserve(buffer.size() / 64);
+	indices.reserve(buffer.size() / 16);
+
+	std::vector<boost::uint32_t> faceVertices, faceNormals;
+
+	while (state.Position < state.End)
+	{
+		std::size_t keywordLength;
+		const char* keyword = state.ParseWord(keywordLength);
+
+		if (keywordLength == 1 && keyword[0] == 'v')
+		{
+			float x = state.ParseFloat();
+			float y = state.ParseFloat();
+			float z = state.ParseFloat();
+			vertices.push_back(Vector3(x, y, z));
+		}
+		else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+		{
+			float x = state.ParseFloat();
+			float y = state.ParseFloat();
+			float z = state.ParseFloat();
+			normals.push_back(Vector3::Normalize(Vector3(x, y, z)));
+		}
+		else if (keywordLength == 1 && keyword[0] == 'f')
+		{
+			faceVertices.clear();
+			faceNormals.clear();
+			bool faceHasNormals = true;
+
+			while (true)
+			{
+				state.SkipSpace();
+				if (state.AtEndOfLine())
+					break;
+
+				boost::uint32_t vertex, normal = 0;
+				bool hasNormal;
+				ParseCorner(state, vertices.size(), normals.size(), vertex, normal, hasNormal);
+				faceVertices.push_back(vertex);
+				faceNormals.push_back(normal);
+				faceHasNormals = faceHasNormals && hasNormal;
+			}
+
+			if (faceVertices.size() < 3)
+				throw state.Error("Face has fewer than three vertices");
+
+			allFacesHaveNormals = allFacesHaveNormals && faceHasNormals;
+
+			for (std::size_t i=1; i+1<faceVertices.size(); ++i)
+			{
+				indices.push_back(faceVertices[0]);
+				indices.push_back(faceVertices[i]);
+				indices.push_back(faceVertices[i + 1]);
+				if (allFacesHaveNormals)
+				{
+					normalIndices.push_back(faceNormals[0]);
+					normalIndices.push_back(faceNormals[i]);
+					normalIndices.push_back(faceNormals[i + 1]);
+				}
+			}
+		}
+		// anything else (texture coordinates, groups, materials, comments) is ignored
+
+		state.SkipLine();
+	}
+
+	MeshPtr mesh(new Mesh());
+	if (allFacesHaveNormals && !normals.empty())
+		mesh->SetGeometry(vertices, indices, normals, normalIndices);
+	else
+		mesh->SetGeometry(vertices, indices);
+	return mesh;
+}
+
+
+void Mesh::SetGeometry(const VertexContainer_t& vertices, const IndexContainer_t& indices)
+{
+	SetGeometry(vertices, indices, VertexContainer_t(), IndexContainer_t());
+}
+
+
+void Mesh::SetGeometry(const VertexContainer_t& vertices, const IndexContainer_t& indices,
+	const VertexContainer_t& normals, const IndexContainer_t& normalIndices)
+{
+	if (indices.size() % 3 != 0)
+		throw SDL::Exception("Mesh index count must be a multiple of three");
+	if (!normalIndices.empty() && normalIndices.size() != indices.size())
+		throw SDL::Exception("Mesh normal index count must match the vertex index count");
+
+	this->vertices.assign(vertices);
+	this->indices.assign(indices);
+	this->normals.assign(normals);
+	this->normalIndices.assign(normalIndices);
+	mapping.reset();
+
+	const std::size_t triangleCount = GetTriangleCount();
+	triangles.Clear();
+	triangles.Reserve(triangleCount);
+	for (std::size_t i=0; i<triangleCount; ++i)
+		triangles.Add(this->vertices[this->indices[i * 3]], this->vertices[this->indices[i * 3 + 1]], this->vertices[this->indices[i * 3 + 2]]);
+
+	triangles.Build();
+}
+
+
+void Mesh::SetVertices(const VertexContainer_t& vertices, const VertexContainer_t& normals)
+{
+	if (vertices.size() != this->vertices.size() || normals.size() != this->normals.size())
+		throw SDL::Exception("Moving a mesh's vertices must keep their number");
+
+	// a mesh read from a scene cache keeps no corners to move, so it is built once from a copy of its own
+	if (mapping)
+	{
+		IndexContainer_t indices(this->indices.data(), this->indices.data() + this->indices.size());
+		IndexContainer_t normalIndices(this->normalIndices.data(), this->normalIndices.data() + this->normalIndices.size());
+		SetGeometry(vertices, indices, normals, normalIndices);
+		return;
+	}
+
+	this->vertices.assign(vertices);
+	this->normals.assign(normals);
+
+	const std::size_t triangleCount = GetTriangleCount();
+	for (std::size_t i=0; i<triangleCount; ++i)
+		triangles.Update((boost::uint32_t)i, vertices[indices[i * 3]], vertices[indices[i * 3 + 1]], vertices[indices[i * 3 + 2]]);
+
+	triangles.Refit(REBUILD_THRESHOLD);
+}
+
+
+void Mesh::Write(CacheWriter& writer) const
+{
+	writer.WriteArray(vertices);
+	writer.WriteArray(normals);
+	writer.WriteArray(indices);
+	writer.WriteArray(normalIndices);
+	triangles.Write(writer);
+}
+
+
+MeshPtr Mesh::Map(CacheReader& reader, const boost::shared_ptr<const void>& mapping)
+{
+	MeshPtr mesh(new Mesh());
+	mesh->mapping = mapping;
+	reader.MapArray(mesh->vertices);
+	reader.MapArray(mesh->normals);
+	reader.MapArray(mesh->indices);
+	reader.MapArray(mesh->normalIndices);
+	mesh->triangles.Map(reader);
+
+	if (mesh->indices.size() != mesh->triangles.GetCount() * 3 || (!mesh->normalIndices.empty() && mesh->normalIndices.size() != mesh->indices.size()))
+		throw reader.Error("Mesh arrays differ in length");
+	reader.CheckIndices(mesh->indices, mesh->indices.size(), mesh->vertices.size(), "Mesh refers to a vertex which does not exist");
+	reader.CheckIndices(mesh->normalIndices, mesh->normalIndices.size(), mesh->normals.size(), "Mesh refers to a normal which does not exist");
+	return mesh;
+}
+
+
+bool Mesh::FindTriangle(const Ray& ray, float& distance, boost::uint32_t& triangle, float& u, float& v) const
+{
+	return triangles.Intersect(ray, distance, triangle, u, v);
+}
+
+
 bool Mesh::Trace(const Ray& ray, float& distance) const
 {
-	return false;
+	float nearest = std::numeric_limits<float>::max();
+	boost::uint32_t triangle;
+	float u, v;
+
+	if (!FindTriangle(ray, nearest, triangle, u, v))
+		return false;
+
+	distance = nearest;
+	return true;
+}
+
+
+bool Mesh::Occludes(const Ray& ray, float maxDistance) const
+{
+	return triangles.Occludes(ray, maxDistance);
 }
 
 
 Vector3 Mesh::GetNormal(const Ray& ray, float distance) const
 {
-	return Vector3();
+	// Trace doesn't get to remember which triangle it hit (it must be safe to call from several threads),
+	// so find it again. Limiting the search to just past the known hit culls almost all of the hierarchy
+	float limit = distance + std::max(1.0e-3f, distance * 1.0e-4f);
+	boost::uint32_t triangle;
+	float u, v;
+
+	if (!FindTriangle(ray, limit, triangle, u, v))
+		return Vector3();
+
+	const boost::uint32_t* corners = &indices[triangle * 3];
+
+	if (normalIndices.empty())
+	{
+		const Vector3& a = vertices[corners[0]];
+		return Vector3::Normalize(Vector3::Cross(vertices[corners[1]] - a, vertices[corners[2]] - a));
+	}
+
+	const boost::uint32_t* normalCorners = &normalIndices[triangle * 3];
+	Vector3 normal = normals[normalCorners[0]] * (1.0f - u - v) + normals[normalCorners[1]] * u + normals[normalCorners[2]] * v;
+	return Vector3::Normalize(normal);
+}
+
+
+void Mesh::CompleteHit(const Ray& ray, HitRecord& hit) const
+{
+	const boost::uint32_t* corners = &indices[hit.PrimitiveId * 3];
+	const Vector3& a = vertices[corners[0]];
+	const Vector3& b = vertices[corners[1]];
+	const Vector3& c = vertices[corners[2]];
+
+	// the same test as the store's kernels, so gives the same coordinates
+	float distance, u = 0.0f, v = 0.0f;
+	Triangle::Intersect(a, b, c, ray, distance, u, v);
+	hit.U = u;
+	hit.V = v;
+
+	if (normalIndices.empty())
+	{
+		hit.Normal = Vector3::Normalize(Vector3::Cross(b - a, c - a));
+		return;
+	}
+
+	const boost::uint32_t* normalCorners = &normalIndices[hit.PrimitiveId * 3];
+	Vector3 normal = normals[normalCorners[0]] * (1.0f - u - v) + normals[normalCorners[1]] * u + normals[normalCorners[2]] * v;
+	hit.Normal = Vector3::Normalize(normal);
 }
 
+
+SimdMask Mesh::FindTriangles(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t triangle[]) const
+{
+	return triangles.IntersectPacket(packet, active, distance, triangle);
+}
+
+
+SimdMask Mesh::TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+{
+	boost::uint32_t triangle[RayPacket::Size];
+	return FindTriangles(packet, active, distance, triangle);
+}
+
+
+BoundingBox Mesh::GetBounds() const
+{
+	return triangles.GetBounds();
+}
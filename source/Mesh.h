@@ -3,19 +3,76 @@
 #define MESH_H
 
 #include "Object.h"
+#include "TriangleStore.h"
+#include "PackedArray.h"
 
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 
+
+class Mesh;
+typedef boost::shared_ptr<Mesh> MeshPtr;
+
+
+// Indexed triangle mesh. Triangles are stored as three indices into a shared vertex buffer, and are
+// traced through a TriangleStore of their own, so a whole mesh is a single entry in the scene.
 class Mesh : public Object
 {
+public:
+	typedef std::vector<Vector3> VertexContainer_t;
+	typedef std::vector<boost::uint32_t> IndexContainer_t;
+
 private:
+	PackedArray<Vector3> vertices;
+	PackedArray<Vector3> normals;
+	PackedArray<boost::uint32_t> indices;
+	// optional per-corner indices into normals, parallel to indices. Empty for flat shaded meshes
+	PackedArray<boost::uint32_t> normalIndices;
+	TriangleStore triangles;
+	// keeps the scene cache mapped while a mesh read from it refers into it
+	boost::shared_ptr<const void> mapping;
+
 public:
 	Mesh();
-	
+
+	// Loads a Wavefront OBJ file. Polygons are triangulated as fans, and vertex normals are used
+	// for smooth shading if every face references one.
+	static MeshPtr Load(const std::string& fileName);
+
+	// Replaces the mesh geometry and rebuilds its hierarchy. indices holds three vertex indices per triangle
+	void SetGeometry(const VertexContainer_t& vertices, const IndexContainer_t& indices);
+	void SetGeometry(const VertexContainer_t& vertices, const IndexContainer_t& indices,
+		const VertexContainer_t& normals, const IndexContainer_t& normalIndices);
+	// Moves the vertices, and the normals if the mesh has them, keeping the triangles, and refits the
+	// hierarchy instead of building it again. The counts must stay the same
+	void SetVertices(const VertexContainer_t& vertices, const VertexContainer_t& normals);
+
+	// Writes the mesh's geometry and hierarchy to a scene cache, and reads one back. A mesh read back
+	// is traced straight from the mapped cache, with nothing to parse or build
+	void Write(CacheWriter& writer) const;
+	static MeshPtr Map(CacheReader& reader, const boost::shared_ptr<const void>& mapping);
+
+	inline std::size_t GetTriangleCount() const { return indices.size() / 3; }
+	inline std::size_t GetVertexCount() const { return vertices.size(); }
+	inline const PackedArray<Vector3>& GetVertices() const { return vertices; }
+	inline const PackedArray<Vector3>& GetNormals() const { return normals; }
+
+	// Closest hit, as Trace, which also says which triangle was hit and where on it
+	bool FindTriangle(const Ray& ray, float& distance, boost::uint32_t& triangle, float& u, float& v) const;
+	// Closest hits for a packet, as TracePacket. triangle is written for each lane in the returned mask
+	SimdMask FindTriangles(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t triangle[]) const;
+
 	bool Trace(const Ray& ray, float& distance) const;
+	bool Occludes(const Ray& ray, float maxDistance) const;
+	SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const;
 	Vector3 GetNormal(const Ray& ray, float distance) const;
+	// uses the triangle in hit.PrimitiveId rather than searching for it again
+	void CompleteHit(const Ray& ray, HitRecord& hit) const;
+	BoundingBox GetBounds() const;
 	
 };
 
 
 #endif
-
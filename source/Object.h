@@ -4,6 +4,9 @@
 
 #include "Ray.h"
 #include "Material.h"
+#include "BoundingBox.h"
+#include "RayPacket.h"
+#include "HitRecord.h"
 
 
 class Object
@@ -12,12 +15,53 @@ public:
 	Object() {}
 	virtual ~Object() {}
 
-	Material Material;
+	::Material Material;
 
 
 	virtual bool Trace(const Ray& ray, float& distance) const=0;
 	virtual Vector3 GetNormal(const Ray& ray, float distance) const=0;
 
+	// Occlusion-only query, used for shadow rays: true if the ray hits the object anywhere in
+	// [0, maxDistance). Objects which can answer this more cheaply than a closest hit should override it
+	virtual bool Occludes(const Ray& ray, float maxDistance) const
+	{
+		float distance;
+		return Trace(ray, distance) && distance >= 0.0f && distance < maxDistance;
+	}
+
+	// Traces every active lane of a packet. Lanes which hit the object closer than distance have
+	// distance lowered and are returned in the mask. The default traces the lanes one at a time;
+	// objects with a vectorised intersection test override it
+	virtual SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+	{
+		float distances[RayPacket::Size];
+		distance.Store(distances);
+
+		int hits = 0;
+		for (int lane=0; lane<RayPacket::Size; ++lane)
+		{
+			float laneDistance;
+			if (active.IsSet(lane) && Trace(packet.GetRay(lane), laneDistance) && laneDistance < distances[lane])
+			{
+				distances[lane] = laneDistance;
+				hits |= 1 << lane;
+			}
+		}
+
+		distance = SimdFloat::Load(distances);
+		return SimdMask::FromBits(hits);
+	}
+
+	// Fills in the normal and surface coordinates of a hit on this object, given its distance, point
+	// and primitive. The default only knows the normal
+	virtual void CompleteHit(const Ray& ray, HitRecord& hit) const
+	{
+		hit.Normal = GetNormal(ray, hit.Distance);
+	}
+
+	// World space bounds of the object. Objects with no finite extent return BoundingBox::Infinite()
+	virtual BoundingBox GetBounds() const=0;
+
 };
 
 
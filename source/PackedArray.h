@@ -0,0 +1,98 @@
+#ifndef PACKEDARRAY_H
+#define PACKEDARRAY_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+
+// Array of plain data which either owns its elements, like a vector, or refers to elements kept
+// somewhere else, such as a mapped scene cache, so that loaded data is traced where it lies instead
+// of being copied. Reading works the same either way; anything which changes the array needs it to
+// own its elements, and Refer gives them up.
+template <class T>
+class PackedArray
+{
+public:
+	typedef typename std::vector<T>::iterator iterator;
+
+private:
+	std::vector<T> storage;
+	const T* elements;
+	std::size_t count;
+	bool owner;
+
+	// after the storage changed, so the elements read are its own
+	inline void Own()
+	{
+		elements = storage.empty() ? NULL : &storage[0];
+		count = storage.size();
+		owner = true;
+	}
+
+public:
+	PackedArray() : elements(NULL), count(0), owner(true) {}
+
+	PackedArray(const PackedArray& other)
+		: storage(other.storage), elements(other.elements), count(other.count), owner(other.owner)
+	{
+		if (owner)
+			Own();
+	}
+
+	PackedArray& operator= (const PackedArray& other)
+	{
+		storage = other.storage;
+		elements = other.elements;
+		count = other.count;
+		owner = other.owner;
+		if (owner)
+			Own();
+		return *this;
+	}
+
+	// uses count elements at data, which must stay valid as long as the array refers to them
+	void Refer(const T* data, std::size_t count)
+	{
+		std::vector<T>().swap(storage);
+		elements = data;
+		this->count = count;
+		owner = false;
+	}
+
+	inline bool IsOwner() const { return owner; }
+
+	inline std::size_t size() const { return count; }
+	inline bool empty() const { return count == 0; }
+	inline const T* data() const { return elements; }
+
+	inline const T& operator[] (std::size_t index) const { return elements[index]; }
+	inline T& operator[] (std::size_t index)
+	{
+		assert(owner);
+		return storage[index];
+	}
+
+	inline iterator begin() { assert(owner); return storage.begin(); }
+	inline iterator end() { assert(owner); return storage.end(); }
+
+	void clear() { storage.clear(); Own(); }
+	void reserve(std::size_t size) { assert(owner); storage.reserve(size); Own(); }
+	void resize(std::size_t size) { Take(); storage.resize(size); Own(); }
+	void assign(std::size_t size, const T& value) { storage.assign(size, value); Own(); }
+	void assign(const std::vector<T>& values) { storage = values; Own(); }
+	void push_back(const T& value) { Take(); storage.push_back(value); Own(); }
+
+	// copies referred elements into storage of its own, so the array can be changed
+	void Take()
+	{
+		if (!owner)
+		{
+			storage.assign(elements, elements + count);
+			Own();
+		}
+	}
+};
+
+
+#endif
@@ -0,0 +1,138 @@
+#include "ParseState.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <boost/cstdint.hpp>
+
+
+namespace
+{
+	// largest number that can still take another digit without overflowing
+	const boost::uint64_t MAX_MANTISSA = 1000000000000000000ull;
+	// powers of ten up to this are exact in a double, so scaling by them rounds only once
+	const int MAX_EXACT_POWER = 22;
+	const double POWERS_OF_TEN[MAX_EXACT_POWER + 1] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+}
+
+
+void ParseState::ReadFile(const std::string& fileName, std::vector<char>& buffer)
+{
+	std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		throw SDL::Exception("Could not open " + fileName);
+
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	buffer.resize((std::size_t)size);
+	if (size > 0 && !file.read(&buffer[0], size))
+		throw SDL::Exception("Could not read " + fileName);
+}
+
+
+SDL::Exception ParseState::Error(const std::string& message) const
+{
+	std::ostringstream stream;
+	stream << FileName << "(" << Line << "): " << message;
+	return SDL::Exception(stream.str());
+}
+
+
+float ParseState::ParseFloat()
+{
+	SkipSpace();
+	const char* p = Position;
+
+	bool negative = false;
+	if (p < End && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	if (p >= End || (!IsDigit(*p) && *p != '.'))
+		throw Error("Expected a number");
+
+	// the digits are gathered as a whole number and scaled by a power of ten once at the end, which is
+	// both quicker and more accurate than adding up scaled digits. Digits past what the mantissa holds
+	// only move the exponent
+	boost::uint64_t mantissa = 0;
+	int exponent = 0;
+	while (p < End && IsDigit(*p))
+	{
+		if (mantissa < MAX_MANTISSA)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			++exponent;
+		++p;
+	}
+
+	if (p < End && *p == '.')
+	{
+		++p;
+		while (p < End && IsDigit(*p))
+		{
+			if (mantissa < MAX_MANTISSA)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				--exponent;
+			}
+			++p;
+		}
+	}
+
+	if (p < End && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < End && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+		int written = 0;
+		while (p < End && IsDigit(*p))
+		{
+			if (written < 10000)
+				written = written * 10 + (*p - '0');
+			++p;
+		}
+		exponent += negativeExponent ? -written : written;
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0 && exponent >= -MAX_EXACT_POWER)
+		value /= POWERS_OF_TEN[-exponent];
+	else if (exponent > 0 && exponent <= MAX_EXACT_POWER)
+		value *= POWERS_OF_TEN[exponent];
+	else if (exponent != 0)
+		value *= pow(10.0, exponent);
+
+	Position = p;
+	return (float)(negative ? -value : value);
+}
+
+
+int ParseState::ParseInt()
+{
+	SkipSpace();
+	const char* p = Position;
+
+	bool negative = false;
+	if (p < End && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	if (p >= End || !IsDigit(*p))
+		throw Error("Expected a whole number");
+
+	long long value = 0;
+	while (p < End && IsDigit(*p))
+	{
+		value = value * 10 + (*p++ - '0');
+		if (value > 0x7fffffff)
+			throw Error("Number out of range");
+	}
+
+	Position = p;
+	return (int)(negative ? -value : value);
+}
@@ -0,0 +1,86 @@
+#ifndef PARSESTATE_H
+#define PARSESTATE_H
+
+#include "SDL/Exception.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// Position in a line based text file held in memory, with the small tokenizers the OBJ and scene
+// parsers share. Nothing is copied out of the buffer; words are returned as pointers into it.
+// Errors carry the file name and line number.
+class ParseState
+{
+public:
+	const char* Position;
+	const char* End;
+	const std::string& FileName;
+	int Line;
+
+	ParseState(const char* begin, const char* end, const std::string& fileName)
+		: Position(begin), End(end), FileName(fileName), Line(1)
+	{}
+
+	// Reads the whole file into buffer, which is how both parsers get their input
+	static void ReadFile(const std::string& fileName, std::vector<char>& buffer);
+
+	SDL::Exception Error(const std::string& message) const;
+
+	static inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static inline bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline void SkipSpace()
+	{
+		while (Position < End && IsSpace(*Position))
+			++Position;
+	}
+
+	// at a line break, a comment or the end of the file
+	inline bool AtEndOfLine() const
+	{
+		return Position >= End || *Position == '\n' || *Position == '#';
+	}
+
+	inline void SkipLine()
+	{
+		while (Position < End && *Position != '\n')
+			++Position;
+		if (Position < End)
+		{
+			++Position;
+			++Line;
+		}
+	}
+
+	// the next run of characters up to a space or the end of the line, which may be empty
+	inline const char* ParseWord(std::size_t& length)
+	{
+		SkipSpace();
+		const char* word = Position;
+		while (Position < End && !IsSpace(*Position) && *Position != '\n')
+			++Position;
+		length = Position - word;
+		return word;
+	}
+
+	static inline bool IsWord(const char* word, std::size_t length, const char* keyword)
+	{
+		return std::strlen(keyword) == length && std::memcmp(word, keyword, length) == 0;
+	}
+
+	// locale independent float parser, considerably faster than strtod for the short numbers found in OBJ files
+	float ParseFloat();
+	int ParseInt();
+};
+
+
+#endif
@@ -68,10 +68,34 @@ public:
 	}
 
 
+	SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+	{
+		SimdVector3 normal(Normal);
+		SimdFloat t = -(SimdVector3::Dot(normal, packet.Origin) + Distance) / SimdVector3::Dot(normal, packet.Direction);
+
+		SimdMask hit = active & (t >= 0.0f) & (t < distance);
+		distance = SimdFloat::Select(hit, t, distance);
+		return hit;
+	}
+
+
 	Vector3 GetNormal(const Ray& ray, float distance) const
 	{
 		return Normal;
 	}
+
+
+	void CompleteHit(const Ray& ray, HitRecord& hit) const
+	{
+		hit.Normal = Normal;
+		hit.U = hit.V = 0.0f;
+	}
+
+
+	BoundingBox GetBounds() const
+	{
+		return BoundingBox::Infinite();
+	}
 };
 
 
@@ -0,0 +1,675 @@
+#ifndef PRIMITIVESET_H
+#define PRIMITIVESET_H
+
+#include "Object.h"
+#include "HitRecord.h"
+#include "BVH.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Plane.h"
+#include "Cube.h"
+#include "Box.h"
+#include "Mesh.h"
+#include "SphereStore.h"
+#include "TriangleStore.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+
+// Finds the index an object was added to a group at, so that moving it only touches its own entry
+template <class T>
+class ObjectIndex
+{
+private:
+	typedef std::pair<const T*, boost::uint32_t> Entry_t;
+	std::vector<Entry_t> entries;
+
+public:
+	void Build(const std::vector<const T*>& objects)
+	{
+		entries.resize(objects.size());
+		for (boost::uint32_t i=0; i<objects.size(); ++i)
+			entries[i] = Entry_t(objects[i], i);
+		std::sort(entries.begin(), entries.end());
+	}
+
+	void Clear()
+	{
+		entries.clear();
+	}
+
+	bool Find(const T* object, boost::uint32_t& index) const
+	{
+		typename std::vector<Entry_t>::const_iterator it = std::lower_bound(entries.begin(), entries.end(), Entry_t(object, 0));
+		if (it == entries.end() || it->first != object)
+			return false;
+
+		index = it->second;
+		return true;
+	}
+};
+
+
+// How objects of type T are traced. The calls are qualified with T, so they are bound when the
+// scene is compiled and can be inlined into the groups' loops rather than going through the vtable.
+template <class T>
+class PrimitiveTraits
+{
+public:
+	static inline bool Intersect(const T& object, const Ray& ray, float& distance, boost::uint32_t& primitive)
+	{
+		float hitDistance;
+		if (object.T::Trace(ray, hitDistance) && hitDistance < distance)
+		{
+			distance = hitDistance;
+			primitive = 0;
+			return true;
+		}
+		return false;
+	}
+
+	static inline bool Occludes(const T& object, const Ray& ray, float maxDistance)
+	{
+		return object.T::Occludes(ray, maxDistance);
+	}
+
+	static inline SimdMask IntersectPacket(const T& object, const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t primitive[])
+	{
+		for (int lane=0; lane<RayPacket::Size; ++lane)
+			primitive[lane] = 0;
+		return object.T::TracePacket(packet, active, distance);
+	}
+
+	static inline void CompleteHit(const T& object, const Ray& ray, HitRecord& hit)
+	{
+		object.T::CompleteHit(ray, hit);
+	}
+};
+
+
+// Meshes say which triangle was hit, so its normal can be found without tracing the mesh again
+template <>
+class PrimitiveTraits<Mesh>
+{
+public:
+	static inline bool Intersect(const Mesh& mesh, const Ray& ray, float& distance, boost::uint32_t& primitive)
+	{
+		float u, v;
+		return mesh.FindTriangle(ray, distance, primitive, u, v);
+	}
+
+	static inline bool Occludes(const Mesh& mesh, const Ray& ray, float maxDistance)
+	{
+		return mesh.Occludes(ray, maxDistance);
+	}
+
+	static inline SimdMask IntersectPacket(const Mesh& mesh, const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t primitive[])
+	{
+		return mesh.FindTriangles(packet, active, distance, primitive);
+	}
+
+	static inline void CompleteHit(const Mesh& mesh, const Ray& ray, HitRecord& hit)
+	{
+		mesh.CompleteHit(ray, hit);
+	}
+};
+
+
+// Any other type of object, traced through its virtual functions
+template <>
+class PrimitiveTraits<Object>
+{
+public:
+	static inline bool Intersect(const Object& object, const Ray& ray, float& distance, boost::uint32_t& primitive)
+	{
+		float hitDistance;
+		if (object.Trace(ray, hitDistance) && hitDistance < distance)
+		{
+			distance = hitDistance;
+			primitive = 0;
+			return true;
+		}
+		return false;
+	}
+
+	static inline bool Occludes(const Object& object, const Ray& ray, float maxDistance)
+	{
+		return object.Occludes(ray, maxDistance);
+	}
+
+	static inline SimdMask IntersectPacket(const Object& object, const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t primitive[])
+	{
+		for (int lane=0; lane<RayPacket::Size; ++lane)
+			primitive[lane] = 0;
+		return object.TracePacket(packet, active, distance);
+	}
+
+	static inline void CompleteHit(const Object& object, const Ray& ray, HitRecord& hit)
+	{
+		object.CompleteHit(ray, hit);
+	}
+};
+
+
+// The objects of exactly one type. Those with finite bounds are kept in a hierarchy, and the rest
+// (planes) are tested against every ray. Each method takes the group's index in the scene, which it
+// records in the hits it finds. Object as T takes objects of any type.
+template <class T>
+class PrimitiveGroup
+{
+private:
+	typedef PrimitiveTraits<T> Traits_t;
+
+	std::vector<const T*> bounded, unbounded;
+	std::vector<BoundingBox> bounds;
+	BVH hierarchy;
+	ObjectIndex<T> index;
+	// bounded objects moved since the hierarchy was last fitted
+	std::vector<boost::uint32_t> moved;
+
+	class ClosestIntersector
+	{
+	private:
+		const std::vector<const T*>& objects;
+		const Ray& ray;
+
+	public:
+		const T* Hit;
+		boost::uint32_t Primitive;
+
+		ClosestIntersector(const std::vector<const T*>& objects, const Ray& ray)
+			: objects(objects), ray(ray), Hit(NULL), Primitive(0)
+		{}
+
+		inline bool operator()(boost::uint32_t index, float& distance)
+		{
+			if (!Traits_t::Intersect(*objects[index], ray, distance, Primitive))
+				return false;
+			Hit = objects[index];
+			return true;
+		}
+	};
+
+	class PacketIntersector
+	{
+	private:
+		const std::vector<const T*>& objects;
+		const RayPacket& packet;
+		HitRecord* hits;
+		int group;
+
+	public:
+		PacketIntersector(const std::vector<const T*>& objects, const RayPacket& packet, HitRecord hits[], int group)
+			: objects(objects), packet(packet), hits(hits), group(group)
+		{}
+
+		inline SimdMask operator()(boost::uint32_t index, const SimdMask& lanes, SimdFloat& distance)
+		{
+			boost::uint32_t primitive[RayPacket::Size];
+			SimdMask hit = Traits_t::IntersectPacket(*objects[index], packet, lanes, distance, primitive);
+
+			int bits = hit.GetBits();
+			for (int lane=0; bits != 0; ++lane, bits >>= 1)
+			{
+				if (bits & 1)
+				{
+					hits[lane].Object = objects[index];
+					hits[lane].PrimitiveId = primitive[lane];
+					hits[lane].Group = group;
+				}
+			}
+
+			return hit;
+		}
+	};
+
+	class OcclusionIntersector
+	{
+	private:
+		const std::vector<const T*>& objects;
+		const Ray& ray;
+
+	public:
+		const T* Hit;
+
+		OcclusionIntersector(const std::vector<const T*>& objects, const Ray& ray)
+			: objects(objects), ray(ray), Hit(NULL)
+		{}
+
+		inline bool operator()(boost::uint32_t index, float maxDistance)
+		{
+			if (!Traits_t::Occludes(*objects[index], ray, maxDistance))
+				return false;
+			Hit = objects[index];
+			return true;
+		}
+	};
+
+public:
+	// only exact types, as a subclass may trace differently
+	static inline bool Accepts(const Object& object)
+	{
+		return typeid(object) == typeid(T);
+	}
+
+	void Clear()
+	{
+		bounded.clear();
+		unbounded.clear();
+		bounds.clear();
+		hierarchy.Clear();
+		index.Clear();
+		moved.clear();
+	}
+
+	void Add(const T* object)
+	{
+		BoundingBox box = object->GetBounds();
+		if (box.IsFinite())
+		{
+			bounded.push_back(object);
+			bounds.push_back(box);
+		}
+		else
+		{
+			unbounded.push_back(object);
+		}
+	}
+
+	void Build()
+	{
+		hierarchy.Build(bounds);
+		index.Build(bounded);
+		moved.clear();
+	}
+
+	// Notes that an object has moved. Unbounded objects are always traced as they are, so need nothing
+	void Update(const T* object)
+	{
+		boost::uint32_t i;
+		if (!index.Find(object, i))
+			return;
+
+		bounds[i] = object->GetBounds();
+		moved.push_back(i);
+	}
+
+	// Fits the hierarchy around the objects moved since the last fit, rebuilding it instead if its cost
+	// would grow past rebuildThreshold times the cost it was built with
+	void Refit(float rebuildThreshold)
+	{
+		if (moved.empty())
+			return;
+
+		hierarchy.Refit(bounds, moved);
+		moved.clear();
+
+		if (hierarchy.GetCost() > hierarchy.GetBuildCost() * rebuildThreshold)
+			hierarchy.Build(bounds);
+	}
+
+	// Closest hit. If there is one nearer than hit.Distance, lowers it and records the object
+	bool Intersect(const Ray& ray, HitRecord& hit, int group) const
+	{
+		ClosestIntersector intersector(unbounded, ray);
+		for (boost::uint32_t i=0; i<unbounded.size(); ++i)
+			intersector(i, hit.Distance);
+
+		// then the hierarchy, which only descends into nodes closer than the best hit so far
+		ClosestIntersector hierarchyIntersector(bounded, ray);
+		hierarchy.Intersect(ray, hit.Distance, hierarchyIntersector);
+
+		const ClosestIntersector& closest = hierarchyIntersector.Hit != NULL ? hierarchyIntersector : intersector;
+		if (closest.Hit == NULL)
+			return false;
+
+		hit.Object = closest.Hit;
+		hit.PrimitiveId = closest.Primitive;
+		hit.Group = group;
+		return true;
+	}
+
+	// true if anything blocks the ray before maxDistance, giving the first object found to
+	bool Occludes(const Ray& ray, float maxDistance, const Object*& occluder) const
+	{
+		OcclusionIntersector intersector(unbounded, ray);
+		for (boost::uint32_t i=0; i<unbounded.size(); ++i)
+		{
+			if (intersector(i, maxDistance))
+			{
+				occluder = intersector.Hit;
+				return true;
+			}
+		}
+
+		OcclusionIntersector hierarchyIntersector(bounded, ray);
+		if (!hierarchy.IntersectAny(ray, maxDistance, hierarchyIntersector))
+			return false;
+
+		occluder = hierarchyIntersector.Hit;
+		return true;
+	}
+
+	// Closest hits for a packet, recording the object in hits for each lane returned
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[], int group) const
+	{
+		PacketIntersector intersector(unbounded, packet, hits, group);
+		SimdMask hit(false);
+		for (boost::uint32_t i=0; i<unbounded.size(); ++i)
+			hit = hit | intersector(i, active, distance);
+
+		PacketIntersector hierarchyIntersector(bounded, packet, hits, group);
+		return hit | hierarchy.IntersectPacket(packet, active, distance, hierarchyIntersector);
+	}
+
+	static inline void CompleteHit(const Ray& ray, HitRecord& hit)
+	{
+		Traits_t::CompleteHit(static_cast<const T&>(*hit.Object), ray, hit);
+	}
+};
+
+
+template <>
+inline bool PrimitiveGroup<Object>::Accepts(const Object& object)
+{
+	return true;
+}
+
+
+// Spheres are copied into a SphereStore and traced with its vectorised kernels
+template <>
+class PrimitiveGroup<Sphere>
+{
+private:
+	SphereStore spheres;
+	// indexed by store id
+	std::vector<const Sphere*> objects;
+	ObjectIndex<Sphere> index;
+
+public:
+	static inline bool Accepts(const Object& object)
+	{
+		return typeid(object) == typeid(Sphere);
+	}
+
+	void Clear()
+	{
+		spheres.Clear();
+		objects.clear();
+		index.Clear();
+	}
+
+	void Add(const Sphere* sphere)
+	{
+		spheres.Add(sphere->Centre, sphere->Radius);
+		objects.push_back(sphere);
+	}
+
+	void Build()
+	{
+		spheres.Build();
+		index.Build(objects);
+	}
+
+	void Update(const Sphere* sphere)
+	{
+		boost::uint32_t id;
+		if (index.Find(sphere, id))
+			spheres.Update(id, sphere->Centre, sphere->Radius);
+	}
+
+	void Refit(float rebuildThreshold)
+	{
+		spheres.Refit(rebuildThreshold);
+	}
+
+	bool Intersect(const Ray& ray, HitRecord& hit, int group) const
+	{
+		boost::uint32_t id;
+		if (!spheres.Intersect(ray, hit.Distance, id))
+			return false;
+
+		hit.Object = objects[id];
+		hit.PrimitiveId = 0;
+		hit.Group = group;
+		return true;
+	}
+
+	bool Occludes(const Ray& ray, float maxDistance, const Object*& occluder) const
+	{
+		boost::uint32_t id;
+		if (!spheres.Occludes(ray, maxDistance, id))
+			return false;
+
+		occluder = objects[id];
+		return true;
+	}
+
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[], int group) const
+	{
+		boost::uint32_t id[RayPacket::Size];
+		SimdMask hit = spheres.IntersectPacket(packet, active, distance, id);
+
+		int bits = hit.GetBits();
+		for (int lane=0; bits != 0; ++lane, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				hits[lane].Object = objects[id[lane]];
+				hits[lane].PrimitiveId = 0;
+				hits[lane].Group = group;
+			}
+		}
+
+		return hit;
+	}
+
+	static inline void CompleteHit(const Ray& ray, HitRecord& hit)
+	{
+		static_cast<const Sphere*>(hit.Object)->Sphere::CompleteHit(ray, hit);
+	}
+};
+
+
+// Triangles are copied into a TriangleStore and traced with its vectorised kernels
+template <>
+class PrimitiveGroup<Triangle>
+{
+private:
+	TriangleStore triangles;
+	// indexed by store id
+	std::vector<const Triangle*> objects;
+	ObjectIndex<Triangle> index;
+
+public:
+	static inline bool Accepts(const Object& object)
+	{
+		return typeid(object) == typeid(Triangle);
+	}
+
+	void Clear()
+	{
+		triangles.Clear();
+		objects.clear();
+		index.Clear();
+	}
+
+	void Add(const Triangle* triangle)
+	{
+		triangles.Add(triangle->A, triangle->B, triangle->C);
+		objects.push_back(triangle);
+	}
+
+	void Build()
+	{
+		triangles.Build();
+		index.Build(objects);
+	}
+
+	void Update(const Triangle* triangle)
+	{
+		boost::uint32_t id;
+		if (index.Find(triangle, id))
+			triangles.Update(id, triangle->A, triangle->B, triangle->C);
+	}
+
+	void Refit(float rebuildThreshold)
+	{
+		triangles.Refit(rebuildThreshold);
+	}
+
+	bool Intersect(const Ray& ray, HitRecord& hit, int group) const
+	{
+		boost::uint32_t id;
+		float u, v;
+		if (!triangles.Intersect(ray, hit.Distance, id, u, v))
+			return false;
+
+		hit.Object = objects[id];
+		hit.PrimitiveId = 0;
+		hit.Group = group;
+		return true;
+	}
+
+	bool Occludes(const Ray& ray, float maxDistance, const Object*& occluder) const
+	{
+		boost::uint32_t id;
+		if (!triangles.Occludes(ray, maxDistance, id))
+			return false;
+
+		occluder = objects[id];
+		return true;
+	}
+
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[], int group) const
+	{
+		boost::uint32_t id[RayPacket::Size];
+		SimdMask hit = triangles.IntersectPacket(packet, active, distance, id);
+
+		int bits = hit.GetBits();
+		for (int lane=0; bits != 0; ++lane, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				hits[lane].Object = objects[id[lane]];
+				hits[lane].PrimitiveId = 0;
+				hits[lane].Group = group;
+			}
+		}
+
+		return hit;
+	}
+
+	static inline void CompleteHit(const Ray& ray, HitRecord& hit)
+	{
+		static_cast<const Triangle*>(hit.Object)->Triangle::CompleteHit(ray, hit);
+	}
+};
+
+
+// A group for each of Types, in order; Index is the position of the first. Objects go in the first
+// group that accepts them. All of the dispatch is resolved at compile time: tracing runs through each
+// group's loop in turn, and completing a hit picks the group by its index.
+template <int Index, class... Types>
+class PrimitiveGroupList
+{
+public:
+	inline void Clear() {}
+	inline bool Add(const Object* object) { return false; }
+	inline void Build() {}
+	inline void Update(const Object* object) {}
+	inline void Refit(float rebuildThreshold) {}
+	inline bool Intersect(const Ray& ray, HitRecord& hit) const { return false; }
+	inline bool Occludes(const Ray& ray, float maxDistance, const Object*& occluder) const { return false; }
+	inline SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[]) const { return SimdMask(false); }
+	inline void CompleteHit(const Ray& ray, HitRecord& hit) const {}
+};
+
+
+template <int Index, class T, class... Rest>
+class PrimitiveGroupList<Index, T, Rest...>
+{
+private:
+	PrimitiveGroup<T> group;
+	PrimitiveGroupList<Index + 1, Rest...> rest;
+
+public:
+	void Clear()
+	{
+		group.Clear();
+		rest.Clear();
+	}
+
+	// false if no group takes the object
+	bool Add(const Object* object)
+	{
+		if (!PrimitiveGroup<T>::Accepts(*object))
+			return rest.Add(object);
+
+		group.Add(static_cast<const T*>(object));
+		return true;
+	}
+
+	void Build()
+	{
+		group.Build();
+		rest.Build();
+	}
+
+	// for an object already added whose geometry has changed. Refit must be called before tracing again
+	void Update(const Object* object)
+	{
+		if (!PrimitiveGroup<T>::Accepts(*object))
+			rest.Update(object);
+		else
+			group.Update(static_cast<const T*>(object));
+	}
+
+	// Fits each group's hierarchy around the objects updated since the last build or fit. A group whose
+	// hierarchy would then cost more than rebuildThreshold times what it did when built is rebuilt instead
+	void Refit(float rebuildThreshold)
+	{
+		group.Refit(rebuildThreshold);
+		rest.Refit(rebuildThreshold);
+	}
+
+	// closest hit nearer than hit.Distance. Fills in the distance, object, primitive and group
+	inline bool Intersect(const Ray& ray, HitRecord& hit) const
+	{
+		bool found = group.Intersect(ray, hit, Index);
+		return rest.Intersect(ray, hit) || found;
+	}
+
+	// true if anything blocks the ray before maxDistance, giving the first object found to
+	inline bool Occludes(const Ray& ray, float maxDistance, const Object*& occluder) const
+	{
+		return group.Occludes(ray, maxDistance, occluder) || rest.Occludes(ray, maxDistance, occluder);
+	}
+
+	// closest hits for a packet: the distances are lowered, and the rest filled in for the lanes returned
+	inline SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[]) const
+	{
+		SimdMask hit = group.IntersectPacket(packet, active, distance, hits, Index);
+		return hit | rest.IntersectPacket(packet, active, distance, hits);
+	}
+
+	// fills in the normal and surface coordinates of a hit found by Intersect, once its Point is set
+	inline void CompleteHit(const Ray& ray, HitRecord& hit) const
+	{
+		if (hit.Group == Index)
+			PrimitiveGroup<T>::CompleteHit(ray, hit);
+		else
+			rest.CompleteHit(ray, hit);
+	}
+};
+
+
+template <class... Types>
+using PrimitiveSet = PrimitiveGroupList<0, Types...>;
+
+
+#endif
@@ -0,0 +1,48 @@
+
+
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "Ray.h"
+#include "Simd.h"
+
+
+// SimdFloat::Width rays traced together, one per lane. Packets are built from neighbouring pixels, so
+// the rays mostly hit the same objects and visit the same hierarchy nodes.
+class RayPacket
+{
+public:
+	static const int Size = SimdFloat::Width;
+
+	SimdVector3 Origin, Direction;
+
+	inline Ray GetRay(int lane) const
+	{
+		Ray ray;
+		ray.Origin = Vector3(Origin.X[lane], Origin.Y[lane], Origin.Z[lane]);
+		ray.Direction = Vector3(Direction.X[lane], Direction.Y[lane], Direction.Z[lane]);
+		return ray;
+	}
+
+	inline void SetRay(int lane, const Ray& ray)
+	{
+		SetLane(Origin.X, lane, ray.Origin.X);
+		SetLane(Origin.Y, lane, ray.Origin.Y);
+		SetLane(Origin.Z, lane, ray.Origin.Z);
+		SetLane(Direction.X, lane, ray.Direction.X);
+		SetLane(Direction.Y, lane, ray.Direction.Y);
+		SetLane(Direction.Z, lane, ray.Direction.Z);
+	}
+
+private:
+	static inline void SetLane(SimdFloat& value, int lane, float laneValue)
+	{
+		float values[Size];
+		value.Store(values);
+		values[lane] = laneValue;
+		value = SimdFloat::Load(values);
+	}
+};
+
+
+#endif
@@ -0,0 +1,422 @@
+#include "RenderCheckpoint.h"
+#include "CacheStream.h"
+#include "Scene.h"
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <boost/align/aligned_allocator.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+
+
+namespace
+{
+	const char MAGIC[4] = { 'R', 'T', 'C', 'P' };
+	const boost::uint32_t VERSION = 1;
+	const int MS_PER_SECOND = 1000;
+
+	typedef std::vector< char, boost::alignment::aligned_allocator< char, CacheWriter::ALIGNMENT > > FileData_t;
+
+
+	class Header
+	{
+	public:
+		char Magic[4];
+		boost::uint32_t Version;
+		boost::int32_t Width, Height, TileCount;
+		boost::uint32_t EdgesFound;
+		boost::uint64_t SceneHash;
+	};
+
+
+	// the render settings which change the image, hashed with the scene
+	class SettingsRecord
+	{
+	public:
+		boost::int32_t MaxDepth, Antialiasing, Packets;
+		float ContributionThreshold, AntialiasingThreshold;
+	};
+
+
+	// 64 bit FNV-1a
+	boost::uint64_t Hash(const char* data, std::size_t size, boost::uint64_t hash = 14695981039346656037ULL)
+	{
+		for (std::size_t i=0; i<size; ++i)
+			hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+		return hash;
+	}
+
+
+	boost::uint64_t HashScene(const Scene& scene)
+	{
+		SettingsRecord settings = SettingsRecord();
+		settings.MaxDepth = scene.GetMaxDepth();
+		settings.Antialiasing = scene.GetAntialiasing();
+		settings.Packets = scene.GetPacketTracing();
+		settings.ContributionThreshold = scene.GetContributionThreshold();
+		settings.AntialiasingThreshold = scene.GetAntialiasingThreshold();
+
+		std::ostringstream stream(std::ios::out | std::ios::binary);
+		SceneCache::Save(stream, scene);
+		const std::string cache = stream.str();
+
+		return Hash(cache.data(), cache.size(), Hash(reinterpret_cast<const char*>(&settings), sizeof(settings)));
+	}
+
+
+	// the tiles with samples, as the file lists their pixels
+	std::size_t CountPixels(const TileScheduler::TileContainer_t& tiles, const std::vector< boost::uint8_t >& tileSamples)
+	{
+		std::size_t count = 0;
+		for (std::size_t i=0; i<tiles.size(); ++i)
+		{
+			if (tileSamples[i] > 0)
+				count += (std::size_t)tiles[i].Width * tiles[i].Height;
+		}
+		return count;
+	}
+}
+
+
+RenderCheckpoint::RenderCheckpoint(const std::string& fileName, int intervalSeconds, bool resume)
+	: fileName(fileName), interval(intervalSeconds * MS_PER_SECOND), resume(resume), width(0), height(0), sceneHash(0),
+	edgesFound(false), changed(false), stopping(false), complete(false)
+{
+}
+
+
+RenderCheckpoint::~RenderCheckpoint()
+{
+	StopWriter();
+}
+
+
+void RenderCheckpoint::Begin(const Scene& scene)
+{
+	StopWriter();
+
+	width = scene.GetCamera().GetWidth();
+	height = scene.GetCamera().GetHeight();
+	sceneHash = HashScene(scene);
+	tiles = scene.GetTiles();
+
+	const std::size_t pixelCount = (std::size_t)width * height;
+	tileSamples.assign(tiles.size(), 0);
+	red.assign(pixelCount, 0.0f);
+	green.assign(pixelCount, 0.0f);
+	blue.assign(pixelCount, 0.0f);
+	objectIndices.assign(pixelCount, -1);
+	edges.assign(pixelCount, 0);
+	edgesFound = false;
+
+	const Scene::ObjectContainer_t& sceneObjects = scene.GetObjects();
+	objects.resize(sceneObjects.size());
+	objectLookup.resize(sceneObjects.size());
+	for (std::size_t i=0; i<sceneObjects.size(); ++i)
+	{
+		objects[i] = sceneObjects[i].get();
+		objectLookup[i] = std::make_pair(objects[i], (boost::int32_t)i);
+	}
+	std::sort(objectLookup.begin(), objectLookup.end());
+
+	// only the first render resumes; any after it start over
+	if (resume)
+	{
+		resume = false;
+		Load();
+	}
+
+	changed = stopping = complete = false;
+	writer = boost::thread(boost::bind(&RenderCheckpoint::WriteLoop, this));
+}
+
+
+void RenderCheckpoint::Finish()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		complete = true;
+	}
+	StopWriter();
+
+	std::remove(fileName.c_str());
+}
+
+
+void RenderCheckpoint::StopWriter()
+{
+	if (!writer.joinable())
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		stopping = true;
+		wake.notify_all();
+	}
+	writer.join();
+}
+
+
+// Writes the checkpoint whenever the interval has passed with something changed, and once more on the
+// way out unless the render was completed. A checkpoint which cannot be written is reported and the
+// render carries on, as the last good one is still there
+void RenderCheckpoint::WriteLoop()
+{
+	typedef boost::chrono::steady_clock Clock_t;
+
+	boost::mutex::scoped_lock lock(mutex);
+	Clock_t::time_point next = Clock_t::now() + boost::chrono::milliseconds(interval);
+
+	while (true)
+	{
+		while (!stopping && Clock_t::now() < next)
+			wake.wait_until(lock, next);
+
+		if (changed && !complete)
+		{
+			std::string data = Encode();
+			changed = false;
+
+			lock.unlock();
+			try
+			{
+				WriteFile(data);
+			}
+			catch (const SDL::Exception& e)
+			{
+				printf("%s\n", e.GetMessage().c_str());
+			}
+			lock.lock();
+		}
+
+		if (stopping)
+			return;
+		next = Clock_t::now() + boost::chrono::milliseconds(interval);
+	}
+}
+
+
+// The header, the samples of every tile, then the colours and object indices of the pixels of each tile
+// with any, row by row in tile order, and the edge pixels as bits once they have been found
+std::string RenderCheckpoint::Encode() const
+{
+	const std::size_t pixelCount = CountPixels(tiles, tileSamples);
+	std::vector< float > tileRed, tileGreen, tileBlue;
+	std::vector< boost::int32_t > tileObjects;
+	tileRed.reserve(pixelCount);
+	tileGreen.reserve(pixelCount);
+	tileBlue.reserve(pixelCount);
+	tileObjects.reserve(pixelCount);
+
+	for (std::size_t i=0; i<tiles.size(); ++i)
+	{
+		if (tileSamples[i] == 0)
+			continue;
+
+		const Tile& tile = tiles[i];
+		for (int y=tile.Y; y<tile.Y + tile.Height; ++y)
+		{
+			std::size_t row = (std::size_t)y * width + tile.X;
+			tileRed.insert(tileRed.end(), red.begin() + row, red.begin() + row + tile.Width);
+			tileGreen.insert(tileGreen.end(), green.begin() + row, green.begin() + row + tile.Width);
+			tileBlue.insert(tileBlue.end(), blue.begin() + row, blue.begin() + row + tile.Width);
+			tileObjects.insert(tileObjects.end(), objectIndices.begin() + row, objectIndices.begin() + row + tile.Width);
+		}
+	}
+
+	std::vector< boost::uint8_t > edgeBits;
+	if (edgesFound)
+	{
+		edgeBits.resize((edges.size() + 7) / 8);
+		for (std::size_t i=0; i<edges.size(); ++i)
+		{
+			if (edges[i])
+				edgeBits[i / 8] |= (boost::uint8_t)(1 << (i % 8));
+		}
+	}
+
+	Header header = Header();
+	std::copy(MAGIC, MAGIC + 4, header.Magic);
+	header.Version = VERSION;
+	header.Width = width;
+	header.Height = height;
+	header.TileCount = (boost::int32_t)tiles.size();
+	header.EdgesFound = edgesFound;
+	header.SceneHash = sceneHash;
+
+	std::ostringstream stream(std::ios::out | std::ios::binary);
+	CacheWriter writer(stream);
+	writer.Write(header);
+	writer.WriteArray(tileSamples);
+	writer.WriteArray(tileRed);
+	writer.WriteArray(tileGreen);
+	writer.WriteArray(tileBlue);
+	writer.WriteArray(tileObjects);
+	writer.WriteArray(edgeBits);
+	return stream.str();
+}
+
+
+void RenderCheckpoint::WriteFile(const std::string& data) const
+{
+	const std::string partName = fileName + ".part";
+	{
+		std::ofstream file(partName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.write(data.data(), data.size()) || !file.flush())
+			throw SDL::Exception("Could not write checkpoint " + partName);
+	}
+
+#if defined(_WIN32)
+	// rename does not replace an existing file on Windows
+	std::remove(fileName.c_str());
+#endif
+	if (std::rename(partName.c_str(), fileName.c_str()) != 0)
+		throw SDL::Exception("Could not replace checkpoint " + fileName);
+}
+
+
+void RenderCheckpoint::Load()
+{
+	std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		throw SDL::Exception("No checkpoint to resume from in " + fileName);
+
+	// read whole into aligned memory, as CacheReader expects of its arrays
+	FileData_t data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const char* begin = data.empty() ? NULL : &data[0];
+	CacheReader reader(begin, begin + data.size(), fileName);
+
+	Header header = reader.Read<Header>();
+	if (!std::equal(MAGIC, MAGIC + 4, header.Magic))
+		throw reader.Error("Not a render checkpoint");
+	if (header.Version != VERSION)
+		throw reader.Error("Checkpoint was written by a different build");
+	if (header.Width != width || header.Height != height || header.TileCount != (boost::int32_t)tiles.size() || header.SceneHash != sceneHash)
+		throw reader.Error("Checkpoint is of a different scene, size or settings");
+
+	std::size_t count;
+	const boost::uint8_t* samples = reader.ReadArray< boost::uint8_t >(count);
+	if (count != tiles.size())
+		throw reader.Error("Checkpoint has the wrong number of tiles");
+	tileSamples.assign(samples, samples + count);
+
+	const std::size_t pixelCount = CountPixels(tiles, tileSamples);
+	std::size_t redCount, greenCount, blueCount, objectCount, edgeCount;
+	const float* tileRed = reader.ReadArray< float >(redCount);
+	const float* tileGreen = reader.ReadArray< float >(greenCount);
+	const float* tileBlue = reader.ReadArray< float >(blueCount);
+	const boost::int32_t* tileObjects = reader.ReadArray< boost::int32_t >(objectCount);
+	const boost::uint8_t* edgeBits = reader.ReadArray< boost::uint8_t >(edgeCount);
+	if (redCount != pixelCount || greenCount != pixelCount || blueCount != pixelCount || objectCount != pixelCount)
+		throw reader.Error("Checkpoint has the wrong number of pixels");
+	if (edgeCount != (header.EdgesFound ? (edges.size() + 7) / 8 : 0))
+		throw reader.Error("Checkpoint has the wrong number of edge pixels");
+
+	std::size_t pixel = 0;
+	for (std::size_t i=0; i<tiles.size(); ++i)
+	{
+		if (tileSamples[i] == 0)
+			continue;
+
+		const Tile& tile = tiles[i];
+		for (int y=tile.Y; y<tile.Y + tile.Height; ++y)
+		{
+			std::size_t row = (std::size_t)y * width + tile.X;
+			std::copy(tileRed + pixel, tileRed + pixel + tile.Width, red.begin() + row);
+			std::copy(tileGreen + pixel, tileGreen + pixel + tile.Width, green.begin() + row);
+			std::copy(tileBlue + pixel, tileBlue + pixel + tile.Width, blue.begin() + row);
+			for (int x=0; x<tile.Width; ++x)
+			{
+				boost::int32_t index = tileObjects[pixel + x];
+				if (index < -1 || index >= (boost::int32_t)objects.size())
+					throw reader.Error("Checkpoint refers to an object the scene does not have");
+				objectIndices[row + x] = index;
+			}
+			pixel += tile.Width;
+		}
+	}
+
+	edgesFound = header.EdgesFound != 0;
+	for (std::size_t i=0; i<edgeCount * 8 && i<edges.size(); ++i)
+		edges[i] = (edgeBits[i / 8] >> (i % 8)) & 1;
+}
+
+
+boost::int32_t RenderCheckpoint::GetObjectIndex(const Object* object) const
+{
+	if (!object)
+		return -1;
+
+	std::vector< std::pair< const Object*, boost::int32_t > >::const_iterator it =
+		std::lower_bound(objectLookup.begin(), objectLookup.end(), std::make_pair(object, (boost::int32_t)-1));
+	if (it == objectLookup.end() || it->first != object)
+		throw SDL::Exception("A pixel hit an object the scene does not list");
+	return it->second;
+}
+
+
+void RenderCheckpoint::SaveTile(std::size_t tile, int samples, const AccumulationBuffer& accumulation, const std::vector< const Object* >& pixelObjects)
+{
+	const Tile& area = tiles[tile];
+
+	// the lookups are done before taking the lock, which the writer may hold while it copies everything
+	std::vector< boost::int32_t > indices;
+	indices.reserve((std::size_t)area.Width * area.Height);
+	for (int y=area.Y; y<area.Y + area.Height; ++y)
+	{
+		for (int x=area.X; x<area.X + area.Width; ++x)
+			indices.push_back(GetObjectIndex(pixelObjects[(std::size_t)y * width + x]));
+	}
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	std::vector< boost::int32_t >::const_iterator index = indices.begin();
+	for (int y=area.Y; y<area.Y + area.Height; ++y)
+	{
+		for (int x=area.X; x<area.X + area.Width; ++x, ++index)
+		{
+			std::size_t pixel = (std::size_t)y * width + x;
+			Vector3 colour = accumulation.GetPixel(x, y);
+			red[pixel] = colour.X;
+			green[pixel] = colour.Y;
+			blue[pixel] = colour.Z;
+			objectIndices[pixel] = *index;
+		}
+	}
+
+	tileSamples[tile] = (boost::uint8_t)samples;
+	changed = true;
+}
+
+
+void RenderCheckpoint::SaveEdges(const std::vector< boost::uint8_t >& edgePixels)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	edges = edgePixels;
+	edgesFound = true;
+	changed = true;
+}
+
+
+void RenderCheckpoint::RestoreTile(std::size_t tile, AccumulationBuffer& accumulation, std::vector< const Object* >& pixelObjects) const
+{
+	const Tile& area = tiles[tile];
+	for (int y=area.Y; y<area.Y + area.Height; ++y)
+	{
+		for (int x=area.X; x<area.X + area.Width; ++x)
+		{
+			std::size_t pixel = (std::size_t)y * width + x;
+			accumulation.SetPixel(x, y, Vector3(red[pixel], green[pixel], blue[pixel]));
+			pixelObjects[pixel] = objectIndices[pixel] < 0 ? NULL : objects[objectIndices[pixel]];
+		}
+	}
+}
+
+
+void RenderCheckpoint::RestoreEdges(std::vector< boost::uint8_t >& edgePixels) const
+{
+	edgePixels = edges;
+}
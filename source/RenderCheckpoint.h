@@ -0,0 +1,94 @@
+#ifndef RENDERCHECKPOINT_H
+#define RENDERCHECKPOINT_H
+
+#include "AccumulationBuffer.h"
+#include "TileScheduler.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class Object;
+class Scene;
+
+
+// A render's progress, saved to a file every so often so that a long render which is stopped can carry
+// on from where it was. It holds the samples each tile's pixels have had (none, the first ray, or the
+// antialiasing grid on its edges), the colours and primary objects of the tiles with any, and the edge
+// pixels once they have been found. The file is written by a thread of its own from a copy taken under
+// a lock, so the render threads only ever wait for a copy in memory, never for the disk; it is written
+// beside the real one and renamed over it, so it is always a complete checkpoint.
+//
+// A checkpoint only resumes the render of the scene and settings it was made with, which it checks by
+// a hash of the scene as a scene cache. Scene::Render drives it; see Scene::SetCheckpoint.
+class RenderCheckpoint
+{
+private:
+	std::string fileName;
+	int interval;
+	bool resume;
+
+	// the copy of the render's progress, in frame layout
+	int width, height;
+	boost::uint64_t sceneHash;
+	TileScheduler::TileContainer_t tiles;
+	std::vector< boost::uint8_t > tileSamples;
+	std::vector< float > red, green, blue;
+	std::vector< boost::int32_t > objectIndices;
+	std::vector< boost::uint8_t > edges;
+	bool edgesFound;
+	// the scene's objects, to store pixels' objects by index, sorted by address for looking them up
+	std::vector< const Object* > objects;
+	std::vector< std::pair< const Object*, boost::int32_t > > objectLookup;
+
+	boost::mutex mutex;
+	boost::condition_variable wake;
+	boost::thread writer;
+	// changed since the file was last written; stopping ends the writer, and complete drops the changes
+	bool changed, stopping, complete;
+
+	void Load();
+	std::string Encode() const;
+	void WriteFile(const std::string& data) const;
+	void WriteLoop();
+	void StopWriter();
+	boost::int32_t GetObjectIndex(const Object* object) const;
+
+	RenderCheckpoint(const RenderCheckpoint&);
+	RenderCheckpoint& operator= (const RenderCheckpoint&);
+
+public:
+	// Checkpoints go to fileName every intervalSeconds while something has changed. With resume the
+	// first render carries on from the checkpoint already in the file, and throws if there is none
+	RenderCheckpoint(const std::string& fileName, int intervalSeconds, bool resume);
+	// writes any progress since the last checkpoint, unless the render was completed
+	~RenderCheckpoint();
+
+	// Starts checkpointing a render of the scene, loading the file first if resuming. Throws if the
+	// file is not a checkpoint of this scene with its current settings
+	void Begin(const Scene& scene);
+	// the frame is done, so the file is no longer needed and is removed
+	void Finish();
+
+	// the samples per edge pixel the tile has had, as Scene::GetAntialiasing counts them, or 0 if it
+	// has not been traced
+	inline int GetTileSamples(std::size_t tile) const { return tileSamples[tile]; }
+	inline bool HasEdges() const { return edgesFound; }
+
+	// Copies a tile into the checkpoint once it has had the samples given. Safe to call from any
+	// number of render threads at once, for different tiles
+	void SaveTile(std::size_t tile, int samples, const AccumulationBuffer& accumulation, const std::vector< const Object* >& pixelObjects);
+	// the edge pixels of the whole frame, once all of them have been found
+	void SaveEdges(const std::vector< boost::uint8_t >& edgePixels);
+
+	// puts a tile the checkpoint holds back into the render
+	void RestoreTile(std::size_t tile, AccumulationBuffer& accumulation, std::vector< const Object* >& pixelObjects) const;
+	void RestoreEdges(std::vector< boost::uint8_t >& edgePixels) const;
+};
+
+
+#endif
@@ -0,0 +1,324 @@
+#include "RenderConnection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <boost/array.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/thread/thread.hpp>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+
+const char RenderConnection::MAGIC[4] = { 'R', 'T', 'D', 'W' };
+const boost::uint32_t RenderConnection::VERSION;
+const boost::uint32_t RenderConnection::BYTE_ORDER_MARK;
+const boost::uint64_t RenderConnection::ANY_SIZE;
+
+
+namespace
+{
+	typedef boost::asio::generic::stream_protocol::endpoint Endpoint_t;
+
+	// a scene cache can be large, but anything claiming to be bigger than this is not a message
+	const boost::uint64_t MAX_MESSAGE_SIZE = (boost::uint64_t)1 << 36;
+	// a batch is a few tiles for each of a worker's threads
+	const boost::uint64_t MAX_TILES_SIZE = (boost::uint64_t)1 << 24;
+	const std::size_t MAX_ERROR_SIZE = 4096;
+	const int CONNECT_RETRY_MS = 200;
+
+
+	class MessageHeader
+	{
+	public:
+		boost::uint32_t Type, Reserved;
+		boost::uint64_t Size;
+	};
+
+
+	// completion handler for the asynchronous operations, which are only used to get timeouts
+	void StoreResult(boost::system::error_code& result, const boost::system::error_code& error)
+	{
+		result = error;
+	}
+
+
+	inline bool IsUnixAddress(const std::string& address)
+	{
+		return address.compare(0, 5, "unix:") == 0;
+	}
+
+
+	Endpoint_t ParseAddress(boost::asio::io_context& io, const std::string& address)
+	{
+		if (IsUnixAddress(address))
+		{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+			return boost::asio::local::stream_protocol::endpoint(address.substr(5));
+#else
+			throw SDL::Exception("Unix sockets are not supported on this system: " + address);
+#endif
+		}
+
+		std::string::size_type colon = address.rfind(':');
+		if (colon == std::string::npos)
+			throw SDL::Exception("Addresses are HOST:PORT or unix:PATH, not " + address);
+
+		std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+		if (host.size() > 1 && host[0] == '[' && host[host.size() - 1] == ']')
+			host = host.substr(1, host.size() - 2);
+		if (host.empty())
+			host = "127.0.0.1";
+
+		boost::asio::ip::tcp::resolver resolver(io);
+		boost::system::error_code error;
+		boost::asio::ip::tcp::resolver::results_type results = resolver.resolve(host, port, error);
+		if (error || results.empty())
+			throw SDL::Exception("Could not resolve " + address + ": " + error.message());
+
+		return results.begin()->endpoint();
+	}
+
+
+	// Removes a socket file left at path by an earlier run, which would stop the bind. Anything else
+	// there is more likely a mistyped address than an old socket, so it is left alone
+	void RemoveStaleSocket(const std::string& path, const std::string& address)
+	{
+#if !defined(_WIN32)
+		struct stat status;
+		if (lstat(path.c_str(), &status) != 0)
+			return;
+		if (!S_ISSOCK(status.st_mode))
+			throw SDL::Exception("Could not listen on " + address + ": there is a file which is not a socket there");
+
+		std::remove(path.c_str());
+#endif
+	}
+}
+
+
+RenderConnection::RenderConnection()
+	: socket(io), timeout(0), introduced(false)
+{
+}
+
+
+void RenderConnection::Connect(const std::string& address, int retrySeconds)
+{
+	typedef boost::chrono::steady_clock Clock_t;
+	Clock_t::time_point giveUp = Clock_t::now() + boost::chrono::seconds(retrySeconds);
+
+	Endpoint_t endpoint = ParseAddress(io, address);
+	while (true)
+	{
+		boost::system::error_code error;
+		socket.connect(endpoint, error);
+		if (!error)
+			return;
+
+		socket.close();
+		if (Clock_t::now() >= giveUp)
+			throw SDL::Exception("Could not connect to " + address + ": " + error.message());
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(CONNECT_RETRY_MS));
+	}
+}
+
+
+void RenderConnection::Close()
+{
+	boost::system::error_code ignored;
+	socket.close(ignored);
+}
+
+
+// Runs the operation just started until it finishes, or closes the socket if the timeout passes first
+void RenderConnection::Wait(const char* what)
+{
+	io.restart();
+	if (timeout > 0)
+		io.run_for(std::chrono::milliseconds(timeout));
+	else
+		io.run();
+
+	if (!io.stopped())
+	{
+		// closing the socket makes the operation finish, cancelled
+		Close();
+		io.run();
+		throw SDL::Exception(std::string("Timed out ") + what);
+	}
+}
+
+
+void RenderConnection::Send(RENDER_MESSAGE type, const void* header, std::size_t headerSize, const void* body, std::size_t bodySize)
+{
+	// a worker's HELLO, or the SCENE a coordinator only sends once it has checked one
+	if (type == MESSAGE_HELLO || type == MESSAGE_SCENE)
+		introduced = true;
+
+	MessageHeader message = MessageHeader();
+	message.Type = type;
+	message.Size = headerSize + bodySize;
+
+	boost::array<boost::asio::const_buffer, 3> buffers = {{
+		boost::asio::buffer(&message, sizeof(message)),
+		boost::asio::buffer(header, headerSize),
+		boost::asio::buffer(body, bodySize)
+	}};
+
+	boost::system::error_code result;
+	boost::asio::async_write(socket, buffers, boost::bind(&StoreResult, boost::ref(result), boost::asio::placeholders::error));
+	Wait("sending");
+
+	if (result)
+		throw SDL::Exception("Connection lost: " + result.message());
+}
+
+
+RENDER_MESSAGE RenderConnection::Receive(Payload_t& payload, boost::uint64_t expectedSize)
+{
+	MessageHeader message;
+	boost::system::error_code result;
+	boost::asio::async_read(socket, boost::asio::buffer(&message, sizeof(message)), boost::bind(&StoreResult, boost::ref(result), boost::asio::placeholders::error));
+	Wait("receiving");
+
+	if (result)
+		throw SDL::Exception("Connection lost: " + result.message());
+	if (message.Type > MESSAGE_ERROR)
+		throw SDL::Exception("Received something which is not a message");
+	if (message.Size > GetSizeLimit((RENDER_MESSAGE)message.Type))
+		throw SDL::Exception("Received a message too large for its type");
+	if (expectedSize != ANY_SIZE && message.Type != MESSAGE_ERROR && message.Size != expectedSize)
+		throw SDL::Exception("Received a message of the wrong size");
+
+	payload.resize((std::size_t)message.Size);
+	if (!payload.empty())
+	{
+		boost::asio::async_read(socket, boost::asio::buffer(payload), boost::bind(&StoreResult, boost::ref(result), boost::asio::placeholders::error));
+		Wait("receiving");
+
+		if (result)
+			throw SDL::Exception("Connection lost: " + result.message());
+	}
+
+	return (RENDER_MESSAGE)message.Type;
+}
+
+
+// The most a message of the type can hold, checked before anything is allocated for it, so that
+// whoever reaches the port cannot have it allocate much. Only messages which follow the handshake
+// may be large
+boost::uint64_t RenderConnection::GetSizeLimit(RENDER_MESSAGE type) const
+{
+	switch (type)
+	{
+	case MESSAGE_HELLO:
+		return sizeof(HelloRecord);
+	case MESSAGE_READY:
+	case MESSAGE_DONE:
+		return 0;
+	case MESSAGE_ERROR:
+		return MAX_ERROR_SIZE;
+	case MESSAGE_TILES:
+		return introduced ? MAX_TILES_SIZE : 0;
+	case MESSAGE_SCENE:
+	case MESSAGE_PIXELS:
+		return introduced ? MAX_MESSAGE_SIZE : 0;
+	}
+	return 0;
+}
+
+
+void RenderConnection::Expect(RENDER_MESSAGE type, Payload_t& payload, boost::uint64_t expectedSize)
+{
+	RENDER_MESSAGE received = Receive(payload, expectedSize);
+	if (received == MESSAGE_ERROR)
+		throw SDL::Exception(std::string(payload.begin(), payload.end()));
+	if (received != type)
+		throw SDL::Exception("Received a message out of turn");
+}
+
+
+void RenderConnection::SendError(const std::string& message)
+{
+	try
+	{
+		Send(MESSAGE_ERROR, message.data(), std::min(message.size(), MAX_ERROR_SIZE));
+	}
+	catch (const SDL::Exception&)
+	{
+	}
+}
+
+
+RenderListener::RenderListener(const std::string& address)
+	: acceptor(io)
+{
+	Endpoint_t endpoint = ParseAddress(io, address);
+
+	if (IsUnixAddress(address))
+	{
+		RemoveStaleSocket(address.substr(5), address);
+		unixPath = address.substr(5);
+	}
+
+	boost::system::error_code error;
+	acceptor.open(endpoint.protocol(), error);
+	if (!error && unixPath.empty())
+		acceptor.set_option(boost::asio::socket_base::reuse_address(true), error);
+	if (!error)
+		acceptor.bind(endpoint, error);
+	if (!error)
+		acceptor.listen(boost::asio::socket_base::max_listen_connections, error);
+
+	if (error)
+		throw SDL::Exception("Could not listen on " + address + ": " + error.message());
+}
+
+
+RenderListener::~RenderListener()
+{
+	CloseAcceptor();
+	if (!unixPath.empty())
+		std::remove(unixPath.c_str());
+}
+
+
+bool RenderListener::Accept(RenderConnection& connection)
+{
+	boost::system::error_code result;
+	acceptor.async_accept(connection.socket, boost::bind(&StoreResult, boost::ref(result), boost::asio::placeholders::error));
+	io.restart();
+	io.run();
+
+	if (!acceptor.is_open())
+		return false;
+	if (result)
+		throw SDL::Exception("Could not accept a worker: " + result.message());
+	return true;
+}
+
+
+void RenderListener::Close()
+{
+	// run by Accept's thread, which owns the acceptor
+	boost::asio::post(io, boost::bind(&RenderListener::CloseAcceptor, this));
+}
+
+
+void RenderListener::CloseAcceptor()
+{
+	boost::system::error_code ignored;
+	acceptor.close(ignored);
+}
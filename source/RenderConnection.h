@@ -0,0 +1,129 @@
+#ifndef RENDERCONNECTION_H
+#define RENDERCONNECTION_H
+
+#include "SDL/Exception.h"
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
+
+
+// What a coordinator and its workers say to each other, in order:
+//
+//   worker       HELLO   HelloRecord
+//   coordinator  SCENE   SettingsRecord, then the scene as a scene cache
+//   worker       READY
+//   coordinator  TILES   frame number, tile count, then the index in Scene::GetTiles of each tile
+//   worker       PIXELS  the same frame number, count and indices, then each tile's pixels row by row
+//   ...                  TILES and PIXELS until the coordinator is done
+//   coordinator  DONE
+//
+// Either side may send ERROR, a message for the other to report, and then close the connection.
+enum RENDER_MESSAGE
+{
+	MESSAGE_HELLO,
+	MESSAGE_SCENE,
+	MESSAGE_READY,
+	MESSAGE_TILES,
+	MESSAGE_PIXELS,
+	MESSAGE_DONE,
+	MESSAGE_ERROR
+};
+
+
+class HelloRecord
+{
+public:
+	char Magic[4];
+	boost::uint32_t Version, ByteOrder;
+	// render threads the worker runs, which a batch of tiles should keep busy
+	boost::uint32_t Threads;
+};
+
+
+// the render settings the coordinator's scene was given, for the workers to use too
+class SettingsRecord
+{
+public:
+	boost::int32_t Width, Height;
+	boost::int32_t Packets, MaxDepth, Antialiasing;
+	float ContributionThreshold, AntialiasingThreshold;
+};
+
+
+// One end of a link between a coordinator and a worker, over TCP or a Unix socket. Messages are a type
+// and a length, followed by that many bytes; everything is sent in the byte order of the machines,
+// which the handshake checks agree. With a timeout set, a message which takes longer than that to send
+// or arrive closes the connection and throws, so a hung peer cannot hold things up for ever.
+class RenderConnection
+{
+public:
+	typedef std::vector<char> Payload_t;
+
+	static const boost::uint32_t VERSION = 1;
+	static const char MAGIC[4];
+	static const boost::uint32_t BYTE_ORDER_MARK = 0x01020304;
+	static const boost::uint64_t ANY_SIZE = ~(boost::uint64_t)0;
+
+private:
+	boost::asio::io_context io;
+	boost::asio::generic::stream_protocol::socket socket;
+	int timeout;
+	// whether this end has sent its part of the handshake, before which nothing large is accepted
+	bool introduced;
+
+	void Wait(const char* what);
+	boost::uint64_t GetSizeLimit(RENDER_MESSAGE type) const;
+
+	friend class RenderListener;
+
+public:
+	RenderConnection();
+
+	// Addresses are HOST:PORT for TCP, or unix:PATH for a Unix socket. Keeps trying for retrySeconds in
+	// case the coordinator is still starting
+	void Connect(const std::string& address, int retrySeconds);
+	// in milliseconds, 0 to wait as long as it takes
+	inline void SetTimeout(int milliseconds) { timeout = milliseconds; }
+	void Close();
+
+	// the message is the header followed by the body, either of which may be empty
+	void Send(RENDER_MESSAGE type, const void* header, std::size_t headerSize, const void* body = NULL, std::size_t bodySize = 0);
+	// Anything but an ERROR must be expectedSize bytes long when that is given, which is checked before
+	// anything is allocated for it
+	RENDER_MESSAGE Receive(Payload_t& payload, boost::uint64_t expectedSize = ANY_SIZE);
+	// receives a message which must be of the given type, throwing with the text of an ERROR instead
+	void Expect(RENDER_MESSAGE type, Payload_t& payload, boost::uint64_t expectedSize = ANY_SIZE);
+	// sends ERROR, ignoring any failure as the connection is given up on anyway
+	void SendError(const std::string& message);
+};
+
+
+// Listens for workers on an address, as RenderConnection::Connect takes them. A HOST:PORT with no host
+// listens on loopback only; as workers are not authenticated, taking them from other machines needs
+// the address of an interface given explicitly
+class RenderListener
+{
+private:
+	boost::asio::io_context io;
+	boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> acceptor;
+	// the socket file, removed again when done
+	std::string unixPath;
+
+	void CloseAcceptor();
+
+public:
+	explicit RenderListener(const std::string& address);
+	~RenderListener();
+
+	// Waits for a worker to connect. Returns false once Close has been called
+	bool Accept(RenderConnection& connection);
+	// can be called from any thread, and wakes Accept
+	void Close();
+};
+
+
+#endif
@@ -0,0 +1,299 @@
+#include "RenderCoordinator.h"
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+
+
+namespace
+{
+	// a batch keeps every one of a worker's threads busy, and is no bigger than this
+	const std::size_t MAX_BATCH_TILES = 64;
+	const int MS_PER_SECOND = 1000;
+}
+
+
+RenderCoordinator::RenderCoordinator(Scene& scene, const std::string& address, int timeoutSeconds)
+	: scene(scene), timeout(timeoutSeconds * MS_PER_SECOND), listener(address), workerCount(0), stopping(false), frame(0), tilesLeft(0)
+{
+	const Camera& camera = scene.GetCamera();
+	SettingsRecord settings = SettingsRecord();
+	settings.Width = camera.GetWidth();
+	settings.Height = camera.GetHeight();
+	settings.Packets = scene.GetPacketTracing();
+	settings.MaxDepth = scene.GetMaxDepth();
+	settings.Antialiasing = scene.GetAntialiasing();
+	settings.ContributionThreshold = scene.GetContributionThreshold();
+	settings.AntialiasingThreshold = scene.GetAntialiasingThreshold();
+
+	// the scene is made into a cache once, however many workers it goes to
+	std::ostringstream stream(std::ios::out | std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(&settings), sizeof(settings));
+	SceneCache::Save(stream, scene);
+	sceneMessage = stream.str();
+
+	acceptThread = boost::thread(boost::bind(&RenderCoordinator::AcceptWorkers, this));
+}
+
+
+RenderCoordinator::~RenderCoordinator()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		stopping = true;
+		changed.notify_all();
+	}
+
+	listener.Close();
+	acceptThread.join();
+	workerThreads.join_all();
+}
+
+
+void RenderCoordinator::WaitForWorkers(int count)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	while (workerCount < count)
+		changed.wait(lock);
+}
+
+
+void RenderCoordinator::Render()
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	++frame;
+	const std::size_t tileCount = scene.GetTiles().size();
+	queue.clear();
+	for (std::size_t i=0; i<tileCount; ++i)
+		queue.push_back((boost::uint32_t)i);
+	states.assign(tileCount, TILE_WAITING);
+	copies.assign(tileCount, 0);
+	tilesLeft = tileCount;
+	changed.notify_all();
+
+	while (tilesLeft > 0)
+	{
+		if (workerCount > 0)
+		{
+			changed.wait(lock);
+			continue;
+		}
+
+		// the tiles wait for a worker to join, but not for ever
+		boost::chrono::steady_clock::time_point giveUp = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout);
+		while (workerCount == 0 && tilesLeft > 0)
+		{
+			if (changed.wait_until(lock, giveUp) == boost::cv_status::timeout && workerCount == 0)
+				throw SDL::Exception("No workers left to render with");
+		}
+	}
+}
+
+
+void RenderCoordinator::AcceptWorkers()
+{
+	for (int number=1; ; ++number)
+	{
+		boost::shared_ptr<RenderConnection> connection(new RenderConnection());
+		try
+		{
+			if (!listener.Accept(*connection))
+				return;
+		}
+		catch (const SDL::Exception& e)
+		{
+			printf("%s\n", e.GetMessage().c_str());
+			continue;
+		}
+
+		workerThreads.create_thread(boost::bind(&RenderCoordinator::ServeWorker, this, connection, number));
+	}
+}
+
+
+// Talks to one worker for as long as it is connected. Whatever goes wrong with it, only its own tiles
+// are affected, and they go back to the others
+void RenderCoordinator::ServeWorker(boost::shared_ptr<RenderConnection> connection, int number)
+{
+	std::vector<boost::uint32_t> batch;
+	boost::uint32_t batchFrame = 0;
+	bool ready = false;
+
+	try
+	{
+		connection->SetTimeout(timeout);
+
+		RenderConnection::Payload_t payload;
+		connection->Expect(MESSAGE_HELLO, payload);
+
+		HelloRecord hello;
+		if (payload.size() != sizeof(hello))
+			throw SDL::Exception("Not a render worker");
+		std::memcpy(&hello, &payload[0], sizeof(hello));
+		if (!std::equal(RenderConnection::MAGIC, RenderConnection::MAGIC + 4, hello.Magic))
+			throw SDL::Exception("Not a render worker");
+		if (hello.Version != RenderConnection::VERSION || hello.ByteOrder != RenderConnection::BYTE_ORDER_MARK)
+		{
+			connection->SendError("The coordinator is a different build; use the same one for both");
+			throw SDL::Exception("Worker is a different build");
+		}
+
+		connection->Send(MESSAGE_SCENE, sceneMessage.data(), sceneMessage.size());
+		connection->Expect(MESSAGE_READY, payload);
+
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			++workerCount;
+			ready = true;
+			changed.notify_all();
+		}
+		printf("worker %d ready with %u threads\n", number, hello.Threads);
+
+		const TileScheduler::TileContainer_t& tiles = scene.GetTiles();
+		std::vector<boost::uint32_t> header;
+
+		while (TakeBatch(batch, batchFrame, std::max(1u, hello.Threads)))
+		{
+			header.clear();
+			header.push_back(batchFrame);
+			header.push_back((boost::uint32_t)batch.size());
+			header.insert(header.end(), batch.begin(), batch.end());
+			const std::size_t headerSize = header.size() * sizeof(boost::uint32_t);
+			connection->Send(MESSAGE_TILES, &header[0], headerSize);
+
+			std::size_t pixelCount = 0;
+			for (std::size_t i=0; i<batch.size(); ++i)
+				pixelCount += (std::size_t)tiles[batch[i]].Width * tiles[batch[i]].Height;
+
+			// the answer starts with the request, so one meant for anything else shows up here
+			connection->Expect(MESSAGE_PIXELS, payload, headerSize + pixelCount * sizeof(boost::uint32_t));
+			if (std::memcmp(&payload[0], &header[0], headerSize) != 0)
+				throw SDL::Exception("Worker sent pixels for different tiles");
+
+			FinishBatch(batch, batchFrame, payload, headerSize);
+			batch.clear();
+		}
+
+		connection->Send(MESSAGE_DONE, NULL, 0);
+	}
+	catch (const SDL::Exception& e)
+	{
+		printf("worker %d dropped: %s\n", number, e.GetMessage().c_str());
+	}
+	catch (const std::exception& e)
+	{
+		printf("worker %d dropped: %s\n", number, e.what());
+	}
+
+	// the thread keeps the connection until the coordinator is done, so it is closed now
+	connection->Close();
+	ReturnBatch(batch, batchFrame);
+
+	boost::mutex::scoped_lock lock(mutex);
+	if (ready)
+		--workerCount;
+	changed.notify_all();
+}
+
+
+// Waits for tiles for a worker: ones nobody has yet, or once there are none of those, copies of ones
+// just one other worker has. Returns false once the coordinator is finished with the workers
+bool RenderCoordinator::TakeBatch(std::vector<boost::uint32_t>& batch, boost::uint32_t& batchFrame, unsigned int threads)
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	while (!stopping)
+	{
+		batchFrame = frame;
+
+		// large batches while there is plenty left, then smaller ones so the workers finish together
+		if (!queue.empty())
+		{
+			std::size_t size = std::max<std::size_t>(threads, queue.size() / (2 * std::max(workerCount, 1)));
+			size = std::min(std::min(size, MAX_BATCH_TILES), queue.size());
+
+			for (std::size_t i=0; i<size; ++i)
+			{
+				boost::uint32_t tile = queue.front();
+				queue.pop_front();
+				states[tile] = TILE_TRACING;
+				copies[tile] = 1;
+				batch.push_back(tile);
+			}
+			return true;
+		}
+
+		for (std::size_t tile=0; tile<states.size() && batch.size() < threads; ++tile)
+		{
+			if (states[tile] == TILE_TRACING && copies[tile] == 1)
+			{
+				++copies[tile];
+				batch.push_back((boost::uint32_t)tile);
+			}
+		}
+		if (!batch.empty())
+			return true;
+
+		changed.wait(lock);
+	}
+
+	return false;
+}
+
+
+// Copies the pixels of the batch's tiles into the frame buffer, unless another worker got there first
+void RenderCoordinator::FinishBatch(const std::vector<boost::uint32_t>& batch, boost::uint32_t batchFrame, const RenderConnection::Payload_t& pixels, std::size_t offset)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if (batchFrame != frame)
+		return;
+
+	const TileScheduler::TileContainer_t& tiles = scene.GetTiles();
+	const SDL::SurfacePtr& frameBuffer = scene.GetFrameBuffer();
+	const boost::uint32_t* tilePixels = reinterpret_cast<const boost::uint32_t*>(&pixels[offset]);
+
+	frameBuffer->Lock();
+	for (std::size_t i=0; i<batch.size(); ++i)
+	{
+		const Tile& tile = tiles[batch[i]];
+		if (states[batch[i]] != TILE_DONE)
+		{
+			for (int y=0; y<tile.Height; ++y)
+				frameBuffer->WritePixels(tile.X, tile.Y + y, tile.Width, tilePixels + y * tile.Width);
+
+			states[batch[i]] = TILE_DONE;
+			--tilesLeft;
+		}
+		tilePixels += tile.Width * tile.Height;
+	}
+	frameBuffer->Unlock();
+
+	changed.notify_all();
+}
+
+
+// Gives back the tiles of a batch which will not be finished, so other workers can take them
+void RenderCoordinator::ReturnBatch(const std::vector<boost::uint32_t>& batch, boost::uint32_t batchFrame)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if (batchFrame != frame)
+		return;
+
+	// to the front of the queue, in their order, as they have waited longest
+	for (std::size_t i=batch.size(); i-- > 0; )
+	{
+		boost::uint32_t tile = batch[i];
+		if (states[tile] == TILE_TRACING && --copies[tile] == 0)
+		{
+			states[tile] = TILE_WAITING;
+			queue.push_front(tile);
+		}
+	}
+
+	changed.notify_all();
+}
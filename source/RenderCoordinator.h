@@ -0,0 +1,79 @@
+#ifndef RENDERCOORDINATOR_H
+#define RENDERCOORDINATOR_H
+
+#include "Scene.h"
+#include "RenderConnection.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+
+// Renders a scene on worker processes, which may be on other machines. The coordinator sends each
+// worker that connects the scene, as a scene cache, and its render settings, then hands out batches
+// of tiles for it to trace and copies the pixels it sends back into the scene's frame buffer. Workers
+// can join at any time, and start taking tiles as soon as they have loaded the scene.
+//
+// A worker which drops its connection, or takes longer than the timeout to answer, loses its batch to
+// the others. Once no tiles are left to hand out, workers with nothing to do are also given copies of
+// tiles another worker still has, so a slow worker does not hold up the end of a frame; whichever
+// answers first is used.
+class RenderCoordinator
+{
+private:
+	enum TILE_STATE
+	{
+		TILE_WAITING,
+		TILE_TRACING,
+		TILE_DONE
+	};
+
+	Scene& scene;
+	int timeout;
+	// everything after the header of the SCENE message, the same for every worker
+	std::string sceneMessage;
+
+	RenderListener listener;
+	boost::thread acceptThread;
+	boost::thread_group workerThreads;
+
+	boost::mutex mutex;
+	boost::condition_variable changed;
+	int workerCount;
+	bool stopping;
+
+	// The frame being rendered, counted from 1 so workers' answers for an earlier one can be told
+	// apart, and its tiles. Tiles waiting are queued; ones being traced count the workers tracing them
+	boost::uint32_t frame;
+	std::deque<boost::uint32_t> queue;
+	std::vector<boost::uint8_t> states;
+	std::vector<int> copies;
+	std::size_t tilesLeft;
+
+	void AcceptWorkers();
+	void ServeWorker(boost::shared_ptr<RenderConnection> connection, int number);
+	bool TakeBatch(std::vector<boost::uint32_t>& batch, boost::uint32_t& batchFrame, unsigned int threads);
+	void FinishBatch(const std::vector<boost::uint32_t>& batch, boost::uint32_t batchFrame, const RenderConnection::Payload_t& pixels, std::size_t offset);
+	void ReturnBatch(const std::vector<boost::uint32_t>& batch, boost::uint32_t batchFrame);
+
+public:
+	// Listens for workers on address, as RenderListener takes it. timeoutSeconds is how long a worker
+	// may take over any one message, such as loading the scene or tracing a batch
+	RenderCoordinator(Scene& scene, const std::string& address, int timeoutSeconds);
+	~RenderCoordinator();
+
+	// blocks until count workers are ready to trace
+	void WaitForWorkers(int count);
+	// Renders the scene as it was when the coordinator was made, which is what the workers have,
+	// blocking until every tile is in its frame buffer. Throws if there are no workers for longer than
+	// the timeout
+	void Render();
+};
+
+
+#endif
@@ -0,0 +1,37 @@
+
+
+#ifndef RENDERSTATISTICS_H
+#define RENDERSTATISTICS_H
+
+#include <boost/cstdint.hpp>
+
+
+// Counts of the rays traced for a frame. Each render thread keeps its own counts for the tile it is
+// working on, and they are merged once per tile so that counting costs nothing measurable.
+class RenderStatistics
+{
+public:
+	// AntialiasRays are the extra primary rays traced in edge pixels
+	boost::uint64_t PrimaryRays, ShadowRays, ReflectionRays, AntialiasRays;
+
+	inline RenderStatistics()
+		: PrimaryRays(0), ShadowRays(0), ReflectionRays(0), AntialiasRays(0)
+	{}
+
+	inline boost::uint64_t GetTotalRays() const
+	{
+		return PrimaryRays + ShadowRays + ReflectionRays + AntialiasRays;
+	}
+
+	inline RenderStatistics& operator += (const RenderStatistics& other)
+	{
+		PrimaryRays += other.PrimaryRays;
+		ShadowRays += other.ShadowRays;
+		ReflectionRays += other.ReflectionRays;
+		AntialiasRays += other.AntialiasRays;
+		return *this;
+	}
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+#include "RenderWorker.h"
+#include "Scene.h"
+#include "CacheStream.h"
+#include "SceneCache.h"
+#include "SDL/Surface.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <boost/align/aligned_allocator.hpp>
+#include <boost/make_shared.hpp>
+
+
+namespace
+{
+	// the coordinator may not be listening yet when its workers are started alongside it
+	const int CONNECT_RETRY_SECONDS = 10;
+
+	// the cache is read in place, so needs the alignment it has when mapped from a file
+	typedef std::vector<char, boost::alignment::aligned_allocator<char, CacheWriter::ALIGNMENT> > CacheMemory_t;
+}
+
+
+RenderWorker::RenderWorker(const std::string& address, unsigned int threadCount)
+	: address(address), threadCount(TileScheduler::ResolveThreadCount(threadCount))
+{
+}
+
+
+void RenderWorker::Run()
+{
+	connection.Connect(address, CONNECT_RETRY_SECONDS);
+
+	try
+	{
+		Serve();
+	}
+	catch (const SDL::Exception& e)
+	{
+		connection.SendError(e.GetMessage());
+		throw;
+	}
+}
+
+
+void RenderWorker::Serve()
+{
+	HelloRecord hello = HelloRecord();
+	std::memcpy(hello.Magic, RenderConnection::MAGIC, sizeof(hello.Magic));
+	hello.Version = RenderConnection::VERSION;
+	hello.ByteOrder = RenderConnection::BYTE_ORDER_MARK;
+	hello.Threads = threadCount;
+	connection.Send(MESSAGE_HELLO, &hello, sizeof(hello));
+
+	RenderConnection::Payload_t payload;
+	connection.Expect(MESSAGE_SCENE, payload);
+
+	SettingsRecord settings;
+	if (payload.size() < sizeof(settings))
+		throw SDL::Exception("Received a scene with no settings");
+	std::memcpy(&settings, &payload[0], sizeof(settings));
+	if (settings.Width < 1 || settings.Height < 1)
+		throw SDL::Exception("Received a scene with no frame");
+
+	boost::shared_ptr<CacheMemory_t> memory = boost::make_shared<CacheMemory_t>(payload.begin() + sizeof(settings), payload.end());
+	RenderConnection::Payload_t().swap(payload);
+
+	SDL::SurfacePtr frameBuffer = SDL::Surface::CreateRGBSurface(0, settings.Width, settings.Height, 32,
+		0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+	Scene scene(SDL::WindowPtr(), frameBuffer, threadCount);
+	scene.SetPacketTracing(settings.Packets != 0);
+	scene.SetMaxDepth(settings.MaxDepth);
+	scene.SetContributionThreshold(settings.ContributionThreshold);
+	scene.SetAntialiasing(settings.Antialiasing);
+	scene.SetAntialiasingThreshold(settings.AntialiasingThreshold);
+
+	const char* begin = memory->empty() ? NULL : &(*memory)[0];
+	SceneCache::Load(begin, begin + memory->size(), address, memory, scene);
+	scene.UpdateHierarchy();
+
+	connection.Send(MESSAGE_READY, NULL, 0);
+	printf("loaded %u objects from %s, tracing with %u threads\n", (unsigned int)scene.GetObjectCount(), address.c_str(), threadCount);
+
+	const TileScheduler::TileContainer_t& tiles = scene.GetTiles();
+	TileScheduler::TileContainer_t region;
+	std::vector<boost::uint32_t> pixels;
+
+	while (true)
+	{
+		RENDER_MESSAGE type = connection.Receive(payload);
+		if (type == MESSAGE_DONE)
+			return;
+		if (type == MESSAGE_ERROR)
+			throw SDL::Exception(std::string(payload.begin(), payload.end()));
+		if (type != MESSAGE_TILES)
+			throw SDL::Exception("Received a message out of turn");
+
+		// frame number and count, then the indices
+		const std::size_t wordCount = payload.size() / sizeof(boost::uint32_t);
+		std::vector<boost::uint32_t> header(wordCount);
+		if (wordCount > 0)
+			std::memcpy(&header[0], &payload[0], wordCount * sizeof(boost::uint32_t));
+		if (wordCount < 2 || payload.size() != wordCount * sizeof(boost::uint32_t) || header[1] != wordCount - 2)
+			throw SDL::Exception("Received a malformed batch of tiles");
+
+		region.clear();
+		std::size_t pixelCount = 0;
+		for (std::size_t i=2; i<wordCount; ++i)
+		{
+			if (header[i] >= tiles.size())
+				throw SDL::Exception("Received a tile outside the frame");
+			region.push_back(tiles[header[i]]);
+			pixelCount += (std::size_t)region.back().Width * region.back().Height;
+		}
+
+		scene.RenderTiles(region);
+
+		pixels.resize(pixelCount);
+		boost::uint32_t* tilePixels = pixels.empty() ? NULL : &pixels[0];
+		frameBuffer->Lock();
+		for (std::size_t i=0; i<region.size(); ++i)
+		{
+			const Tile& tile = region[i];
+			for (int y=0; y<tile.Height; ++y)
+				frameBuffer->ReadPixels(tile.X, tile.Y + y, tile.Width, tilePixels + y * tile.Width);
+			tilePixels += tile.Width * tile.Height;
+		}
+		frameBuffer->Unlock();
+
+		connection.Send(MESSAGE_PIXELS, &payload[0], payload.size(), pixels.empty() ? NULL : &pixels[0], pixels.size() * sizeof(boost::uint32_t));
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef RENDERWORKER_H
+#define RENDERWORKER_H
+
+#include "RenderConnection.h"
+
+#include <string>
+
+
+// The other end of a RenderCoordinator: connects to it, loads the scene it sends and traces the tiles
+// it is given until it says it is done. The worker needs no scene of its own, but must be the same
+// build as the coordinator, as the scene arrives as a scene cache
+class RenderWorker
+{
+private:
+	std::string address;
+	unsigned int threadCount;
+	RenderConnection connection;
+
+	void Serve();
+
+public:
+	// threadCount of 0 uses one render thread per hardware thread
+	RenderWorker(const std::string& address, unsigned int threadCount);
+
+	// Blocks until the coordinator is done with the worker. Throws if the connection is lost or the
+	// coordinator reports an error, telling the coordinator what went wrong if it can
+	void Run();
+};
+
+
+#endif
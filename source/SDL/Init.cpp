@@ -5,13 +5,17 @@
 using namespace SDL;
 
 InitPtr Init::Create() {
-	return InitPtr(new Init());
+	return InitPtr(new Init(SDL_INIT_VIDEO));
 }
 
-Init::Init()
+InitPtr Init::Create(boost::uint32_t flags) {
+	return InitPtr(new Init(flags));
+}
+
+Init::Init(boost::uint32_t flags)
 {
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
-		throw Exception("Could not initialise video subsystem");
+	if (SDL_Init(flags) < 0)
+		throw Exception((flags & SDL_INIT_VIDEO) ? "Could not initialise video subsystem" : "Could not initialise SDL");
 		
 #ifdef USE_SDL_NET
 	if (SDLNet_Init() < 0)
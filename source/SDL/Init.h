@@ -13,11 +13,19 @@ namespace SDL
 	class Init
 	{
 	private:
-		Init();
+		Init(boost::uint32_t flags);
 	public:
 		~Init();
 		
 		static InitPtr Create();
+		
+		/// <summary>
+		/// Initialises only the given subsystems. Passing 0 initialises the core library without video,
+		/// which is enough for software surfaces on machines with no display.
+		/// </summary>
+		/// <param name="flags">SDL_INIT_* flags of the subsystems to initialise</param>
+		/// <returns>Init pointer, SDL is shut down when it is released</returns>
+		static InitPtr Create(boost::uint32_t flags);
 	};
 }
 
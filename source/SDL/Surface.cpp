@@ -1,6 +1,13 @@
 
 #include "Surface.h"
 #include <cassert>
+#include <cstring>
+
+// the span conversions use SSE2 where the compiler targets it, and plain loops otherwise
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SDLPP_SSE2
+#include <emmintrin.h>
+#endif
 
 
 using namespace SDL;
@@ -95,9 +102,193 @@ void Surface::PutPixel(int x, int y, const Color& color)
 	assert(lockCount > 0);
 
 	int bpp = pixelFormat.GetBytesPerPixel();
-	boost::uint32_t pixel = pixelFormat.ColorToUInt32(color);
 	boost::uint8_t* position = (boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+	StorePixel(position, bpp, pixelFormat.ColorToUInt32(color));
+}
+
+
+Color Surface::GetPixel(int x, int y)
+{
+	assert(lockCount > 0);
+
+	int bpp = pixelFormat.GetBytesPerPixel();
+	boost::uint8_t* position = (boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+	return pixelFormat.Int32ToColor(LoadPixel(position, bpp));
+}
+
+
+namespace
+{
+	// float channel to 8 bits the way the SSE2 kernels do it: truncated, with the same NaN handling
+	// as minps/maxps
+	inline boost::uint32_t FloatToChannel(float value)
+	{
+		value *= 255.0f;
+		value = value < 255.0f ? value : 255.0f;
+		value = value > 0.0f ? value : 0.0f;
+		return (boost::uint32_t)value;
+	}
+}
+
+
+bool Surface::HasPacked32BitPixels() const
+{
+	return pixelFormat.GetBytesPerPixel() == 4 &&
+		pixelFormat.GetRedLoss() == 0 && pixelFormat.GetGreenLoss() == 0 && pixelFormat.GetBlueLoss() == 0;
+}
+
+
+void Surface::WritePixels(int x, int y, int count, const boost::uint32_t* pixels)
+{
+	assert(lockCount > 0);
+
+	int bpp = pixelFormat.GetBytesPerPixel();
+	boost::uint8_t* position = (boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+
+	if (bpp == 4)
+	{
+		memcpy(position, pixels, count * sizeof(boost::uint32_t));
+		return;
+	}
+
+	for (int i=0; i<count; ++i, position+=bpp)
+		StorePixel(position, bpp, pixels[i]);
+}
+
+
+void Surface::ReadPixels(int x, int y, int count, boost::uint32_t* pixels) const
+{
+	assert(lockCount > 0);
+
+	int bpp = pixelFormat.GetBytesPerPixel();
+	const boost::uint8_t* position = (const boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+
+	if (bpp == 4)
+	{
+		memcpy(pixels, position, count * sizeof(boost::uint32_t));
+		return;
+	}
+
+	for (int i=0; i<count; ++i, position+=bpp)
+		pixels[i] = LoadPixel(position, bpp);
+}
+
+
+void Surface::WritePixels(int x, int y, int count, const float* red, const float* green, const float* blue)
+{
+	assert(lockCount > 0);
+
+	if (!HasPacked32BitPixels())
+	{
+		for (int i=0; i<count; ++i)
+			PutPixel(x + i, y, Color(FloatToChannel(red[i]), FloatToChannel(green[i]), FloatToChannel(blue[i]), 255));
+		return;
+	}
+
+	const int redShift = pixelFormat.GetRedShift(), greenShift = pixelFormat.GetGreenShift(), blueShift = pixelFormat.GetBlueShift();
+	const boost::uint32_t alpha = pixelFormat.GetAlphaMask();
+	boost::uint32_t* out = (boost::uint32_t*)((boost::uint8_t*)surface->pixels + y * surface->pitch) + x;
+	int i = 0;
+
+#if defined(SDLPP_SSE2)
+	const __m128 scale = _mm_set1_ps(255.0f), zero = _mm_setzero_ps();
+	const __m128i alphaBits = _mm_set1_epi32((int)alpha);
+	const __m128i redCount = _mm_cvtsi32_si128(redShift), greenCount = _mm_cvtsi32_si128(greenShift), blueCount = _mm_cvtsi32_si128(blueShift);
 
+	for (; i + 4 <= count; i+=4)
+	{
+		__m128i r = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(red + i), scale), scale), zero));
+		__m128i g = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(green + i), scale), scale), zero));
+		__m128i b = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(blue + i), scale), scale), zero));
+		__m128i pixel = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(r, redCount), _mm_sll_epi32(g, greenCount)), _mm_or_si128(_mm_sll_epi32(b, blueCount), alphaBits));
+		_mm_storeu_si128((__m128i*)(out + i), pixel);
+	}
+#endif
+
+	for (; i<count; ++i)
+		out[i] = FloatToChannel(red[i]) << redShift | FloatToChannel(green[i]) << greenShift | FloatToChannel(blue[i]) << blueShift | alpha;
+}
+
+
+void Surface::ReadPixels(int x, int y, int count, float* red, float* green, float* blue) const
+{
+	assert(lockCount > 0);
+
+	const float scale = 1.0f / 255.0f;
+
+	if (!HasPacked32BitPixels())
+	{
+		int bpp = pixelFormat.GetBytesPerPixel();
+		const boost::uint8_t* position = (const boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+		for (int i=0; i<count; ++i, position+=bpp)
+		{
+			Color colour = pixelFormat.Int32ToColor(LoadPixel(position, bpp));
+			red[i] = colour.R * scale;
+			green[i] = colour.G * scale;
+			blue[i] = colour.B * scale;
+		}
+		return;
+	}
+
+	const int redShift = pixelFormat.GetRedShift(), greenShift = pixelFormat.GetGreenShift(), blueShift = pixelFormat.GetBlueShift();
+	const boost::uint32_t* in = (const boost::uint32_t*)((const boost::uint8_t*)surface->pixels + y * surface->pitch) + x;
+	int i = 0;
+
+#if defined(SDLPP_SSE2)
+	const __m128 channelScale = _mm_set1_ps(scale);
+	const __m128i channelMask = _mm_set1_epi32(0xff);
+	const __m128i redCount = _mm_cvtsi32_si128(redShift), greenCount = _mm_cvtsi32_si128(greenShift), blueCount = _mm_cvtsi32_si128(blueShift);
+
+	for (; i + 4 <= count; i+=4)
+	{
+		__m128i pixel = _mm_loadu_si128((const __m128i*)(in + i));
+		_mm_storeu_ps(red + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixel, redCount), channelMask)), channelScale));
+		_mm_storeu_ps(green + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixel, greenCount), channelMask)), channelScale));
+		_mm_storeu_ps(blue + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixel, blueCount), channelMask)), channelScale));
+	}
+#endif
+
+	for (; i<count; ++i)
+	{
+		red[i] = ((in[i] >> redShift) & 0xff) * scale;
+		green[i] = ((in[i] >> greenShift) & 0xff) * scale;
+		blue[i] = ((in[i] >> blueShift) & 0xff) * scale;
+	}
+}
+
+
+void Surface::ReadRGB(int x, int y, int count, boost::uint8_t* rgb) const
+{
+	assert(lockCount > 0);
+
+	int bpp = pixelFormat.GetBytesPerPixel();
+	const boost::uint8_t* position = (const boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
+
+	if (!HasPacked32BitPixels())
+	{
+		for (int i=0; i<count; ++i, position+=bpp)
+		{
+			Color colour = pixelFormat.Int32ToColor(LoadPixel(position, bpp));
+			*rgb++ = colour.R;
+			*rgb++ = colour.G;
+			*rgb++ = colour.B;
+		}
+		return;
+	}
+
+	const int redShift = pixelFormat.GetRedShift(), greenShift = pixelFormat.GetGreenShift(), blueShift = pixelFormat.GetBlueShift();
+	const boost::uint32_t* in = (const boost::uint32_t*)position;
+	for (int i=0; i<count; ++i)
+	{
+		*rgb++ = (boost::uint8_t)(in[i] >> redShift);
+		*rgb++ = (boost::uint8_t)(in[i] >> greenShift);
+		*rgb++ = (boost::uint8_t)(in[i] >> blueShift);
+	}
+}
+
+
+void Surface::StorePixel(boost::uint8_t* position, int bpp, boost::uint32_t pixel)
+{
 	switch (bpp)
 	{
 	case 1:
@@ -130,36 +321,28 @@ void Surface::PutPixel(int x, int y, const Color& color)
 }
 
 
-Color Surface::GetPixel(int x, int y)
+boost::uint32_t Surface::LoadPixel(const boost::uint8_t* position, int bpp)
 {
-	assert(lockCount > 0);
-
-  int bpp = pixelFormat.GetBytesPerPixel();
-	boost::uint32_t colorInt;
-  boost::uint8_t* position = (boost::uint8_t*)surface->pixels + y * surface->pitch + x * bpp;
-
-  switch (bpp)
+	switch (bpp)
 	{
-  case 1:
-    colorInt = *position;
+	case 1:
+		return *position;
 
-  case 2:
-		colorInt = *(boost::uint16_t*)position;
+	case 2:
+		return *(const boost::uint16_t*)position;
 
-  case 3:
+	case 3:
 		if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
-			colorInt = position[0] << 16 | position[1] << 8 | position[2];
+			return position[0] << 16 | position[1] << 8 | position[2];
 		else
-			colorInt = position[0] | position[1] << 8 | position[2] << 16;
+			return position[0] | position[1] << 8 | position[2] << 16;
 
-  case 4:
-    colorInt = *(boost::uint32_t*)position;
-
-  default:
-		colorInt = 0;
-  }
+	case 4:
+		return *(const boost::uint32_t*)position;
 
-	return pixelFormat.Int32ToColor(colorInt);
+	default:
+		return 0;
+	}
 }
 
 
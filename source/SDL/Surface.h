@@ -35,6 +35,10 @@ namespace SDL
 		Surface();
 		Surface(SDL_Surface* surface, bool needsFree);
 		Surface(SDL_Surface* surface, bool needsFree, boost::uint8_t* pixelData);
+
+		bool HasPacked32BitPixels() const;
+		static void StorePixel(boost::uint8_t* position, int bpp, boost::uint32_t pixel);
+		static boost::uint32_t LoadPixel(const boost::uint8_t* position, int bpp);
 		
 	public:
 		/// <summary>
@@ -124,6 +128,46 @@ namespace SDL
 		/// <returns>Pixel colour</returns>
 		Color GetPixel(int x, int y);
 
+		/// <summary>
+		/// Writes a horizontal span of pixels that are already in the surface's pixel format, as made by
+		/// PixelFormat::ColorToUInt32. 32 bit surfaces are written with a straight copy. Surface must be locked beforehand.
+		/// </summary>
+		/// <param name="x">X position of the first pixel</param>
+		/// <param name="y">Y position</param>
+		/// <param name="count">Number of pixels, which must all lie on the surface</param>
+		/// <param name="pixels">Pixel values</param>
+		void WritePixels(int x, int y, int count, const boost::uint32_t* pixels);
+
+		/// <summary>
+		/// Reads a horizontal span of pixels in the surface's pixel format. Surface must be locked beforehand.
+		/// </summary>
+		void ReadPixels(int x, int y, int count, boost::uint32_t* pixels) const;
+
+		/// <summary>
+		/// Writes a horizontal span of pixels from one array of floats per channel, where 0 to 1 maps to 0 to 255.
+		/// Values are scaled, clamped and truncated to 8 bits, and the pixels are written opaque. Surfaces with
+		/// 8 bits per channel in 32 bit pixels (ARGB, RGBA, ABGR and so on) are converted with SIMD, four pixels
+		/// at a time. Surface must be locked beforehand.
+		/// </summary>
+		/// <param name="x">X position of the first pixel</param>
+		/// <param name="y">Y position</param>
+		/// <param name="count">Number of pixels, which must all lie on the surface</param>
+		/// <param name="red">Red channel</param>
+		/// <param name="green">Green channel</param>
+		/// <param name="blue">Blue channel</param>
+		void WritePixels(int x, int y, int count, const float* red, const float* green, const float* blue);
+
+		/// <summary>
+		/// Reads a horizontal span of pixels into one array of floats per channel, 0 to 1. Surface must be locked beforehand.
+		/// </summary>
+		void ReadPixels(int x, int y, int count, float* red, float* green, float* blue) const;
+
+		/// <summary>
+		/// Reads a horizontal span of pixels as 8 bit red, green, blue triples. Surface must be locked beforehand.
+		/// </summary>
+		/// <param name="rgb">Receives count * 3 bytes</param>
+		void ReadRGB(int x, int y, int count, boost::uint8_t* rgb) const;
+
 		/// <summary>
 		/// Fills a rectangle with the specified colour
 		/// </summary>
@@ -29,6 +29,18 @@ void Window::UpdateSurface()
 	SDL_UpdateWindowSurface(mWindow);
 }
 
+void Window::UpdateSurfaceRects(const std::vector<Rect>& rects)
+{
+	if (rects.empty())
+		return;
+
+	std::vector<SDL_Rect> sdlRects(rects.size());
+	for (std::size_t i=0; i<rects.size(); ++i)
+		rects[i].Convert(sdlRects[i]);
+
+	SDL_UpdateWindowSurfaceRects(mWindow, &sdlRects[0], (int)sdlRects.size());
+}
+
 void Window::ToggleFullscreen()
 {
 	if (SDL_SetWindowFullscreen(mWindow, mIsFullScreen ? 0 : SDL_WINDOW_FULLSCREEN) == 0) {
@@ -128,6 +140,17 @@ void Window::WaitForEvent()
 }
 
 
+bool Window::WaitForEvent(int timeoutMs)
+{
+	// SDL gives no way to tell a timeout from an error here
+	SDL_Event event;
+	if (SDL_WaitEventTimeout(&event, timeoutMs) == 0)
+		return false;
+	CallEvents(&event);
+	return true;
+}
+
+
 void Window::PushEvent(const UserEvent& event)
 {
 	SDL_Event sdlEvent;
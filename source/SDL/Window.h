@@ -6,6 +6,7 @@
 #include "Surface.h"
 #include "Event.h"
 #include <string>
+#include <vector>
 
 
 namespace SDL
@@ -43,6 +44,12 @@ namespace SDL
 
 		void UpdateSurface();
 
+		/// <summary>
+		/// Copies only parts of the window surface to the screen, for when little of it has changed.
+		/// </summary>
+		/// <param name="rects">Areas of the surface to copy</param>
+		void UpdateSurfaceRects(const std::vector<Rect>& rects);
+
 		/// <summary>
 		/// Toggles fullscreen mode
 		/// </summary>
@@ -73,6 +80,13 @@ namespace SDL
 		/// Waits indefinitely for the next available event.
 		/// </summary>
 		void WaitForEvent();
+
+		/// <summary>
+		/// Waits until the next available event, or until the timeout runs out.
+		/// </summary>
+		/// <param name="timeoutMs">Longest time to wait, in milliseconds.</param>
+		/// <returns>true if an event was handled, false if the wait timed out.</returns>
+		bool WaitForEvent(int timeoutMs);
 		
 		/// <summary>
 		/// Pushes an event onto the event queue.
@@ -4,14 +4,34 @@
 #include "SDL/Color.h"
 #include "Sphere.h"
 #include "Plane.h"
+#include "Triangle.h"
+#include "RenderCheckpoint.h"
 #include "SDL/Window.h"
 #include <boost/bind/bind.hpp>
 
 using namespace boost::placeholders;
 
-const int RAYTRACE_RECURSION_LIMIT = 6;
+// segments in a ray's path, counting the primary ray
+const int DEFAULT_MAX_DEPTH = 6;
+// reflections are no longer followed once they could change the colour by less than half of an 8 bit step
+const float DEFAULT_CONTRIBUTION_THRESHOLD = 0.5f / 255.0f;
 const float EPSILON = 0.01f;
 const float DISTANCE_LIMIT = 20000.0f;
+const int TILE_SIZE = 32;
+// pixels covered by one ray packet
+const int PACKET_HEIGHT = 2;
+const int PACKET_WIDTH = RayPacket::Size / PACKET_HEIGHT;
+// smallest part a tile that took far longer than the others is split into, a whole number of packets
+const int SPLIT_SIZE = 8;
+// pixels between the rays of the first progressive pass; each pass after halves it
+const int PROGRESSIVE_BLOCK_SIZE = 8;
+// a hierarchy is rebuilt once refitting moved objects has made it this many times more costly to trace
+const float HIERARCHY_REBUILD_THRESHOLD = 1.5f;
+// antialiasing is off by default. The threshold is the difference in any channel between neighbouring
+// pixels, after clamping to the displayable range, that counts as an edge
+const int DEFAULT_ANTIALIAS_SAMPLES = 1;
+const int MAX_ANTIALIAS_SAMPLES = 64;
+const float DEFAULT_ANTIALIAS_THRESHOLD = 0.1f;
 
 
 inline Vector3 ColourToVector( const SDL::Color& colour )
@@ -23,44 +43,32 @@ inline Vector3 ColourToVector( const SDL::Color& colour )
 }
 
 
-inline SDL::Color VectorToColour( const Vector3& vec )
+Scene::Scene(SDL::WindowPtr window, SDL::SurfacePtr frameBuffer, unsigned int threadCount)
+	: window(window), frameBuffer(frameBuffer), accumulation(frameBuffer->GetWidth(), frameBuffer->GetHeight()), camera(frameBuffer->GetWidth(), frameBuffer->GetHeight()), scheduler(threadCount)
 {
-	int red = (int)(vec.X * 255.0f);
-	int green = (int)(vec.Y * 255.0f);
-	int blue = (int)(vec.Z * 255.0f);
-	if (red > 255) red = 255;
-	if (green > 255) green = 255;
-	if (blue > 255) blue = 255;
-	return SDL::Color( red, green, blue );
-}
-
-
-Scene::Scene(SDL::WindowPtr window, SDL::SurfacePtr frameBuffer)
-	: window(window), frameBuffer(frameBuffer)
-{
-	shadowson = specularon = true;
-	GenerateDirectionTable();
-
-	window->KeyUp.connect( boost::bind( &Scene::OnKeyUp, this,  _1 ) );
-}
-
+	shadowson = specularon = packetson = true;
+	maxDepth = DEFAULT_MAX_DEPTH;
+	contributionThreshold = DEFAULT_CONTRIBUTION_THRESHOLD;
+	SetAntialiasing( DEFAULT_ANTIALIAS_SAMPLES );
+	antialiasThreshold = DEFAULT_ANTIALIAS_THRESHOLD;
+	hierarchyDirty = true;
+	progressiveBlock = 0;
+	antialiasPass = false;
+	renderPending = false;
+	frameValid = false;
+	pixelObjects.resize( (std::size_t)frameBuffer->GetWidth() * frameBuffer->GetHeight() );
+	edgePixels.resize( pixelObjects.size() );
+	tiles = TileScheduler::SplitIntoTiles(frameBuffer->GetWidth(), frameBuffer->GetHeight(), TILE_SIZE);
+	tilesAcross = ( frameBuffer->GetWidth() + TILE_SIZE - 1 ) / TILE_SIZE;
+	tileObjects.resize( tiles.size() );
+	dirtyTiles.resize( tiles.size() );
+	borderTiles.resize( tiles.size() );
+	SetPixelOrder( ORDER_ROWS );
+	SetTileSplitting( true );
 
-void Scene::GenerateDirectionTable()
-{
-	directionTable.resize(frameBuffer->GetWidth());
-
-	for(int x=0; x<frameBuffer->GetWidth(); x++)
-	{
-		directionTable[x].resize(frameBuffer->GetHeight());
-
-		for(int y=0; y<frameBuffer->GetHeight(); y++)
-		{
-			directionTable[x][y].X = (float)x - (float)(frameBuffer->GetWidth())/2.0f;
-			directionTable[x][y].Y = -((float)y - (float)(frameBuffer->GetHeight())/2.0f);
-			directionTable[x][y].Z = 10000.0f; // this value is fairly arbitrary and can basically be interpreted as field of view
-			directionTable[x][y].Normalize();
-		}
-	}
+	// there is no window when rendering headless
+	if ( window )
+		window->KeyUp.connect( boost::bind( &Scene::OnKeyUp, this,  _1 ) );
 }
 
 
@@ -69,9 +77,14 @@ void Scene::OnKeyUp(const SDL::KeyboardEvent& event)
 	switch (event.GetKey())
 	{
 	case SDLK_u:
-		Render();
+		StartRender();
+		break;
+	case SDLK_p:
+		packetson = !packetson;
+		StartRender();
 		break;
 	case SDLK_q:
+		CancelRender();
 		exit(0);
 		break;
 	}
@@ -80,7 +93,10 @@ void Scene::OnKeyUp(const SDL::KeyboardEvent& event)
 
 void Scene::AddObject(ObjectPtr_t object)
 {
+	InterruptRender();
 	objects.push_back(object);
+	hierarchyDirty = true;
+	MarkDirty(object.get());
 }
 
 
@@ -88,13 +104,162 @@ void Scene::RemoveObject(ObjectPtr_t object)
 {
 	ObjectContainer_t::iterator it = std::find(objects.begin(), objects.end(), object);
 	if (it != objects.end())
+	{
+		InterruptRender();
 		objects.erase(it);
+		hierarchyDirty = true;
+		MarkDirty(object.get());
+	}
+}
+
+
+void Scene::UpdateObject(ObjectPtr_t object)
+{
+	InterruptRender();
+	movedObjects.push_back(object.get());
+	MarkDirty(object.get());
+}
+
+
+// Marks the tiles an edit to object can change: those whose rays met it in the last render, and those
+// it covers now. With the frame already out of date everything is traced again anyway
+void Scene::MarkDirty(const Object* object)
+{
+	renderPending = true;
+
+	if ( !frameValid )
+		return;
+
+	for ( std::size_t i=0; i<tiles.size(); ++i )
+	{
+		if ( std::binary_search( tileObjects[i].begin(), tileObjects[i].end(), object ) )
+			dirtyTiles[i] = 1;
+	}
+
+	// the screen rectangle the object's bounds project to. Objects without bounds, or reaching behind
+	// the camera, could be anywhere on screen
+	BoundingBox bounds = object->GetBounds();
+	BoundingBox screen;
+	bool visible = bounds.IsFinite();
+	for ( int corner=0; corner<8 && visible; ++corner )
+	{
+		Vector3 point( corner & 1 ? bounds.Max.X : bounds.Min.X, corner & 2 ? bounds.Max.Y : bounds.Min.Y, corner & 4 ? bounds.Max.Z : bounds.Min.Z );
+		float x, y;
+		visible = camera.Project( point, x, y );
+		screen.Expand( Vector3( x, y, 0.0f ) );
+	}
+
+	if ( !visible )
+	{
+		std::fill( dirtyTiles.begin(), dirtyTiles.end(), 1 );
+		return;
+	}
+
+	// a pixel's ray is at its top left corner, so a pixel either side of the rectangle may see the object
+	const int width = accumulation.GetWidth(), height = accumulation.GetHeight();
+	if ( screen.Max.X < -1.0f || screen.Max.Y < -1.0f || screen.Min.X > width || screen.Min.Y > height )
+		return;
+
+	int left = std::max( 0, (int)screen.Min.X - 1 ) / TILE_SIZE;
+	int top = std::max( 0, (int)screen.Min.Y - 1 ) / TILE_SIZE;
+	int right = std::min( width - 1, (int)screen.Max.X + 1 ) / TILE_SIZE;
+	int bottom = std::min( height - 1, (int)screen.Max.Y + 1 ) / TILE_SIZE;
+
+	for ( int ty=top; ty<=bottom; ++ty )
+		for ( int tx=left; tx<=right; ++tx )
+			dirtyTiles[ty * tilesAcross + tx] = 1;
+}
+
+
+inline int Scene::GetTileIndex(const Tile& tile) const
+{
+	return ( tile.Y / TILE_SIZE ) * tilesAcross + tile.X / TILE_SIZE;
+}
+
+
+// Keeps the objects a tile's rays met, for MarkDirty. A pass which traced every pixel replaces the
+// list; one which only traced some of them adds to it
+void Scene::RecordTileObjects(const Tile& tile, ObjectList_t& touched, bool merge)
+{
+	std::sort( touched.begin(), touched.end() );
+	touched.erase( std::unique( touched.begin(), touched.end() ), touched.end() );
+
+	const int index = GetTileIndex( tile );
+	ObjectList_t& recorded = tileObjects[index];
+
+	// the other parts of a split tile may be recording theirs at the same time, so the parts add to
+	// the list under a lock; the pass cleared it before tracing them
+	boost::unique_lock<boost::mutex> lock( tileObjectsMutex, boost::defer_lock );
+	if ( tile.Width != tiles[index].Width || tile.Height != tiles[index].Height )
+	{
+		lock.lock();
+		merge = true;
+	}
+
+	if ( merge )
+	{
+		ObjectList_t both;
+		std::set_union( recorded.begin(), recorded.end(), touched.begin(), touched.end(), std::back_inserter( both ) );
+		recorded.swap( both );
+	}
+	else
+	{
+		recorded.swap( touched );
+	}
+}
+
+
+void Scene::BuildHierarchy()
+{
+	primitives.Clear();
+
+	ObjectContainer_t::const_iterator it = objects.begin();
+	ObjectContainer_t::const_iterator itEnd = objects.end();
+
+	// the last group takes any type, so every object finds a place
+	for (; it != itEnd; ++it)
+		primitives.Add( it->get() );
+
+	primitives.Build();
+	hierarchyDirty = false;
+	movedObjects.clear();
+}
+
+
+// Brings the hierarchies up to date before a render. Only adding or removing objects needs a full build;
+// objects that have moved are refitted in place, which costs in proportion to how many moved
+void Scene::UpdateHierarchy()
+{
+	if ( hierarchyDirty )
+	{
+		BuildHierarchy();
+		return;
+	}
+
+	if ( movedObjects.empty() )
+		return;
+
+	for ( std::size_t i=0; i<movedObjects.size(); ++i )
+		primitives.Update( movedObjects[i] );
+
+	primitives.Refit( HIERARCHY_REBUILD_THRESHOLD );
+	movedObjects.clear();
+}
+
+
+void Scene::SetCamera(const Camera& camera)
+{
+	InterruptRender();
+	this->camera = camera;
+	Invalidate();
 }
 
 
 void Scene::AddLight(LightPtr_t light)
 {
+	InterruptRender();
 	lights.push_back(light);
+	Invalidate();
 }
 
 
@@ -102,41 +267,690 @@ void Scene::RemoveLight(LightPtr_t light)
 {
 	LightContainer_t::iterator it = std::find(lights.begin(), lights.end(), light);
 	if (it != lights.end())
+	{
+		InterruptRender();
 		lights.erase(it);
+		Invalidate();
+	}
+}
+
+
+void Scene::UpdateLight(LightPtr_t light)
+{
+	InterruptRender();
+	Invalidate();
+}
+
+
+void Scene::Invalidate()
+{
+	frameValid = false;
+	renderPending = true;
 }
 
 
 void Scene::Render()
 {
-	frameBuffer->Fill(SDL::Color(128, 128, 128));
-	frameBuffer->Lock();
+	// the tiles cover the whole frame, so every pixel gets written and no clear is needed
+	passTiles = tiles;
+	if ( checkpoint )
+		RenderCheckpointed();
+	else
+		RenderPassTiles();
+}
+
+
+void Scene::RenderChanges()
+{
+	if ( !frameValid )
+	{
+		Render();
+		return;
+	}
+
+	FindDirtyTiles();
+	RenderPassTiles();
+}
+
+
+void Scene::RenderTiles( const TileScheduler::TileContainer_t& region )
+{
+	passTiles = region;
+	RenderPassTiles();
+
+	// the tiles left out may show the scene as it was, or nothing
+	frameValid = false;
+}
+
+
+// Traces passTiles at full resolution, blocking until they are done and written to the frame buffer
+void Scene::RenderPassTiles()
+{
+	CancelRender();
+
+	UpdateHierarchy();
+
+	statistics = RenderStatistics();
+
+	// what each tile took last frame picks out the ones to split, so is only kept for whole frames
+	bool whole = passTiles.size() == tiles.size();
+	if ( whole && scheduler.GetSplitSize() > 0 )
+	{
+		for ( std::size_t i=0; i<tileObjects.size(); ++i )
+			tileObjects[i].clear();
+	}
+
+	if ( packetson )
+		scheduler.Run( passTiles, boost::bind( &Scene::RenderTilePackets, this, _1, false ), whole ? &traceCosts : NULL );
+	else
+		scheduler.Run( passTiles, boost::bind( &Scene::RenderTile, this, _1, 1, false ), whole ? &traceCosts : NULL );
+
+	// the tiles around dirty ones are already up to date, but those around an arbitrary region may not be
+	if ( antialiasSide > 1 && !frameValid && passTiles.size() < tiles.size() )
+		TraceBorder();
+
+	if ( antialiasSide > 1 && FindEdges( passTiles ) )
+		scheduler.Run( passTiles, boost::bind( &Scene::AntialiasTile, this, _1 ), whole ? &antialiasCosts : NULL );
+
+	ResolvePassTiles();
+	FinishFrame();
+}
+
+
+// Renders the whole frame as RenderPassTiles does, except that the tiles the checkpoint holds are
+// restored instead of traced, and each tile is saved to it once traced. The edges are found only once
+// every tile has its first ray, and are kept, as antialiasing changes the colours they were found from
+void Scene::RenderCheckpointed()
+{
+	CancelRender();
+
+	UpdateHierarchy();
+
+	statistics = RenderStatistics();
+
+	checkpoint->Begin( *this );
+
+	TileScheduler::TileContainer_t untraced, unsmoothed;
+	bool restored = false;
+	for ( std::size_t i=0; i<tiles.size(); ++i )
+	{
+		int samples = checkpoint->GetTileSamples( i );
+		if ( samples > 0 )
+		{
+			checkpoint->RestoreTile( i, accumulation, pixelObjects );
+			restored = true;
+		}
+		else
+		{
+			untraced.push_back( tiles[i] );
+		}
+
+		if ( samples < antialiasSide * antialiasSide )
+			unsmoothed.push_back( tiles[i] );
+	}
+
+	scheduler.Run( untraced, boost::bind( &Scene::TraceCheckpointTile, this, _1 ) );
+
+	if ( antialiasSide > 1 )
+	{
+		bool edges = true;
+		if ( checkpoint->HasEdges() )
+		{
+			checkpoint->RestoreEdges( edgePixels );
+		}
+		else
+		{
+			edges = FindEdges( tiles );
+			checkpoint->SaveEdges( edgePixels );
+		}
+
+		if ( edges )
+			scheduler.Run( unsmoothed, boost::bind( &Scene::AntialiasCheckpointTile, this, _1 ) );
+	}
+
+	ResolvePassTiles();
+	checkpoint->Finish();
+	FinishFrame();
+
+	if ( restored )
+		frameValid = false;
+}
+
+
+void Scene::TraceCheckpointTile( const Tile& tile )
+{
+	if ( packetson )
+		RenderTilePackets( tile, false );
+	else
+		RenderTile( tile, 1, false );
+
+	checkpoint->SaveTile( GetTileIndex( tile ), 1, accumulation, pixelObjects );
+}
+
+
+void Scene::AntialiasCheckpointTile( const Tile& tile )
+{
+	AntialiasTile( tile );
+	checkpoint->SaveTile( GetTileIndex( tile ), antialiasSide * antialiasSide, accumulation, pixelObjects );
+}
+
+
+// Traces the pixels just outside passTiles, so FindEdges compares the pixels along the tiles' sides with
+// neighbours showing the scene as it is. Each row is a job of its own, so no pixel is traced twice
+void Scene::TraceBorder()
+{
+	std::fill( borderTiles.begin(), borderTiles.end(), 0 );
+	for ( std::size_t i=0; i<passTiles.size(); ++i )
+		borderTiles[GetTileIndex( passTiles[i] )] = 1;
+
+	TileScheduler::TileContainer_t rows;
+	for ( int y=0; y<accumulation.GetHeight(); ++y )
+		rows.push_back( Tile( 0, y, accumulation.GetWidth(), 1 ) );
+
+	scheduler.Run( rows, boost::bind( &Scene::TraceBorderRow, this, _1 ) );
+}
+
+
+// true if the pixel is in one of the tiles TraceBorder is tracing around
+inline bool Scene::IsBorderTile( int x, int y ) const
+{
+	return x >= 0 && y >= 0 && x < accumulation.GetWidth() && y < accumulation.GetHeight()
+		&& borderTiles[( y / TILE_SIZE ) * tilesAcross + x / TILE_SIZE];
+}
+
+
+void Scene::TraceBorderRow( const Tile& row )
+{
+	RenderStatistics rays;
+	ObjectList_t touched;
 
 	Ray ray;
-	ray.Origin.X = 0.0f;
-	ray.Origin.Y = 0.0f;
-	ray.Origin.Z = -16000.0f;
-
-	// calculate each pixel
-  for(int y=0; y<frameBuffer->GetHeight(); y++)
-  {
-		for(int x=0; x<frameBuffer->GetWidth(); x++)
+	ray.Origin = camera.GetPosition();
+
+	const int y = row.Y;
+	for ( int x=row.X; x<row.X + row.Width; ++x )
+	{
+		if ( IsBorderTile( x, y ) || !( IsBorderTile( x - 1, y ) || IsBorderTile( x + 1, y ) || IsBorderTile( x, y - 1 ) || IsBorderTile( x, y + 1 ) ) )
+			continue;
+
+		Vector3 colourvec;
+		ray.Direction = camera.GetDirection( (float)x, (float)y );
+		pixelObjects[y * accumulation.GetWidth() + x] = RayTrace( ray, colourvec, rays, touched );
+		accumulation.SetPixel( x, y, colourvec );
+		rays.PrimaryRays++;
+	}
+
+	boost::unique_lock<boost::mutex> lock( statisticsMutex );
+	statistics += rays;
+}
+
+
+void Scene::StartRender()
+{
+	CancelRender();
+
+	UpdateHierarchy();
+
+	statistics = RenderStatistics();
+	passTiles = tiles;
+	frameValid = false;
+	progressiveBlock = PROGRESSIVE_BLOCK_SIZE;
+	StartPass( false );
+}
+
+
+// Re-renders just the dirty tiles, straight at full resolution as they are usually few
+void Scene::StartUpdate()
+{
+	if ( !frameValid )
+	{
+		StartRender();
+		return;
+	}
+
+	CancelRender();
+
+	UpdateHierarchy();
+
+	statistics = RenderStatistics();
+	FindDirtyTiles();
+	if ( passTiles.empty() )
+		return;
+
+	progressiveBlock = 1;
+	StartPass( false );
+}
+
+
+void Scene::FindDirtyTiles()
+{
+	passTiles.clear();
+	for ( std::size_t i=0; i<tiles.size(); ++i )
+	{
+		if ( dirtyTiles[i] )
+			passTiles.push_back( tiles[i] );
+	}
+}
+
+
+// The frame buffer now shows the whole scene as it is
+void Scene::FinishFrame()
+{
+	frameValid = true;
+	std::fill( dirtyTiles.begin(), dirtyTiles.end(), 0 );
+}
+
+
+void Scene::ResolvePassTiles()
+{
+	if ( passTiles.size() == tiles.size() )
+	{
+		accumulation.Resolve( *frameBuffer );
+		return;
+	}
+
+	for ( std::size_t i=0; i<passTiles.size(); ++i )
+		accumulation.Resolve( *frameBuffer, passTiles[i].X, passTiles[i].Y, passTiles[i].Width, passTiles[i].Height );
+}
+
+
+// Shows the tiles just traced in the window, copying only those to the screen when they are not all of them
+void Scene::PresentPassTiles()
+{
+	ResolvePassTiles();
+
+	if ( !window )
+		return;
+
+	if ( passTiles.size() == tiles.size() )
+	{
+		window->UpdateSurface();
+		return;
+	}
+
+	std::vector< SDL::Rect > rects;
+	rects.reserve( passTiles.size() );
+	for ( std::size_t i=0; i<passTiles.size(); ++i )
+		rects.push_back( SDL::Rect( passTiles[i].X, passTiles[i].Y, passTiles[i].Width, passTiles[i].Height ) );
+	window->UpdateSurfaceRects( rects );
+}
+
+
+bool Scene::PollRender()
+{
+	if ( renderPending )
+	{
+		StartUpdate();
+		return false;
+	}
+
+	if ( progressiveBlock == 0 || !scheduler.IsFinished() )
+		return false;
+
+	// the pass is done, so this only collects any error from it
+	int finishedBlock = progressiveBlock;
+	bool finishedAntialiasing = antialiasPass;
+	progressiveBlock = 0;
+	antialiasPass = false;
+	scheduler.Wait();
+
+	PresentPassTiles();
+
+	if ( finishedBlock > 1 )
+	{
+		progressiveBlock = finishedBlock / 2;
+		StartPass( true );
+	}
+	else if ( !finishedAntialiasing && antialiasSide > 1 && FindEdges( passTiles ) )
+	{
+		// once every pixel has its first ray, the edges are supersampled as one last pass
+		progressiveBlock = 1;
+		antialiasPass = true;
+		scheduler.Start( passTiles, boost::bind( &Scene::AntialiasTile, this, _1 ) );
+	}
+	else
+	{
+		FinishFrame();
+	}
+
+	return true;
+}
+
+
+void Scene::CancelRender()
+{
+	renderPending = false;
+
+	if ( progressiveBlock != 0 )
+	{
+		progressiveBlock = 0;
+		antialiasPass = false;
+		scheduler.Cancel();
+	}
+}
+
+
+void Scene::InterruptRender()
+{
+	if ( progressiveBlock != 0 )
+	{
+		CancelRender();
+		renderPending = true;
+	}
+}
+
+
+// Each pass after the first only traces the pixels the previous ones did not, so the last pass leaves
+// exactly the image Render would
+void Scene::StartPass( bool refine )
+{
+	if ( progressiveBlock == 1 && packetson )
+		scheduler.Start( passTiles, boost::bind( &Scene::RenderTilePackets, this, _1, refine ) );
+	else
+		scheduler.Start( passTiles, boost::bind( &Scene::RenderTile, this, _1, progressiveBlock, refine ) );
+}
+
+
+// Traces the pixels of a tile that lie on a grid blockSize pixels apart, and fills the block below and to
+// the right of each with its colour. When refining, the pixels on the grid twice as coarse were traced by
+// the previous pass and are left alone. A block size of 1 traces every pixel.
+void Scene::RenderTile( const Tile& tile, int blockSize, bool refine )
+{
+	RenderStatistics rays;
+	ObjectList_t touched;
+
+	Ray ray;
+	ray.Origin = camera.GetPosition();
+
+	// calculate each pixel in the tile - tiles never overlap so no locking is needed to write them
+	for ( std::size_t i=0; i<pixelCells.size(); ++i )
+	{
+		const GridCell& cell = pixelCells[i];
+		if ( cell.X >= tile.Width || cell.Y >= tile.Height || cell.X % blockSize != 0 || cell.Y % blockSize != 0 )
+			continue;
+		if ( refine && cell.X % ( 2 * blockSize ) == 0 && cell.Y % ( 2 * blockSize ) == 0 )
+			continue;
+
+		const int x = tile.X + cell.X, y = tile.Y + cell.Y;
+		Vector3 colourvec;
+		ray.Direction = camera.GetDirection( (float)x, (float)y );
+
+		const Object* object = RayTrace( ray, colourvec, rays, touched );
+		rays.PrimaryRays++;
+
+		int blockRight = std::min( x + blockSize, tile.X + tile.Width );
+		int blockBottom = std::min( y + blockSize, tile.Y + tile.Height );
+		for ( int by=y; by<blockBottom; ++by )
+		{
+			for ( int bx=x; bx<blockRight; ++bx )
+			{
+				accumulation.SetPixel( bx, by, colourvec );
+				pixelObjects[by * accumulation.GetWidth() + bx] = object;
+			}
+		}
+	}
+
+	RecordTileObjects( tile, touched, refine );
+
+	boost::unique_lock<boost::mutex> lock( statisticsMutex );
+	statistics += rays;
+}
+
+
+// Traces the primary rays of a tile in packets of PACKET_WIDTH x PACKET_HEIGHT pixels. Only finding the
+// closest hit is done a packet at a time; shading, shadows and reflections diverge too quickly to gain
+// from it, so they are traced per ray from the hit as before. When refining, the pixels a 2 pixel
+// progressive pass traced are left alone.
+void Scene::RenderTilePackets( const Tile& tile, bool refine )
+{
+	RenderStatistics rays;
+	ObjectList_t touched;
+
+	Ray ray;
+	ray.Origin = camera.GetPosition();
+
+	RayPacket packet;
+	packet.Origin = SimdVector3( ray.Origin );
+
+	// pixel offsets of each lane within the packet
+	float laneX[RayPacket::Size], laneY[RayPacket::Size];
+	for ( int lane=0; lane<RayPacket::Size; ++lane )
+	{
+		laneX[lane] = (float)( lane % PACKET_WIDTH );
+		laneY[lane] = (float)( lane / PACKET_WIDTH );
+	}
+	const SimdFloat packetX = SimdFloat::Load( laneX ), packetY = SimdFloat::Load( laneY );
+
+	for ( std::size_t i=0; i<packetCells.size(); ++i )
+	{
+		if ( packetCells[i].X >= tile.Width || packetCells[i].Y >= tile.Height )
+			continue;
+
+		const int x = tile.X + packetCells[i].X, y = tile.Y + packetCells[i].Y;
+		int lanes = 0;
+
+		// lanes past the edge of the tile, or already traced, are traced as dummy rays and ignored
+		for ( int lane=0; lane<RayPacket::Size; ++lane )
+		{
+			int px = x + lane % PACKET_WIDTH;
+			int py = y + lane / PACKET_WIDTH;
+			bool traced = refine && ( px - tile.X ) % 2 == 0 && ( py - tile.Y ) % 2 == 0;
+			if ( px < tile.X + tile.Width && py < tile.Y + tile.Height && !traced )
+				lanes |= 1 << lane;
+		}
+
+		packet.Direction = camera.GetDirections( packetX + SimdFloat( (float)x ), packetY + SimdFloat( (float)y ) );
+
+		Vector3 colours[RayPacket::Size];
+		const Object* objects[RayPacket::Size];
+		TracePacket( packet, lanes, colours, objects, rays, touched );
+
+		for ( int lane=0; lane<RayPacket::Size; ++lane )
+		{
+			if ( ( lanes & ( 1 << lane ) ) == 0 )
+				continue;
+
+			rays.PrimaryRays++;
+
+			int px = x + lane % PACKET_WIDTH;
+			int py = y + lane / PACKET_WIDTH;
+			accumulation.SetPixel( px, py, colours[lane] );
+			pixelObjects[py * accumulation.GetWidth() + px] = objects[lane];
+		}
+	}
+
+	RecordTileObjects( tile, touched, refine );
+
+	boost::unique_lock<boost::mutex> lock( statisticsMutex );
+	statistics += rays;
+}
+
+
+// Finds the closest hits for the lanes of a packet, then shades each one on its own. Lanes that miss
+// everything are black and have no object
+void Scene::TracePacket( const RayPacket& packet, int lanes, Vector3 colours[], const Object* objects[], RenderStatistics& rays, ObjectList_t& touched ) const
+{
+	HitRecord hits[RayPacket::Size];
+	SimdFloat distance( camera.GetViewDistance() );
+	int hitLanes = FindClosest( packet, SimdMask::FromBits( lanes ), distance, hits ).GetBits();
+
+	float distances[RayPacket::Size];
+	distance.Store( distances );
+
+	float directionX[RayPacket::Size], directionY[RayPacket::Size], directionZ[RayPacket::Size];
+	packet.Direction.X.Store( directionX );
+	packet.Direction.Y.Store( directionY );
+	packet.Direction.Z.Store( directionZ );
+
+	Ray ray;
+	ray.Origin = camera.GetPosition();
+
+	for ( int lane=0; lane<RayPacket::Size; ++lane )
+	{
+		colours[lane] = Vector3();
+		objects[lane] = NULL;
+
+		if ( ( hitLanes & ( 1 << lane ) ) == 0 )
+			continue;
+
+		ray.Direction = Vector3( directionX[lane], directionY[lane], directionZ[lane] );
+		hits[lane].Distance = distances[lane];
+		CompleteHit( ray, hits[lane] );
+		Shade( ray, hits[lane], colours[lane], rays, touched );
+		objects[lane] = hits[lane].Object;
+	}
+}
+
+
+namespace
+{
+	inline bool IsContrasting( const Vector3& first, const Vector3& second, float threshold )
+	{
+		// compared as displayed, so differences between colours that are both too bright to show don't count
+		Vector3 difference = Vector3(
+			std::min( first.X, 1.0f ) - std::min( second.X, 1.0f ),
+			std::min( first.Y, 1.0f ) - std::min( second.Y, 1.0f ),
+			std::min( first.Z, 1.0f ) - std::min( second.Z, 1.0f ) );
+		return std::max( fabs( difference.X ), std::max( fabs( difference.Y ), fabs( difference.Z ) ) ) > threshold;
+	}
+}
+
+
+// Marks the pixels in the region which are on either side of an edge in the finished one ray per pixel
+// image: where the primary rays of neighbouring pixels hit different objects, or their colours differ by
+// more than the threshold. Neighbours outside the region are compared too, as they are already final.
+// It has to see past the tiles being traced, so runs between passes on the calling thread; it only
+// compares neighbours and is cheap next to tracing. Returns false if there are no edges at all.
+bool Scene::FindEdges( const TileScheduler::TileContainer_t& region )
+{
+	const int width = accumulation.GetWidth(), height = accumulation.GetHeight();
+	bool found = false;
+
+	for ( std::size_t i=0; i<region.size(); ++i )
+	{
+		const Tile& tile = region[i];
+		for ( int y=tile.Y; y<tile.Y + tile.Height; ++y )
 		{
-			Vector3 colourvec;
-			Object* object;
-			float objectdist;
-			ray.Direction = directionTable[x][y];
+			for ( int x=tile.X; x<tile.X + tile.Width; ++x )
+			{
+				std::size_t index = (std::size_t)y * width + x;
+				const Object* object = pixelObjects[index];
+				Vector3 colour = accumulation.GetPixel( x, y );
 
-			RayTrace( ray, colourvec, object, objectdist );
+				bool edge = ( x > 0 && ( object != pixelObjects[index - 1] || IsContrasting( colour, accumulation.GetPixel( x - 1, y ), antialiasThreshold ) ) )
+					|| ( x + 1 < width && ( object != pixelObjects[index + 1] || IsContrasting( colour, accumulation.GetPixel( x + 1, y ), antialiasThreshold ) ) )
+					|| ( y > 0 && ( object != pixelObjects[index - width] || IsContrasting( colour, accumulation.GetPixel( x, y - 1 ), antialiasThreshold ) ) )
+					|| ( y + 1 < height && ( object != pixelObjects[index + width] || IsContrasting( colour, accumulation.GetPixel( x, y + 1 ), antialiasThreshold ) ) );
 
-			frameBuffer->PutPixel( x, y, VectorToColour( colourvec ) );
+				edgePixels[index] = edge;
+				found = found || edge;
+			}
 		}
 	}
 
-	frameBuffer->Unlock();
+	return found;
+}
+
+
+// Replaces each edge pixel in the tile with the average of a grid of rays spread evenly over the pixel.
+// With packet tracing on the grid is traced a packet at a time, as its rays are as coherent as any
+void Scene::AntialiasTile( const Tile& tile )
+{
+	RenderStatistics rays;
+	ObjectList_t touched;
+
+	const int samples = antialiasSide * antialiasSide;
+	const float step = 1.0f / antialiasSide;
+
+	// offsets of the samples from the pixel centre, padded to whole packets
+	float offsetX[MAX_ANTIALIAS_SAMPLES + RayPacket::Size], offsetY[MAX_ANTIALIAS_SAMPLES + RayPacket::Size];
+	for ( int sample=0; sample<samples + RayPacket::Size; ++sample )
+	{
+		offsetX[sample] = sample < samples ? ( (float)( sample % antialiasSide ) + 0.5f ) * step - 0.5f : 0.0f;
+		offsetY[sample] = sample < samples ? ( (float)( sample / antialiasSide ) + 0.5f ) * step - 0.5f : 0.0f;
+	}
+
+	Ray ray;
+	ray.Origin = camera.GetPosition();
+
+	RayPacket packet;
+	packet.Origin = SimdVector3( ray.Origin );
+
+	for ( std::size_t i=0; i<pixelCells.size(); ++i )
+	{
+		if ( pixelCells[i].X >= tile.Width || pixelCells[i].Y >= tile.Height )
+			continue;
+
+		const int x = tile.X + pixelCells[i].X, y = tile.Y + pixelCells[i].Y;
+		if ( !edgePixels[(std::size_t)y * accumulation.GetWidth() + x] )
+			continue;
+
+		Vector3 total;
+
+		if ( packetson )
+		{
+			for ( int sample=0; sample<samples; sample+=RayPacket::Size )
+			{
+				int count = std::min( samples - sample, (int)RayPacket::Size );
+				packet.Direction = camera.GetDirections(
+					SimdFloat::Load( &offsetX[sample] ) + SimdFloat( (float)x ),
+					SimdFloat::Load( &offsetY[sample] ) + SimdFloat( (float)y ) );
+
+				Vector3 colours[RayPacket::Size];
+				const Object* objects[RayPacket::Size];
+				TracePacket( packet, ( 1 << count ) - 1, colours, objects, rays, touched );
+
+				for ( int lane=0; lane<count; ++lane )
+					total += colours[lane];
+			}
+		}
+		else
+		{
+			for ( int sample=0; sample<samples; ++sample )
+			{
+				Vector3 colourvec;
+				ray.Direction = camera.GetDirection( (float)x + offsetX[sample], (float)y + offsetY[sample] );
+				RayTrace( ray, colourvec, rays, touched );
+				total += colourvec;
+			}
+		}
+
+		rays.AntialiasRays += samples;
+		accumulation.SetPixel( x, y, total * ( 1.0f / samples ) );
+	}
+
+	RecordTileObjects( tile, touched, true );
+
+	boost::unique_lock<boost::mutex> lock( statisticsMutex );
+	statistics += rays;
+}
+
+
+void Scene::SetPixelOrder( CURVE_ORDER order )
+{
+	InterruptRender();
+	pixelOrder = order;
+	pixelCells = SpaceFillingCurve::OrderGrid( order, TILE_SIZE, TILE_SIZE );
+	packetCells = SpaceFillingCurve::OrderGrid( order, TILE_SIZE / PACKET_WIDTH, TILE_SIZE / PACKET_HEIGHT, PACKET_WIDTH, PACKET_HEIGHT );
+}
+
+
+void Scene::SetTileSplitting( bool on )
+{
+	scheduler.SetSplitSize( on ? SPLIT_SIZE : 0 );
+}
+
+
+void Scene::SetAntialiasing( int samples )
+{
+	int side = 1;
+	while ( ( side + 1 ) * ( side + 1 ) <= std::min( samples, MAX_ANTIALIAS_SAMPLES ) )
+		++side;
+	antialiasSide = side;
 }
 
 
-Vector3 Scene::CalculateDiffuse( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod )
+Vector3 Scene::CalculateDiffuse( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod ) const
 {
 	// calculate diffuse colouring
 	if ( material.Diffuse > 0.0f )
@@ -153,7 +967,7 @@ Vector3 Scene::CalculateDiffuse( const Material& material, const Ray& pray, cons
 }
 
 
-Vector3 Scene::CalculateSpecular( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod )
+Vector3 Scene::CalculateSpecular( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod ) const
 {
 	// specular
 	if ( specularon && material.Specular > 0.0f )
@@ -172,34 +986,106 @@ Vector3 Scene::CalculateSpecular( const Material& material, const Ray& pray, con
 }
 
 
-void Scene::RayTrace( const Ray& ray, Vector3& objectcolour, Object*& objecthit, float& objectdist, int recursionDepth )
+bool Scene::FindClosest( const Ray& ray, HitRecord& hit ) const
 {
-	objecthit = NULL;
+	if ( !primitives.Intersect( ray, hit ) )
+		return false;
 
-	if ( recursionDepth > RAYTRACE_RECURSION_LIMIT )
-		return;
+	CompleteHit( ray, hit );
+	return true;
+}
 
-	objectdist = 16000.0f + DISTANCE_LIMIT;
-	float distance = objectdist;
 
-	ObjectContainer_t::const_iterator it = objects.begin();
-	ObjectContainer_t::const_iterator itEnd = objects.end();
+SimdMask Scene::FindClosest( const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[] ) const
+{
+	return primitives.IntersectPacket( packet, active, distance, hits );
+}
 
-	// find the closest object it hit
-	for (; it != itEnd; ++it)
+
+void Scene::CompleteHit( const Ray& ray, HitRecord& hit ) const
+{
+	hit.Point = ray.Origin + ( ray.Direction * hit.Distance );
+	primitives.CompleteHit( ray, hit );
+}
+
+
+// Adds the object to the list of those a tile's rays met. Neighbouring rays mostly meet the same
+// objects, so repeats in a row are dropped here and the rest when the tile is done
+inline void Scene::Touch( ObjectList_t& touched, const Object* object )
+{
+	if ( touched.empty() || touched.back() != object )
+		touched.push_back( object );
+}
+
+
+bool Scene::IsOccluded( const Ray& ray, float maxDistance, ObjectList_t& touched ) const
+{
+	const Object* occluder = NULL;
+	if ( !primitives.Occludes( ray, maxDistance, occluder ) )
+		return false;
+
+	Touch( touched, occluder );
+	return true;
+}
+
+
+const Object* Scene::RayTrace( const Ray& ray, Vector3& objectcolour, RenderStatistics& rays, ObjectList_t& touched ) const
+{
+	HitRecord hit;
+	hit.Distance = camera.GetViewDistance();
+
+	if ( !FindClosest( ray, hit ) )
+		return NULL;
+
+	Shade( ray, hit, objectcolour, rays, touched );
+	return hit.Object;
+}
+
+
+// Follows the chain of reflections from the first hit in a loop, rather than recursing. weight is how
+// much the current surface contributes to the final colour, the product of the colours and
+// reflectivities of the mirrors on the way; once it is too small to matter the path is cut short.
+void Scene::Shade( const Ray& primaryRay, const HitRecord& primaryHit, Vector3& objectcolour, RenderStatistics& rays, ObjectList_t& touched ) const
+{
+	Ray ray = primaryRay;
+	HitRecord hit = primaryHit;
+	Vector3 weight( 1.0f, 1.0f, 1.0f );
+
+	for ( int depth=1; ; ++depth )
 	{
-		if( (*it)->Trace( ray, distance ) && distance < objectdist )
-		{
-			objecthit = it->get();
-			objectdist = distance;
-		}
+		Touch( touched, hit.Object );
+		objectcolour += ShadeSurface( ray, hit, rays, touched ) * weight;
+
+		const Material& material = hit.Object->Material;
+		if ( material.Reflectivity <= 0.0f || depth >= maxDepth )
+			break;
+
+		weight = weight * ColourToVector( material.Color ) * material.Reflectivity;
+		if ( std::max( weight.X, std::max( weight.Y, weight.Z ) ) < contributionThreshold )
+			break;
+
+		// then reflect the ray off the object
+		Vector3 reflect = ray.Direction + hit.Normal * (-2.0f) * Vector3::Dot( ray.Direction, hit.Normal );
+		reflect.Normalize();
+		ray.Origin = hit.Point + reflect * (EPSILON );
+		ray.Direction = reflect;
+
+		rays.ReflectionRays++;
+		hit = HitRecord();
+		hit.Distance = camera.GetViewDistance();
+		if ( !FindClosest( ray, hit ) )
+			break;
 	}
+}
+
 
-	
-	if ( objecthit != 0 )
+Vector3 Scene::ShadeSurface( const Ray& ray, const HitRecord& hit, RenderStatistics& rays, ObjectList_t& touched ) const
+{
+	Vector3 objectcolour;
 	{
-		Vector3 intersectionPoint = ray.Origin + ( ray.Direction * objectdist );
-		Vector3 normal = objecthit->GetNormal( ray, objectdist );
+		const Object* objecthit = hit.Object;
+		const Vector3& intersectionPoint = hit.Point;
+		const Vector3& normal = hit.Normal;
 //		normal.Normalize();
 		
 		// then calculate the color of the pixel, as according to light sources
@@ -213,9 +1099,21 @@ void Scene::RayTrace( const Ray& ray, Vector3& objectcolour, Object*& objecthit,
 			case LIGHT_DIRECTIONAL:
 				{
 					const DirectionalLight* light = static_cast< const DirectionalLight* >( lightit->get() );
+					Vector3 l = Vector3::Normalize( light->Direction );
 
-					objectcolour += CalculateDiffuse( objecthit->Material, ray, Vector3::Normalize( light->Direction ), light->Colour, normal );
-					objectcolour += CalculateSpecular( objecthit->Material, ray, Vector3::Normalize( light->Direction ), light->Colour, normal );
+					float shade = 1.0f;
+					if ( shadowson )
+					{
+						Ray r;
+						r.Origin = intersectionPoint + l * EPSILON;
+						r.Direction = l;
+						rays.ShadowRays++;
+						if ( IsOccluded( r, DISTANCE_LIMIT, touched ) )
+							shade = 0.0f;
+					}
+
+					objectcolour += CalculateDiffuse( objecthit->Material, ray, l, light->Colour, normal, shade );
+					objectcolour += CalculateSpecular( objecthit->Material, ray, l, light->Colour, normal, shade );
 				}
 				break;
 			case LIGHT_POINT:
@@ -223,26 +1121,19 @@ void Scene::RayTrace( const Ray& ray, Vector3& objectcolour, Object*& objecthit,
 					const PointLight* light = static_cast< const PointLight* >( lightit->get() );
 
 					Vector3 l = light->Position - intersectionPoint;
-					l.Normalize();
-					Ray r;
-					r.Origin = intersectionPoint + l * EPSILON;
-					r.Direction = l;
-
-					it = objects.begin();
-					itEnd = objects.end();
+					float lightdist = l.Length();
+					l *= 1.0f / lightdist;
 
+					// only blockers between the surface and the light count, so the shadow ray stops at the light
 					float shade = 1.0f;
 					if ( shadowson )
 					{
-						//for (; it != itEnd; ++it)
-						//{
-						//	float tdist = 0.0f;
-						//	if ( (*it).get() != objecthit && (*it)->Trace( r, tdist ) )
-						//	{
-						//		shade = 0.0f;
-						//		break;
-						//	}
-						//}
+						Ray r;
+						r.Origin = intersectionPoint + l * EPSILON;
+						r.Direction = l;
+						rays.ShadowRays++;
+						if ( IsOccluded( r, lightdist - EPSILON, touched ) )
+							shade = 0.0f;
 					}
 
 					objectcolour += CalculateDiffuse( objecthit->Material, ray, l, light->Colour, normal, shade );
@@ -253,23 +1144,8 @@ void Scene::RayTrace( const Ray& ray, Vector3& objectcolour, Object*& objecthit,
 				break;
 			}
 		}
-
-		// then reflect the ray off the object
-		if ( objecthit->Material.Reflectivity > 0.0f )
-		{
-			Vector3 reflect = ray.Direction + normal * (-2.0f) * Vector3::Dot( ray.Direction, normal );
-			reflect.Normalize();
-			Vector3 vcolour;
-			float dist;
-			Object* object;
-			Ray newray;
-			newray.Origin = intersectionPoint + reflect * (EPSILON );
-			newray.Direction = reflect;
-
-			RayTrace( newray, vcolour, object, dist, recursionDepth+1 );
-
-			objectcolour += vcolour * ColourToVector( objecthit->Material.Color ) * objecthit->Material.Reflectivity;
-		}
 	}
+
+	return objectcolour;
 }
 
@@ -15,46 +15,232 @@
 #include <boost/shared_ptr.hpp>
 
 #include "Light.h"
+#include "TileScheduler.h"
+#include "PrimitiveSet.h"
+#include "RenderStatistics.h"
+#include "Camera.h"
+#include "AccumulationBuffer.h"
 
+class RenderCheckpoint;
 
 class Scene
 {
 public:
 	typedef boost::shared_ptr<Object> ObjectPtr_t;
 	typedef boost::shared_ptr<Light> LightPtr_t;
-
-private:
 	typedef std::vector< ObjectPtr_t > ObjectContainer_t;
 	typedef std::vector< LightPtr_t > LightContainer_t;
 
-	bool shadowson, specularon;
+private:
+	typedef std::vector< const Object* > ObjectList_t;
+
+	bool shadowson, specularon, packetson;
+	int maxDepth;
+	float contributionThreshold;
+	// width of the grid of rays traced in each edge pixel, 1 when antialiasing is off
+	int antialiasSide;
+	float antialiasThreshold;
 
 	SDL::WindowPtr window;
 	SDL::SurfacePtr frameBuffer;
+	// render threads write here, and each finished frame or pass is resolved into frameBuffer
+	AccumulationBuffer accumulation;
 	ObjectContainer_t objects;
 	LightContainer_t lights;
-	std::vector< std::vector< Vector3 > > directionTable;
-
-	void GenerateDirectionTable();
-	void RayTrace( const Ray& ray, Vector3& colour, Object*& objecthit, float& objectdist, int recursionDepth = 1 );
-
-	Vector3 CalculateDiffuse( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod = 1.0f );
-	Vector3 CalculateSpecular( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod = 1.0f );
+	Camera camera;
+
+	TileScheduler scheduler;
+	TileScheduler::TileContainer_t tiles;
+	// The offsets in a whole tile of its pixels, and of its packets, in the order they are traced.
+	// Tiles at the right and bottom of the frame are smaller and skip the ones outside them
+	CURVE_ORDER pixelOrder;
+	std::vector< GridCell > pixelCells, packetCells;
+	// how long each tile took to trace, and to antialias, in the last whole frame, for the scheduler to
+	// split the ones that took longest
+	TileScheduler::TileCosts_t traceCosts, antialiasCosts;
+
+	// Objects sorted by type, each type traced by its own loop with the intersection test bound at
+	// compile time. Spheres and triangles are packed into stores and traced with vectorised kernels;
+	// the other types have a hierarchy each. Any type not listed goes in the last group, through
+	// virtual calls
+	typedef PrimitiveSet< Plane, Sphere, Triangle, Mesh, Cube, Box, Object > Primitives_t;
+	Primitives_t primitives;
+	// set when objects are added or removed, which needs a full build. Objects which have only moved
+	// are listed in movedObjects, and the hierarchies are just refitted around them
+	bool hierarchyDirty;
+	std::vector< const Object* > movedObjects;
+
+	RenderStatistics statistics;
+	mutable boost::mutex statisticsMutex;
+
+	// block size of the progressive pass being traced, or 0 when there is none. renderPending is set
+	// when the scene changed part way through a progressive render, which PollRender then restarts
+	int progressiveBlock;
+	bool renderPending;
+	// set while the last pass of a progressive render supersamples the edges
+	bool antialiasPass;
+
+	// object hit by each pixel's primary ray, or NULL, and the pixels FindEdges picked for supersampling
+	std::vector< const Object* > pixelObjects;
+	std::vector< boost::uint8_t > edgePixels;
+
+	// The objects each tile's primary, shadow and reflection rays met in the last render, sorted, and
+	// the tiles an edit since may have changed. frameValid is cleared by changes that can affect any
+	// pixel, such as moving the camera or a light, which then need a full render
+	std::vector< ObjectList_t > tileObjects;
+	boost::mutex tileObjectsMutex;
+	std::vector< boost::uint8_t > dirtyTiles;
+	int tilesAcross;
+	bool frameValid;
+	// the tiles being traced: all of them, or just the dirty ones
+	TileScheduler::TileContainer_t passTiles;
+	// set for each tile in passTiles while the pixels around them are traced by TraceBorder
+	std::vector< boost::uint8_t > borderTiles;
+
+	boost::shared_ptr< RenderCheckpoint > checkpoint;
+
+	void BuildHierarchy();
+	// Closest hit nearer than hit.Distance, with everything filled in for shading
+	bool FindClosest( const Ray& ray, HitRecord& hit ) const;
+	// Closest hits for a packet. Only the distance, object and group are filled in for the lanes
+	// returned, and CompleteHit must be called for the ones that get shaded
+	SimdMask FindClosest( const RayPacket& packet, const SimdMask& active, SimdFloat& distance, HitRecord hits[] ) const;
+	void CompleteHit( const Ray& ray, HitRecord& hit ) const;
+	static void Touch( ObjectList_t& touched, const Object* object );
+	bool IsOccluded( const Ray& ray, float maxDistance, ObjectList_t& touched ) const;
+	void RenderTile( const Tile& tile, int blockSize, bool refine );
+	void RenderTilePackets( const Tile& tile, bool refine );
+	void TracePacket( const RayPacket& packet, int lanes, Vector3 colours[], const Object* objects[], RenderStatistics& rays, ObjectList_t& touched ) const;
+	bool FindEdges( const TileScheduler::TileContainer_t& region );
+	void AntialiasTile( const Tile& tile );
+	void StartPass( bool refine );
+	void StartUpdate();
+	void RenderPassTiles();
+	void RenderCheckpointed();
+	void TraceCheckpointTile( const Tile& tile );
+	void AntialiasCheckpointTile( const Tile& tile );
+	void TraceBorder();
+	void TraceBorderRow( const Tile& row );
+	bool IsBorderTile( int x, int y ) const;
+	void FindDirtyTiles();
+	void ResolvePassTiles();
+	void PresentPassTiles();
+	void FinishFrame();
+	void Invalidate();
+	void MarkDirty( const Object* object );
+	int GetTileIndex( const Tile& tile ) const;
+	void RecordTileObjects( const Tile& tile, ObjectList_t& touched, bool merge );
+	// returns the first object hit, or NULL. Every object the ray and its shadow and reflection rays
+	// met is added to touched
+	const Object* RayTrace( const Ray& ray, Vector3& colour, RenderStatistics& rays, ObjectList_t& touched ) const;
+	// colour of the point the ray hit, including everything seen in its reflection
+	void Shade( const Ray& ray, const HitRecord& hit, Vector3& colour, RenderStatistics& rays, ObjectList_t& touched ) const;
+	// light reaching the point directly, without reflections
+	Vector3 ShadeSurface( const Ray& ray, const HitRecord& hit, RenderStatistics& rays, ObjectList_t& touched ) const;
+
+	Vector3 CalculateDiffuse( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod = 1.0f ) const;
+	Vector3 CalculateSpecular( const Material& material, const Ray& pray, const Vector3& lightdirection, const SDL::Color& lightColour, const Vector3& incidentNormal, float mod = 1.0f ) const;
 
 public:
-	Scene(SDL::WindowPtr window, SDL::SurfacePtr frameBuffer);
+	// threadCount of 0 uses one render thread per hardware thread
+	Scene(SDL::WindowPtr window, SDL::SurfacePtr frameBuffer, unsigned int threadCount = 0);
 
 	void OnKeyUp(const SDL::KeyboardEvent& event);
+	// renders the whole frame, blocking until it is done
 	void Render();
+	// Render saves its progress to the checkpoint as tiles are finished, and starts from whatever the
+	// checkpoint already holds. Tiles restored from one have no record of the objects their rays met, so
+	// the next RenderChanges renders everything. NULL turns it off
+	inline void SetCheckpoint( const boost::shared_ptr< RenderCheckpoint >& checkpoint ) { this->checkpoint = checkpoint; }
+	// Renders again only the tiles that adding, removing or updating objects has changed since the last
+	// complete render, blocking until they are done; anything else, like a camera move, renders it all.
+	// Tiles are found from the objects their rays met and the screen area an edited object covers now,
+	// so a new shadow or reflection of a moved object, on a surface whose rays never met it before, is
+	// only picked up by a full Render
+	void RenderChanges();
+	// Renders just these tiles, which must be ones GetTiles returns, blocking until they are done. The
+	// rest of the frame buffer is left as it was. With antialiasing the pixels around the tiles are
+	// traced as well, so the edges along their sides are found as a whole frame render finds them
+	void RenderTiles( const TileScheduler::TileContainer_t& region );
+	// the tiles the frame is traced in, which a render can be split along
+	inline const TileScheduler::TileContainer_t& GetTiles() const { return tiles; }
+
+	// Progressive rendering: StartRender traces a coarse image in the background and returns at once.
+	// PollRender must then be called regularly from the thread owning the window; each time a pass has
+	// finished it shows it with Window::UpdateSurface and starts the next, finer one, returning true.
+	// Changing the scene interrupts the render and the next PollRender starts it over. Once a frame is
+	// complete, adding, removing or updating objects only re-renders and shows the tiles RenderChanges would.
+	void StartRender();
+	bool PollRender();
+	// true until the last pass of a progressive render has been shown
+	inline bool IsRendering() const { return progressiveBlock != 0 || renderPending; }
+	// stops the progressive render for good
+	void CancelRender();
+	// stops the pass being traced so objects can be changed safely; PollRender starts the render over
+	void InterruptRender();
+
+	// rays traced by the last call to Render, or so far by a progressive render
+	inline const RenderStatistics& GetStatistics() const { return statistics; }
+	inline std::size_t GetObjectCount() const { return objects.size(); }
+	inline const ObjectContainer_t& GetObjects() const { return objects; }
+	inline const LightContainer_t& GetLights() const { return lights; }
 
 	void AddObject(ObjectPtr_t object);
 	void RemoveObject(ObjectPtr_t object);
+	// must be called after changing an object's geometry so the hierarchy can be refitted around it.
+	// Call InterruptRender before changing it while a progressive render is running
+	void UpdateObject(ObjectPtr_t object);
+	// Brings the hierarchies up to date with the objects added, removed and updated. Rendering does
+	// this itself; calling it first takes the work out of the render, such as to do it on another thread
+	// while something else is being traced. Not while this scene is rendering
+	void UpdateHierarchy();
+
+	inline const SDL::SurfacePtr& GetFrameBuffer() const { return frameBuffer; }
+	// tone mapping and exposure are set here
+	inline AccumulationBuffer& GetAccumulationBuffer() { return accumulation; }
+
+	inline const Camera& GetCamera() const { return camera; }
+	// the camera's resolution should be the frame buffer's size
+	void SetCamera(const Camera& camera);
 
 	void AddLight(LightPtr_t light);
 	void RemoveLight(LightPtr_t light);
+	// must be called after moving or recolouring a light
+	void UpdateLight(LightPtr_t light);
 
 	inline void SetShadows( bool on ) { shadowson = on; }
 	inline void SetSpecular( bool on ) { specularon = on; }
+	// trace primary rays in packets of neighbouring pixels. On by default; off traces every ray on its own
+	inline void SetPacketTracing( bool on ) { packetson = on; }
+	inline bool GetPacketTracing() const { return packetson; }
+	// longest chain of rays followed from a pixel, counting the primary ray, so 1 turns reflections off
+	inline void SetMaxDepth( int depth ) { maxDepth = depth; }
+	inline int GetMaxDepth() const { return maxDepth; }
+	// reflections are cut off once they would make up less than this fraction of the pixel's colour
+	inline void SetContributionThreshold( float threshold ) { contributionThreshold = threshold; }
+	inline float GetContributionThreshold() const { return contributionThreshold; }
+
+	// Adaptive antialiasing: after one ray per pixel, pixels next to an edge (a change of object, or of
+	// colour by more than the threshold) are traced again with a grid of this many rays, rounded down
+	// to a square number up to 64. Fewer than 4 turns it off, which is the default
+	void SetAntialiasing( int samples );
+	inline int GetAntialiasing() const { return antialiasSide * antialiasSide; }
+	inline void SetAntialiasingThreshold( float threshold ) { antialiasThreshold = threshold; }
+	inline float GetAntialiasingThreshold() const { return antialiasThreshold; }
+
+	// The order tiles are handed to the render threads in, and the order each tile's pixels and packets
+	// are traced in. Both are rows by default; see SpaceFillingCurve. Neither changes the image
+	inline void SetTileOrder( CURVE_ORDER order ) { scheduler.SetOrder( order ); }
+	inline CURVE_ORDER GetTileOrder() const { return scheduler.GetOrder(); }
+	void SetPixelOrder( CURVE_ORDER order );
+	inline CURVE_ORDER GetPixelOrder() const { return pixelOrder; }
+	// Splits the tiles which took far longer than the rest to trace or antialias in the last frame into
+	// parts, so the threads finish a frame together. On by default; it does not change the image
+	void SetTileSplitting( bool on );
+	inline bool GetTileSplitting() const { return scheduler.GetSplitSize() > 0; }
+	// how the render threads have shared the work since the scene was made or this was last reset
+	inline const SchedulerStatistics& GetSchedulerStatistics() const { return scheduler.GetStatistics(); }
+	inline void ResetSchedulerStatistics() { scheduler.ResetStatistics(); }
 
 };
 
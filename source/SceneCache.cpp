@@ -0,0 +1,398 @@
+#include "SceneCache.h"
+#include "CacheStream.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Cube.h"
+#include "Box.h"
+#include "Mesh.h"
+
+#include <fstream>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+const boost::uint32_t SceneCache::VERSION;
+
+
+namespace
+{
+	const char MAGIC[4] = { 'R', 'T', 'S', 'C' };
+	// reads back differently on a machine of the other byte order
+	const boost::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+
+	enum RECORD_TYPE
+	{
+		RECORD_SPHERE,
+		RECORD_PLANE,
+		RECORD_TRIANGLE,
+		RECORD_CUBE,
+		// the mesh's arrays follow the records, in the order the records list them
+		RECORD_MESH,
+		RECORD_POINT_LIGHT,
+		RECORD_DIRECTIONAL_LIGHT,
+		RECORD_BOX
+	};
+
+
+	class Header
+	{
+	public:
+		char Magic[4];
+		boost::uint32_t Version, ByteOrder;
+		boost::uint32_t NodeSize, ObjectRecordSize, LightRecordSize;
+	};
+
+
+	class CameraRecord
+	{
+	public:
+		float Position[3], Forward[3], Up[3];
+		// the aspect ratio is kept relative to the image's, so the cache works at any resolution
+		float FieldOfView, Stretch, ViewDistance;
+	};
+
+
+	// Values holds the type's fields in the order they are declared
+	class ObjectRecord
+	{
+	public:
+		boost::uint32_t Type;
+		boost::uint8_t Colour[4];
+		float Diffuse, Specular, Reflectivity;
+		float Values[15];
+	};
+
+
+	class LightRecord
+	{
+	public:
+		boost::uint32_t Type;
+		boost::uint8_t Colour[4];
+		float Values[3];
+	};
+
+
+	class MappedFile
+	{
+	public:
+		boost::interprocess::file_mapping File;
+		boost::interprocess::mapped_region Region;
+
+		explicit MappedFile(const std::string& fileName)
+			: File(fileName.c_str(), boost::interprocess::read_only), Region(File, boost::interprocess::read_only)
+		{}
+	};
+
+
+	inline void Put(float* values, const Vector3& vec)
+	{
+		values[0] = vec.X;
+		values[1] = vec.Y;
+		values[2] = vec.Z;
+	}
+
+
+	inline Vector3 Get(const float* values)
+	{
+		return Vector3(values[0], values[1], values[2]);
+	}
+
+
+	inline void PutColour(boost::uint8_t* colour, const SDL::Color& value)
+	{
+		colour[0] = value.R;
+		colour[1] = value.G;
+		colour[2] = value.B;
+		colour[3] = value.A;
+	}
+
+
+	inline SDL::Color GetColour(const boost::uint8_t* colour)
+	{
+		return SDL::Color(colour[0], colour[1], colour[2], colour[3]);
+	}
+
+
+	ObjectRecord MakeRecord(const Object& object, std::vector<const Mesh*>& meshes)
+	{
+		ObjectRecord record = ObjectRecord();
+		PutColour(record.Colour, object.Material.Color);
+		record.Diffuse = object.Material.Diffuse;
+		record.Specular = object.Material.Specular;
+		record.Reflectivity = object.Material.Reflectivity;
+
+		if (const Sphere* sphere = dynamic_cast<const Sphere*>(&object))
+		{
+			record.Type = RECORD_SPHERE;
+			Put(record.Values, sphere->Centre);
+			record.Values[3] = sphere->Radius;
+		}
+		else if (const Plane* plane = dynamic_cast<const Plane*>(&object))
+		{
+			record.Type = RECORD_PLANE;
+			Put(record.Values, plane->Normal);
+			record.Values[3] = plane->Distance;
+		}
+		else if (const Triangle* triangle = dynamic_cast<const Triangle*>(&object))
+		{
+			record.Type = RECORD_TRIANGLE;
+			Put(record.Values, triangle->A);
+			Put(record.Values + 3, triangle->B);
+			Put(record.Values + 6, triangle->C);
+		}
+		else if (const Cube* cube = dynamic_cast<const Cube*>(&object))
+		{
+			record.Type = RECORD_CUBE;
+			Put(record.Values, cube->AxisX);
+			Put(record.Values + 3, cube->AxisY);
+			Put(record.Values + 6, cube->AxisZ);
+			Put(record.Values + 9, cube->Centre);
+			Put(record.Values + 12, Vector3(cube->ExtentX, cube->ExtentY, cube->ExtentZ));
+		}
+		else if (const Box* box = dynamic_cast<const Box*>(&object))
+		{
+			record.Type = RECORD_BOX;
+			Put(record.Values, box->Min);
+			Put(record.Values + 3, box->Max);
+		}
+		else if (const Mesh* mesh = dynamic_cast<const Mesh*>(&object))
+		{
+			record.Type = RECORD_MESH;
+			meshes.push_back(mesh);
+		}
+		else
+		{
+			throw SDL::Exception("The scene has an object the cache cannot hold");
+		}
+
+		return record;
+	}
+
+
+	Scene::ObjectPtr_t MakeObject(const ObjectRecord& record, CacheReader& reader, const boost::shared_ptr<const void>& mapping)
+	{
+		Scene::ObjectPtr_t object;
+
+		switch (record.Type)
+		{
+		case RECORD_SPHERE:
+			{
+				boost::shared_ptr<Sphere> sphere = boost::make_shared<Sphere>();
+				sphere->Centre = Get(record.Values);
+				sphere->Radius = record.Values[3];
+				object = sphere;
+			}
+			break;
+		case RECORD_PLANE:
+			{
+				// the normal is set as it was saved, as normalising it again could move it by a rounding error
+				boost::shared_ptr<Plane> plane = boost::make_shared<Plane>();
+				plane->Normal = Get(record.Values);
+				plane->Distance = record.Values[3];
+				object = plane;
+			}
+			break;
+		case RECORD_TRIANGLE:
+			{
+				boost::shared_ptr<Triangle> triangle = boost::make_shared<Triangle>();
+				triangle->A = Get(record.Values);
+				triangle->B = Get(record.Values + 3);
+				triangle->C = Get(record.Values + 6);
+				object = triangle;
+			}
+			break;
+		case RECORD_CUBE:
+			{
+				boost::shared_ptr<Cube> cube = boost::make_shared<Cube>();
+				cube->AxisX = Get(record.Values);
+				cube->AxisY = Get(record.Values + 3);
+				cube->AxisZ = Get(record.Values + 6);
+				cube->Centre = Get(record.Values + 9);
+				cube->ExtentX = record.Values[12];
+				cube->ExtentY = record.Values[13];
+				cube->ExtentZ = record.Values[14];
+				object = cube;
+			}
+			break;
+		case RECORD_BOX:
+			object = boost::make_shared<Box>(Get(record.Values), Get(record.Values + 3));
+			break;
+		case RECORD_MESH:
+			object = Mesh::Map(reader, mapping);
+			break;
+		default:
+			throw reader.Error("Unknown object type");
+		}
+
+		object->Material.Color = GetColour(record.Colour);
+		object->Material.Diffuse = record.Diffuse;
+		object->Material.Specular = record.Specular;
+		object->Material.Reflectivity = record.Reflectivity;
+		return object;
+	}
+}
+
+
+void SceneCache::Save(const std::string& fileName, const Scene& scene)
+{
+	std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw SDL::Exception("Could not create " + fileName);
+
+	Save(file, scene);
+
+	file.close();
+	if (!file)
+		throw SDL::Exception("Could not write " + fileName);
+}
+
+
+void SceneCache::Save(std::ostream& stream, const Scene& scene)
+{
+	Header header = Header();
+	std::copy(MAGIC, MAGIC + 4, header.Magic);
+	header.Version = VERSION;
+	header.ByteOrder = BYTE_ORDER_MARK;
+	header.NodeSize = sizeof(BVH::Node);
+	header.ObjectRecordSize = sizeof(ObjectRecord);
+	header.LightRecordSize = sizeof(LightRecord);
+
+	const Camera& camera = scene.GetCamera();
+	CameraRecord cameraRecord = CameraRecord();
+	Put(cameraRecord.Position, camera.GetPosition());
+	Put(cameraRecord.Forward, camera.GetForward());
+	Put(cameraRecord.Up, camera.GetUp());
+	cameraRecord.FieldOfView = camera.GetFieldOfView();
+	cameraRecord.Stretch = camera.GetAspectRatio() / ((float)camera.GetWidth() / (float)camera.GetHeight());
+	cameraRecord.ViewDistance = camera.GetViewDistance();
+
+	const Scene::LightContainer_t& lights = scene.GetLights();
+	std::vector<LightRecord> lightRecords(lights.size());
+	for (std::size_t i=0; i<lights.size(); ++i)
+	{
+		LightRecord& record = lightRecords[i];
+		record = LightRecord();
+		PutColour(record.Colour, lights[i]->Colour);
+
+		if (const PointLight* light = dynamic_cast<const PointLight*>(lights[i].get()))
+		{
+			record.Type = RECORD_POINT_LIGHT;
+			Put(record.Values, light->Position);
+		}
+		else if (const DirectionalLight* light = dynamic_cast<const DirectionalLight*>(lights[i].get()))
+		{
+			record.Type = RECORD_DIRECTIONAL_LIGHT;
+			Put(record.Values, light->Direction);
+		}
+		else
+		{
+			throw SDL::Exception("The scene has a light the cache cannot hold");
+		}
+	}
+
+	const Scene::ObjectContainer_t& objects = scene.GetObjects();
+	std::vector<ObjectRecord> objectRecords(objects.size());
+	std::vector<const Mesh*> meshes;
+	for (std::size_t i=0; i<objects.size(); ++i)
+		objectRecords[i] = MakeRecord(*objects[i], meshes);
+
+	CacheWriter writer(stream);
+	writer.Write(header);
+	writer.Write(cameraRecord);
+	writer.WriteArray(lightRecords);
+	writer.WriteArray(objectRecords);
+	for (std::size_t i=0; i<meshes.size(); ++i)
+		meshes[i]->Write(writer);
+}
+
+
+void SceneCache::Load(const std::string& fileName, Scene& scene)
+{
+	boost::shared_ptr<MappedFile> file;
+	try
+	{
+		file = boost::make_shared<MappedFile>(fileName);
+	}
+	catch (const std::exception&)
+	{
+		throw SDL::Exception("Could not map " + fileName);
+	}
+
+	const char* begin = static_cast<const char*>(file->Region.get_address());
+	Load(begin, begin + file->Region.get_size(), fileName, file, scene);
+}
+
+
+void SceneCache::Load(const char* begin, const char* end, const std::string& name, const boost::shared_ptr<const void>& memory, Scene& scene)
+{
+	CacheReader reader(begin, end, name);
+
+	Header header = reader.Read<Header>();
+	if (!std::equal(MAGIC, MAGIC + 4, header.Magic))
+		throw reader.Error("Not a scene cache");
+	if (header.Version != VERSION || header.ByteOrder != BYTE_ORDER_MARK || header.NodeSize != sizeof(BVH::Node)
+		|| header.ObjectRecordSize != sizeof(ObjectRecord) || header.LightRecordSize != sizeof(LightRecord))
+		throw reader.Error("Scene cache was written by a different build; recreate it");
+
+	CameraRecord cameraRecord = reader.Read<CameraRecord>();
+	Camera camera = scene.GetCamera();
+	try
+	{
+		camera.SetPosition(Get(cameraRecord.Position));
+		camera.SetOrientation(Get(cameraRecord.Forward), Get(cameraRecord.Up));
+		camera.SetFieldOfView(cameraRecord.FieldOfView);
+		camera.SetAspectRatio(cameraRecord.Stretch * (float)camera.GetWidth() / (float)camera.GetHeight());
+		camera.SetViewDistance(cameraRecord.ViewDistance);
+	}
+	catch (const SDL::Exception& e)
+	{
+		throw reader.Error(e.GetMessage());
+	}
+	scene.SetCamera(camera);
+
+	std::size_t lightCount;
+	const LightRecord* lightRecords = reader.ReadArray<LightRecord>(lightCount);
+	for (std::size_t i=0; i<lightCount; ++i)
+	{
+		const LightRecord& record = lightRecords[i];
+		Scene::LightPtr_t light;
+
+		if (record.Type == RECORD_POINT_LIGHT)
+		{
+			boost::shared_ptr<PointLight> point = boost::make_shared<PointLight>();
+			point->Position = Get(record.Values);
+			light = point;
+		}
+		else if (record.Type == RECORD_DIRECTIONAL_LIGHT)
+		{
+			boost::shared_ptr<DirectionalLight> directional = boost::make_shared<DirectionalLight>();
+			directional->Direction = Get(record.Values);
+			light = directional;
+		}
+		else
+		{
+			throw reader.Error("Unknown light type");
+		}
+
+		light->Colour = GetColour(record.Colour);
+		scene.AddLight(light);
+	}
+
+	// the meshes hold on to the memory, which goes once the last of them does
+	std::size_t objectCount;
+	const ObjectRecord* objectRecords = reader.ReadArray<ObjectRecord>(objectCount);
+	for (std::size_t i=0; i<objectCount; ++i)
+		scene.AddObject(MakeObject(objectRecords[i], reader, memory));
+}
+
+
+bool SceneCache::IsCache(const std::string& fileName)
+{
+	std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+	char magic[4];
+	return file.read(magic, 4) && std::equal(MAGIC, MAGIC + 4, magic);
+}
@@ -0,0 +1,41 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include "Scene.h"
+
+#include <ostream>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+
+// Binary snapshot of a scene, for starting up without parsing or building anything. The file is
+// mapped rather than read: meshes keep their vertices, packed triangles and prebuilt hierarchies in
+// it and are traced from the mapped pages directly, so loading one costs what paging it in does.
+// The camera, lights and the remaining objects are fixed size records, made into objects on load
+// with one allocation each; large geometry belongs in meshes.
+//
+// The data is laid out as this build holds it in memory, so a cache is only read by a build with the
+// same version, byte order, structure sizes and no wider a SIMD width than the one that wrote it.
+// Loading checks every array length and index against what it refers to, so a damaged cache, or one
+// sent by something other than a renderer, throws rather than being traced outside its arrays.
+class SceneCache
+{
+public:
+	static const boost::uint32_t VERSION = 1;
+
+	// Writes the scene's camera, lights and objects. Throws for object types the cache cannot hold
+	static void Save(const std::string& fileName, const Scene& scene);
+	static void Save(std::ostream& stream, const Scene& scene);
+	// adds everything in the cache to the scene and sets its camera
+	static void Load(const std::string& fileName, Scene& scene);
+	// The same for a cache already in memory, such as one sent over a network. begin must be aligned to
+	// CacheWriter::ALIGNMENT, and memory keeps it alive for as long as meshes refer into it. name is
+	// only used in errors
+	static void Load(const char* begin, const char* end, const std::string& name, const boost::shared_ptr<const void>& memory, Scene& scene);
+	// true if the file starts like a scene cache, of any version
+	static bool IsCache(const std::string& fileName);
+};
+
+
+#endif
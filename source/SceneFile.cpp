@@ -0,0 +1,433 @@
+#include "SceneFile.h"
+#include "ParseState.h"
+#include "Animation.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Cube.h"
+#include "Box.h"
+#include "Mesh.h"
+
+#include <utility>
+#include <vector>
+#include <boost/make_shared.hpp>
+
+
+namespace
+{
+	typedef std::vector< std::pair< std::string, Material > > MaterialContainer_t;
+
+
+	inline Vector3 ParseVector(ParseState& state)
+	{
+		float x = state.ParseFloat();
+		float y = state.ParseFloat();
+		float z = state.ParseFloat();
+		return Vector3(x, y, z);
+	}
+
+
+	int ParseColourComponent(ParseState& state)
+	{
+		int value = state.ParseInt();
+		if (value < 0 || value > 255)
+			throw state.Error("Colour components must be from 0 to 255");
+		return value;
+	}
+
+
+	SDL::Color ParseColour(ParseState& state)
+	{
+		int red = ParseColourComponent(state);
+		int green = ParseColourComponent(state);
+		int blue = ParseColourComponent(state);
+		return SDL::Color((Uint8)red, (Uint8)green, (Uint8)blue, 0);
+	}
+
+
+	// a word, or anything up to the closing quote if it starts with one
+	std::string ParseName(ParseState& state)
+	{
+		state.SkipSpace();
+		if (state.Position < state.End && *state.Position == '"')
+		{
+			const char* name = ++state.Position;
+			while (state.Position < state.End && *state.Position != '"' && *state.Position != '\n')
+				++state.Position;
+			if (state.Position >= state.End || *state.Position != '"')
+				throw state.Error("Missing closing quote");
+			return std::string(name, state.Position++);
+		}
+
+		std::size_t length;
+		const char* name = state.ParseWord(length);
+		if (length == 0 || *name == '#')
+			throw state.Error("Expected a name");
+		return std::string(name, length);
+	}
+
+
+	// the next property name on the line, or false at the end of it
+	inline bool ParseProperty(ParseState& state, const char*& name, std::size_t& length)
+	{
+		state.SkipSpace();
+		if (state.AtEndOfLine())
+			return false;
+		name = state.ParseWord(length);
+		return true;
+	}
+
+
+	void ExpectEndOfLine(ParseState& state)
+	{
+		state.SkipSpace();
+		if (!state.AtEndOfLine())
+		{
+			std::size_t length;
+			const char* word = state.ParseWord(length);
+			throw state.Error("Unexpected '" + std::string(word, length) + "' at the end of the line");
+		}
+	}
+
+
+	void ParseCamera(ParseState& state, Scene& scene)
+	{
+		Camera camera = scene.GetCamera();
+		Vector3 up(0.0f, 1.0f, 0.0f), target;
+		bool hasTarget = false, hasUp = false;
+		float fieldOfView = camera.GetFieldOfView(), aspectRatio = camera.GetAspectRatio(), viewDistance = camera.GetViewDistance();
+
+		const char* name;
+		std::size_t length;
+		while (ParseProperty(state, name, length))
+		{
+			if (ParseState::IsWord(name, length, "position"))
+				camera.SetPosition(ParseVector(state));
+			else if (ParseState::IsWord(name, length, "lookat"))
+			{
+				target = ParseVector(state);
+				hasTarget = true;
+			}
+			else if (ParseState::IsWord(name, length, "up"))
+			{
+				up = ParseVector(state);
+				hasUp = true;
+			}
+			else if (ParseState::IsWord(name, length, "fov"))
+				fieldOfView = state.ParseFloat();
+			else if (ParseState::IsWord(name, length, "aspect"))
+				aspectRatio = state.ParseFloat();
+			else if (ParseState::IsWord(name, length, "viewdistance"))
+				viewDistance = state.ParseFloat();
+			else
+				throw state.Error("Unknown camera property '" + std::string(name, length) + "'");
+		}
+
+		if (hasTarget && (target - camera.GetPosition()).LengthSq() == 0.0f)
+			throw state.Error("Camera lookat must not be its position");
+
+		// the camera checks the view itself, and its complaints are given this line
+		try
+		{
+			// the target is only aimed at once the position is known, whichever order they came in
+			if (hasTarget)
+				camera.LookAt(target, up);
+			else if (hasUp)
+				camera.SetOrientation(camera.GetForward(), up);
+
+			camera.SetFieldOfView(fieldOfView);
+			camera.SetAspectRatio(aspectRatio);
+			camera.SetViewDistance(viewDistance);
+		}
+		catch (const SDL::Exception& e)
+		{
+			throw state.Error(e.GetMessage());
+		}
+
+		scene.SetCamera(camera);
+	}
+
+
+	void ParseMaterial(ParseState& state, MaterialContainer_t& materials)
+	{
+		std::string materialName = ParseName(state);
+		::Material material;
+
+		const char* name;
+		std::size_t length;
+		while (ParseProperty(state, name, length))
+		{
+			if (ParseState::IsWord(name, length, "color"))
+				material.Color = ParseColour(state);
+			else if (ParseState::IsWord(name, length, "diffuse"))
+				material.Diffuse = state.ParseFloat();
+			else if (ParseState::IsWord(name, length, "specular"))
+				material.Specular = state.ParseFloat();
+			else if (ParseState::IsWord(name, length, "reflectivity"))
+				material.Reflectivity = state.ParseFloat();
+			else
+				throw state.Error("Unknown material property '" + std::string(name, length) + "'");
+		}
+
+		// a later definition replaces an earlier one for the objects after it
+		for (std::size_t i=0; i<materials.size(); ++i)
+		{
+			if (materials[i].first == materialName)
+			{
+				materials[i].second = material;
+				return;
+			}
+		}
+		materials.push_back(std::make_pair(materialName, material));
+	}
+
+
+	const Material& FindMaterial(ParseState& state, const MaterialContainer_t& materials)
+	{
+		std::string name = ParseName(state);
+		for (std::size_t i=0; i<materials.size(); ++i)
+		{
+			if (materials[i].first == name)
+				return materials[i].second;
+		}
+		throw state.Error("Unknown material '" + name + "'");
+	}
+
+
+	// colour is optional on lights, and white if missing
+	void ParseLightColour(ParseState& state, Light& light)
+	{
+		const char* name;
+		std::size_t length;
+		while (ParseProperty(state, name, length))
+		{
+			if (ParseState::IsWord(name, length, "color"))
+				light.Colour = ParseColour(state);
+			else
+				throw state.Error("Unknown light property '" + std::string(name, length) + "'");
+		}
+	}
+
+
+	// what a key line animates: the object, light or camera the line before it made
+	class KeyTarget
+	{
+	public:
+		Scene::ObjectPtr_t Object;
+		Scene::LightPtr_t Light;
+		bool Camera;
+
+		KeyTarget() : Camera(false) {}
+
+		inline void Set(const Scene::ObjectPtr_t& object) { *this = KeyTarget(); Object = object; }
+		inline void Set(const Scene::LightPtr_t& light) { *this = KeyTarget(); Light = light; }
+		inline void SetCamera() { *this = KeyTarget(); Camera = true; }
+	};
+
+
+	void ParseKey(ParseState& state, const KeyTarget& target, Scene& scene, Animation* animation)
+	{
+		Animation::Key key;
+		key.Time = state.ParseFloat();
+
+		const char* name;
+		std::size_t length;
+		while (ParseProperty(state, name, length))
+		{
+			if (ParseState::IsWord(name, length, "rotate"))
+				key.Rotation = ParseVector(state);
+			else if (ParseState::IsWord(name, length, "translate"))
+				key.Translation = ParseVector(state);
+			else if (ParseState::IsWord(name, length, "pivot"))
+			{
+				key.Pivot = ParseVector(state);
+				key.HasPivot = true;
+			}
+			else
+				throw state.Error("Unknown key property '" + std::string(name, length) + "'");
+		}
+
+		if (!target.Object && !target.Light && !target.Camera)
+			throw state.Error("A key must follow the object, light or camera it animates");
+		if (!animation)
+			return;
+
+		try
+		{
+			if (target.Object)
+				animation->AddKey(target.Object, key);
+			else if (target.Light)
+				animation->AddKey(target.Light, key);
+			else
+				animation->AddCameraKey(scene.GetCamera(), key);
+		}
+		catch (const SDL::Exception& e)
+		{
+			throw state.Error(e.GetMessage());
+		}
+	}
+
+
+	bool IsAbsolutePath(const std::string& path)
+	{
+		return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+	}
+}
+
+
+void SceneFile::Load(const std::string& fileName, Scene& scene, Animation* animation)
+{
+	std::vector<char> buffer;
+	ParseState::ReadFile(fileName, buffer);
+
+	std::string::size_type slash = fileName.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+
+	const char* begin = buffer.empty() ? NULL : &buffer[0];
+	Parse(begin, begin + buffer.size(), fileName, directory, scene, animation);
+}
+
+
+void SceneFile::Parse(const char* begin, const char* end, const std::string& fileName, const std::string& directory,
+	Scene& scene, Animation* animation)
+{
+	ParseState state(begin, end, fileName);
+	MaterialContainer_t materials;
+	Material material;
+	KeyTarget target;
+
+	while (state.Position < state.End)
+	{
+		state.SkipSpace();
+		if (state.AtEndOfLine())
+		{
+			state.SkipLine();
+			continue;
+		}
+
+		std::size_t length;
+		const char* keyword = state.ParseWord(length);
+
+		// the primitives come first, as there may be millions of them
+		if (ParseState::IsWord(keyword, length, "sphere"))
+		{
+			boost::shared_ptr<Sphere> sphere = boost::make_shared<Sphere>();
+			sphere->Centre = ParseVector(state);
+			sphere->Radius = state.ParseFloat();
+			if (sphere->Radius <= 0.0f)
+				throw state.Error("Sphere radius must be positive");
+			sphere->Material = material;
+			scene.AddObject(sphere);
+			target.Set(sphere);
+		}
+		else if (ParseState::IsWord(keyword, length, "triangle"))
+		{
+			boost::shared_ptr<Triangle> triangle = boost::make_shared<Triangle>();
+			triangle->A = ParseVector(state);
+			triangle->B = ParseVector(state);
+			triangle->C = ParseVector(state);
+			triangle->Material = material;
+			scene.AddObject(triangle);
+			target.Set(triangle);
+		}
+		else if (ParseState::IsWord(keyword, length, "cube"))
+		{
+			Vector3 centre = ParseVector(state);
+			Vector3 forward = ParseVector(state);
+			Vector3 up = ParseVector(state);
+			Vector3 extent = ParseVector(state);
+			if (extent.X <= 0.0f || extent.Y <= 0.0f || extent.Z <= 0.0f)
+				throw state.Error("Cube size must be positive");
+			if (forward.LengthSq() == 0.0f || up.LengthSq() == 0.0f)
+				throw state.Error("Cube forward and up must not be zero");
+
+			// the cube throws for an up along its forward direction
+			boost::shared_ptr<Cube> cube;
+			try
+			{
+				cube = boost::make_shared<Cube>(centre, Vector3::Normalize(forward), Vector3::Normalize(up), extent.X, extent.Y, extent.Z);
+			}
+			catch (const SDL::Exception& e)
+			{
+				throw state.Error(e.GetMessage());
+			}
+			cube->Material = material;
+			scene.AddObject(cube);
+			target.Set(cube);
+		}
+		else if (ParseState::IsWord(keyword, length, "box"))
+		{
+			Vector3 min = ParseVector(state);
+			Vector3 max = ParseVector(state);
+			if (max.X <= min.X || max.Y <= min.Y || max.Z <= min.Z)
+				throw state.Error("Box maximum must be above its minimum");
+
+			boost::shared_ptr<Box> box = boost::make_shared<Box>(min, max);
+			box->Material = material;
+			scene.AddObject(box);
+			target.Set(box);
+		}
+		else if (ParseState::IsWord(keyword, length, "plane"))
+		{
+			Vector3 normal = ParseVector(state);
+			float distance = state.ParseFloat();
+			if (normal.LengthSq() == 0.0f)
+				throw state.Error("Plane normal must not be zero");
+
+			boost::shared_ptr<Plane> plane = boost::make_shared<Plane>(normal.X, normal.Y, normal.Z, distance);
+			plane->Material = material;
+			scene.AddObject(plane);
+			target.Set(plane);
+		}
+		else if (ParseState::IsWord(keyword, length, "mesh"))
+		{
+			std::string meshName = ParseName(state);
+			MeshPtr mesh;
+			try
+			{
+				mesh = Mesh::Load(IsAbsolutePath(meshName) ? meshName : directory + meshName);
+			}
+			catch (const SDL::Exception& e)
+			{
+				throw state.Error(e.GetMessage());
+			}
+			mesh->Material = material;
+			scene.AddObject(mesh);
+			target.Set(mesh);
+		}
+		else if (ParseState::IsWord(keyword, length, "use"))
+			material = FindMaterial(state, materials);
+		else if (ParseState::IsWord(keyword, length, "material"))
+			ParseMaterial(state, materials);
+		else if (ParseState::IsWord(keyword, length, "pointlight"))
+		{
+			boost::shared_ptr<PointLight> light = boost::make_shared<PointLight>();
+			light->Position = ParseVector(state);
+			ParseLightColour(state, *light);
+			scene.AddLight(light);
+			target.Set(light);
+		}
+		else if (ParseState::IsWord(keyword, length, "directionallight"))
+		{
+			boost::shared_ptr<DirectionalLight> light = boost::make_shared<DirectionalLight>();
+			light->Direction = ParseVector(state);
+			if (light->Direction.LengthSq() == 0.0f)
+				throw state.Error("Light direction must not be zero");
+			ParseLightColour(state, *light);
+			scene.AddLight(light);
+			target.Set(light);
+		}
+		else if (ParseState::IsWord(keyword, length, "camera"))
+		{
+			ParseCamera(state, scene);
+			target.SetCamera();
+		}
+		else if (ParseState::IsWord(keyword, length, "key"))
+			ParseKey(state, target, scene, animation);
+		else
+			throw state.Error("Unknown statement '" + std::string(keyword, length) + "'");
+
+		ExpectEndOfLine(state);
+		state.SkipLine();
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include "Scene.h"
+
+#include <string>
+
+
+class Animation;
+
+
+// Reads scenes from text files, so they can be changed without recompiling. One statement per line,
+// '#' starts a comment; numbers are decimals, colours are red, green and blue from 0 to 255:
+//
+//   camera [position X Y Z] [lookat X Y Z] [up X Y Z] [fov DEGREES] [aspect RATIO] [viewdistance D]
+//   material NAME [color R G B] [diffuse D] [specular S] [reflectivity R]
+//   use NAME                          objects after this get the named material
+//   sphere X Y Z RADIUS
+//   plane NX NY NZ D                  points P where N.P + D = 0
+//   triangle AX AY AZ BX BY BZ CX CY CZ
+//   cube X Y Z FX FY FZ UX UY UZ EX EY EZ
+//                                     centre, forward and up axes, and half size along each axis
+//   box MINX MINY MINZ MAXX MAXY MAXZ opposite corners of a cube lined up with the axes, which is
+//                                     cheaper to trace
+//   mesh FILE                         Wavefront OBJ, relative to the scene file; quote names with spaces
+//   pointlight X Y Z [color R G B]
+//   directionallight X Y Z [color R G B]
+//   key SECONDS [rotate X Y Z] [translate X Y Z] [pivot X Y Z]
+//                                     animates the last object, light or camera before it; see
+//                                     Animation for what the transform means
+//
+// The file is parsed in one pass straight out of a single buffer, with one allocation per object, so
+// scenes of millions of primitives load in well under a second. Errors throw an SDL::Exception
+// giving the file name and line.
+class SceneFile
+{
+public:
+	// Adds everything in the file to the scene, and sets its camera if the file has one. Keys are added
+	// to animation, or only checked if it is NULL, which leaves everything where the file first puts it
+	static void Load(const std::string& fileName, Scene& scene, Animation* animation = NULL);
+	// the same for a scene already in memory. Meshes are found relative to directory
+	static void Parse(const char* begin, const char* end, const std::string& fileName, const std::string& directory,
+		Scene& scene, Animation* animation = NULL);
+};
+
+
+#endif
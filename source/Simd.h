@@ -0,0 +1,243 @@
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <algorithm>
+#include <cmath>
+#include <boost/cstdint.hpp>
+
+
+// Thin wrappers over the widest vector registers the build targets: AVX (8 floats) when compiled
+// with -mavx or /arch:AVX, otherwise SSE2 (4 floats), with a plain C++ fallback of the same width
+// as SSE for other processors, or when NO_SIMD is defined. Code written against SimdFloat and
+// SimdMask works unchanged on all three.
+#if defined(NO_SIMD)
+#elif defined(__AVX__)
+#define SIMD_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+
+#if defined(SIMD_AVX)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+
+
+// Per lane true/false, as produced by comparisons
+class SimdMask
+{
+public:
+	static const int Width = SIMD_WIDTH;
+
+#if defined(SIMD_AVX)
+	__m256 Value;
+	inline SimdMask() {}
+	inline explicit SimdMask(__m256 value) : Value(value) {}
+	inline explicit SimdMask(bool set) : Value(set ? _mm256_castsi256_ps(_mm256_set1_epi32(-1)) : _mm256_setzero_ps()) {}
+
+	inline int GetBits() const { return _mm256_movemask_ps(Value); }
+	inline SimdMask operator & (const SimdMask& other) const { return SimdMask(_mm256_and_ps(Value, other.Value)); }
+	inline SimdMask operator | (const SimdMask& other) const { return SimdMask(_mm256_or_ps(Value, other.Value)); }
+	// this and not other
+	inline SimdMask AndNot(const SimdMask& other) const { return SimdMask(_mm256_andnot_ps(other.Value, Value)); }
+#elif defined(SIMD_SSE)
+	__m128 Value;
+	inline SimdMask() {}
+	inline explicit SimdMask(__m128 value) : Value(value) {}
+	inline explicit SimdMask(bool set) : Value(set ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_setzero_ps()) {}
+
+	inline int GetBits() const { return _mm_movemask_ps(Value); }
+	inline SimdMask operator & (const SimdMask& other) const { return SimdMask(_mm_and_ps(Value, other.Value)); }
+	inline SimdMask operator | (const SimdMask& other) const { return SimdMask(_mm_or_ps(Value, other.Value)); }
+	inline SimdMask AndNot(const SimdMask& other) const { return SimdMask(_mm_andnot_ps(other.Value, Value)); }
+#else
+	int Bits;
+	inline SimdMask() {}
+	inline explicit SimdMask(bool set) : Bits(set ? (1 << Width) - 1 : 0) {}
+
+	inline int GetBits() const { return Bits; }
+	inline SimdMask operator & (const SimdMask& other) const { return FromBits(Bits & other.Bits); }
+	inline SimdMask operator | (const SimdMask& other) const { return FromBits(Bits | other.Bits); }
+	inline SimdMask AndNot(const SimdMask& other) const { return FromBits(Bits & ~other.Bits); }
+#endif
+
+	static inline SimdMask FromBits(int bits)
+	{
+#if defined(SIMD_AVX) || defined(SIMD_SSE)
+		boost::uint32_t lanes[Width];
+		for (int i=0; i<Width; ++i)
+			lanes[i] = bits & (1 << i) ? 0xffffffffu : 0u;
+#if defined(SIMD_AVX)
+		return SimdMask(_mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes))));
+#else
+		return SimdMask(_mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes))));
+#endif
+#else
+		SimdMask mask;
+		mask.Bits = bits;
+		return mask;
+#endif
+	}
+
+	// lanes whose index is less than count
+	static inline SimdMask FirstLanes(int count)
+	{
+		return count >= Width ? SimdMask(true) : FromBits((1 << count) - 1);
+	}
+
+	inline bool IsSet(int lane) const { return (GetBits() & (1 << lane)) != 0; }
+	inline bool Any() const { return GetBits() != 0; }
+	inline bool All() const { return GetBits() == (1 << Width) - 1; }
+};
+
+
+class SimdFloat
+{
+public:
+	static const int Width = SIMD_WIDTH;
+	static const int Alignment = SIMD_WIDTH * sizeof(float);
+
+#if defined(SIMD_AVX)
+	__m256 Value;
+	inline SimdFloat() {}
+	inline SimdFloat(float value) : Value(_mm256_set1_ps(value)) {}
+	inline explicit SimdFloat(__m256 value) : Value(value) {}
+
+	static inline SimdFloat Load(const float* values) { return SimdFloat(_mm256_loadu_ps(values)); }
+	inline void Store(float* values) const { _mm256_storeu_ps(values, Value); }
+	// values must be aligned to SimdFloat::Alignment bytes
+	static inline SimdFloat LoadAligned(const float* values) { return SimdFloat(_mm256_load_ps(values)); }
+	inline void StoreAligned(float* values) const { _mm256_store_ps(values, Value); }
+	// converted to integers by rounding toward zero
+	inline void StoreTruncated(boost::int32_t* values) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), _mm256_cvttps_epi32(Value)); }
+
+	inline SimdFloat operator + (const SimdFloat& other) const { return SimdFloat(_mm256_add_ps(Value, other.Value)); }
+	inline SimdFloat operator - (const SimdFloat& other) const { return SimdFloat(_mm256_sub_ps(Value, other.Value)); }
+	inline SimdFloat operator * (const SimdFloat& other) const { return SimdFloat(_mm256_mul_ps(Value, other.Value)); }
+	inline SimdFloat operator / (const SimdFloat& other) const { return SimdFloat(_mm256_div_ps(Value, other.Value)); }
+	inline SimdFloat operator - () const { return SimdFloat(_mm256_xor_ps(Value, _mm256_set1_ps(-0.0f))); }
+
+	inline SimdMask operator < (const SimdFloat& other) const { return SimdMask(_mm256_cmp_ps(Value, other.Value, _CMP_LT_OQ)); }
+	inline SimdMask operator <= (const SimdFloat& other) const { return SimdMask(_mm256_cmp_ps(Value, other.Value, _CMP_LE_OQ)); }
+	inline SimdMask operator > (const SimdFloat& other) const { return SimdMask(_mm256_cmp_ps(Value, other.Value, _CMP_GT_OQ)); }
+	inline SimdMask operator >= (const SimdFloat& other) const { return SimdMask(_mm256_cmp_ps(Value, other.Value, _CMP_GE_OQ)); }
+
+	static inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat(_mm256_min_ps(a.Value, b.Value)); }
+	static inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat(_mm256_max_ps(a.Value, b.Value)); }
+	static inline SimdFloat Sqrt(const SimdFloat& a) { return SimdFloat(_mm256_sqrt_ps(a.Value)); }
+	// lanes of a where mask is set, b elsewhere
+	static inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b) { return SimdFloat(_mm256_blendv_ps(b.Value, a.Value, mask.Value)); }
+#elif defined(SIMD_SSE)
+	__m128 Value;
+	inline SimdFloat() {}
+	inline SimdFloat(float value) : Value(_mm_set1_ps(value)) {}
+	inline explicit SimdFloat(__m128 value) : Value(value) {}
+
+	static inline SimdFloat Load(const float* values) { return SimdFloat(_mm_loadu_ps(values)); }
+	inline void Store(float* values) const { _mm_storeu_ps(values, Value); }
+	static inline SimdFloat LoadAligned(const float* values) { return SimdFloat(_mm_load_ps(values)); }
+	inline void StoreAligned(float* values) const { _mm_store_ps(values, Value); }
+	inline void StoreTruncated(boost::int32_t* values) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_cvttps_epi32(Value)); }
+
+	inline SimdFloat operator + (const SimdFloat& other) const { return SimdFloat(_mm_add_ps(Value, other.Value)); }
+	inline SimdFloat operator - (const SimdFloat& other) const { return SimdFloat(_mm_sub_ps(Value, other.Value)); }
+	inline SimdFloat operator * (const SimdFloat& other) const { return SimdFloat(_mm_mul_ps(Value, other.Value)); }
+	inline SimdFloat operator / (const SimdFloat& other) const { return SimdFloat(_mm_div_ps(Value, other.Value)); }
+	inline SimdFloat operator - () const { return SimdFloat(_mm_xor_ps(Value, _mm_set1_ps(-0.0f))); }
+
+	inline SimdMask operator < (const SimdFloat& other) const { return SimdMask(_mm_cmplt_ps(Value, other.Value)); }
+	inline SimdMask operator <= (const SimdFloat& other) const { return SimdMask(_mm_cmple_ps(Value, other.Value)); }
+	inline SimdMask operator > (const SimdFloat& other) const { return SimdMask(_mm_cmpgt_ps(Value, other.Value)); }
+	inline SimdMask operator >= (const SimdFloat& other) const { return SimdMask(_mm_cmpge_ps(Value, other.Value)); }
+
+	static inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat(_mm_min_ps(a.Value, b.Value)); }
+	static inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat(_mm_max_ps(a.Value, b.Value)); }
+	static inline SimdFloat Sqrt(const SimdFloat& a) { return SimdFloat(_mm_sqrt_ps(a.Value)); }
+	static inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b)
+	{
+		return SimdFloat(_mm_or_ps(_mm_and_ps(mask.Value, a.Value), _mm_andnot_ps(mask.Value, b.Value)));
+	}
+#else
+	float Value[Width];
+	inline SimdFloat() {}
+	inline SimdFloat(float value) { for (int i=0; i<Width; ++i) Value[i] = value; }
+
+	static inline SimdFloat Load(const float* values) { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = values[i]; return r; }
+	inline void Store(float* values) const { for (int i=0; i<Width; ++i) values[i] = Value[i]; }
+	static inline SimdFloat LoadAligned(const float* values) { return Load(values); }
+	inline void StoreAligned(float* values) const { Store(values); }
+	inline void StoreTruncated(boost::int32_t* values) const { for (int i=0; i<Width; ++i) values[i] = (boost::int32_t)Value[i]; }
+
+#define SIMD_SCALAR_OP(op) \
+	inline SimdFloat operator op (const SimdFloat& other) const { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = Value[i] op other.Value[i]; return r; }
+	SIMD_SCALAR_OP(+) SIMD_SCALAR_OP(-) SIMD_SCALAR_OP(*) SIMD_SCALAR_OP(/)
+#undef SIMD_SCALAR_OP
+	inline SimdFloat operator - () const { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = -Value[i]; return r; }
+
+#define SIMD_SCALAR_CMP(op) \
+	inline SimdMask operator op (const SimdFloat& other) const { int bits = 0; for (int i=0; i<Width; ++i) bits |= (Value[i] op other.Value[i]) << i; return SimdMask::FromBits(bits); }
+	SIMD_SCALAR_CMP(<) SIMD_SCALAR_CMP(<=) SIMD_SCALAR_CMP(>) SIMD_SCALAR_CMP(>=)
+#undef SIMD_SCALAR_CMP
+
+	// same NaN behaviour as minps/maxps: the second operand is returned if either is NaN
+	static inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = a.Value[i] < b.Value[i] ? a.Value[i] : b.Value[i]; return r; }
+	static inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = a.Value[i] > b.Value[i] ? a.Value[i] : b.Value[i]; return r; }
+	static inline SimdFloat Sqrt(const SimdFloat& a) { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = sqrtf(a.Value[i]); return r; }
+	static inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b) { SimdFloat r; for (int i=0; i<Width; ++i) r.Value[i] = mask.IsSet(i) ? a.Value[i] : b.Value[i]; return r; }
+#endif
+
+	inline float operator [] (int lane) const
+	{
+		float values[Width];
+		Store(values);
+		return values[lane];
+	}
+
+	static inline float HorizontalMin(const SimdFloat& a)
+	{
+		float values[Width];
+		a.Store(values);
+		return *std::min_element(values, values + Width);
+	}
+
+	static inline float HorizontalMax(const SimdFloat& a)
+	{
+		float values[Width];
+		a.Store(values);
+		return *std::max_element(values, values + Width);
+	}
+};
+
+
+// Width vectors, one per lane
+class SimdVector3
+{
+public:
+	SimdFloat X, Y, Z;
+
+	inline SimdVector3() {}
+	inline SimdVector3(const SimdFloat& x, const SimdFloat& y, const SimdFloat& z) : X(x), Y(y), Z(z) {}
+	template <class T>
+	inline SimdVector3(const T& vector) : X(vector.X), Y(vector.Y), Z(vector.Z) {}
+
+	inline SimdVector3 operator + (const SimdVector3& other) const { return SimdVector3(X + other.X, Y + other.Y, Z + other.Z); }
+	inline SimdVector3 operator - (const SimdVector3& other) const { return SimdVector3(X - other.X, Y - other.Y, Z - other.Z); }
+	inline SimdVector3 operator * (const SimdFloat& scale) const { return SimdVector3(X * scale, Y * scale, Z * scale); }
+
+	// same evaluation order as Vector3::Dot, so results match the scalar path bit for bit
+	static inline SimdFloat Dot(const SimdVector3& a, const SimdVector3& b)
+	{
+		return a.X * b.X + a.Y * b.Y + a.Z * b.Z;
+	}
+
+	inline SimdFloat LengthSq() const { return X * X + Y * Y + Z * Z; }
+};
+
+
+#endif
@@ -0,0 +1,112 @@
+#include "SpaceFillingCurve.h"
+
+#include <algorithm>
+#include <utility>
+
+
+namespace
+{
+	const int COORDINATE_BITS = 16;
+
+
+	// spreads the low 16 bits of value out to the even bits
+	inline boost::uint32_t SpreadBits(boost::uint32_t value)
+	{
+		value &= 0x0000ffff;
+		value = (value | (value << 8)) & 0x00ff00ff;
+		value = (value | (value << 4)) & 0x0f0f0f0f;
+		value = (value | (value << 2)) & 0x33333333;
+		value = (value | (value << 1)) & 0x55555555;
+		return value;
+	}
+
+
+	// The curve is built up a quadrant at a time from the largest: each step adds the quadrant's place
+	// in the order it is visited, then turns the coordinates so that the quadrant's own curve starts
+	// where the last one ended
+	boost::uint64_t HilbertIndex(boost::uint32_t x, boost::uint32_t y)
+	{
+		boost::uint64_t index = 0;
+		for (boost::uint32_t side = 1u << (COORDINATE_BITS - 1); side > 0; side /= 2)
+		{
+			boost::uint32_t right = (x & side) ? 1 : 0;
+			boost::uint32_t lower = (y & side) ? 1 : 0;
+			index += (boost::uint64_t)side * side * ((3 * right) ^ lower);
+
+			if (lower == 0)
+			{
+				if (right == 1)
+				{
+					x = side - 1 - (x & (side - 1));
+					y = side - 1 - (y & (side - 1));
+				}
+				std::swap(x, y);
+			}
+			x &= side - 1;
+			y &= side - 1;
+		}
+		return index;
+	}
+}
+
+
+boost::uint64_t SpaceFillingCurve::GetIndex(CURVE_ORDER order, unsigned int x, unsigned int y)
+{
+	switch (order)
+	{
+	case ORDER_MORTON:
+		return SpreadBits(x) | (SpreadBits(y) << 1);
+	case ORDER_HILBERT:
+		return HilbertIndex(x, y);
+	default:
+		return ((boost::uint64_t)y << 32) | x;
+	}
+}
+
+
+std::vector<GridCell> SpaceFillingCurve::OrderGrid(CURVE_ORDER order, int across, int down, int width, int height)
+{
+	std::vector< std::pair<boost::uint64_t, int> > keys;
+	keys.reserve((std::size_t)across * down);
+	for (int y=0; y<down; ++y)
+	{
+		for (int x=0; x<across; ++x)
+			keys.push_back(std::make_pair(GetIndex(order, x * width, y * height), y * across + x));
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<GridCell> cells;
+	cells.reserve(keys.size());
+	for (std::size_t i=0; i<keys.size(); ++i)
+		cells.push_back(GridCell(keys[i].second % across * width, keys[i].second / across * height));
+	return cells;
+}
+
+
+bool SpaceFillingCurve::Parse(const std::string& name, CURVE_ORDER& order)
+{
+	if (name == "rows")
+		order = ORDER_ROWS;
+	else if (name == "morton")
+		order = ORDER_MORTON;
+	else if (name == "hilbert")
+		order = ORDER_HILBERT;
+	else
+		return false;
+
+	return true;
+}
+
+
+const char* SpaceFillingCurve::GetName(CURVE_ORDER order)
+{
+	switch (order)
+	{
+	case ORDER_MORTON:
+		return "morton";
+	case ORDER_HILBERT:
+		return "hilbert";
+	default:
+		return "rows";
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef SPACEFILLINGCURVE_H
+#define SPACEFILLINGCURVE_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+// Orders in which to visit the cells of a 2D grid, such as the tiles of a frame or the pixels of a
+// tile. Rows is left to right, top to bottom. The Morton (Z order) and Hilbert curves keep cells
+// visited close together in time close together on screen as well, so the rays traced one after the
+// other meet more of the same objects and hierarchy nodes; Hilbert never jumps, Morton is cheaper to
+// compute but makes long jumps between quadrants.
+enum CURVE_ORDER
+{
+	ORDER_ROWS,
+	ORDER_MORTON,
+	ORDER_HILBERT
+};
+
+
+class GridCell
+{
+public:
+	inline GridCell(int x = 0, int y = 0) : X(x), Y(y) {}
+
+	int X, Y;
+};
+
+
+class SpaceFillingCurve
+{
+public:
+	// the position of (x, y) along the curve, for coordinates below 65536
+	static boost::uint64_t GetIndex(CURVE_ORDER order, unsigned int x, unsigned int y);
+
+	// The cells of a grid across by down, as the offsets of their top left corners when each is
+	// width by height, in the order of the curve through those corners
+	static std::vector<GridCell> OrderGrid(CURVE_ORDER order, int across, int down, int width = 1, int height = 1);
+
+	// "rows", "morton" or "hilbert"; returns false for anything else
+	static bool Parse(const std::string& name, CURVE_ORDER& order);
+	static const char* GetName(CURVE_ORDER order);
+};
+
+
+#endif
@@ -1,5 +1,6 @@
 #include "Sphere.h"
 
+#include <algorithm>
 #include <cmath>
 
 
@@ -12,15 +13,17 @@ bool Sphere::Trace(const Ray& ray, float& distance) const
 {
 	
 	Vector3 rayToSphereCenter = Centre - ray.Origin;
-	float lengthRTSC2 = rayToSphereCenter.LengthSq();
 
 	float closestApproach = Vector3::Dot(rayToSphereCenter, ray.Direction);
 	if (closestApproach < 0.0f) // the intersection is behind the ray
 		return false;
 
 	// halfCord2 = the distance squared from the closest approach of the ray to a perpendicular to the ray
-	// through the center of the sphere to the place where the ray actually intersects the sphere
-	float halfCord2 = (Radius * Radius) - lengthRTSC2 + (closestApproach * closestApproach);
+	// through the center of the sphere to the place where the ray actually intersects the sphere.
+	// The perpendicular is measured directly rather than as lengthRTSC2 - closestApproach^2, which
+	// cancels catastrophically for small spheres far from the ray origin
+	Vector3 perpendicular = rayToSphereCenter - ray.Direction * closestApproach;
+	float halfCord2 = (Radius * Radius) - perpendicular.LengthSq();
 
 	if(halfCord2 < 0.0f)
 		return false; // the ray missed the sphere
@@ -92,6 +95,29 @@ bool Sphere::Trace(const Ray& ray, float& distance) const
 }
 
 
+// The same test as Trace, a lane per ray, with the early outs turned into masks
+SimdMask Sphere::TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const
+{
+	SimdVector3 rayToSphereCenter = SimdVector3(Centre) - packet.Origin;
+
+	SimdFloat closestApproach = SimdVector3::Dot(rayToSphereCenter, packet.Direction);
+	SimdVector3 perpendicular = rayToSphereCenter - packet.Direction * closestApproach;
+	SimdFloat halfCord2 = SimdFloat(Radius * Radius) - perpendicular.LengthSq();
+	SimdFloat hitDistance = closestApproach - SimdFloat::Sqrt(halfCord2);
+
+	SimdMask hit = active & (closestApproach >= 0.0f) & (halfCord2 >= 0.0f) & (hitDistance < distance);
+	distance = SimdFloat::Select(hit, hitDistance, distance);
+	return hit;
+}
+
+
+BoundingBox Sphere::GetBounds() const
+{
+	Vector3 extent(Radius, Radius, Radius);
+	return BoundingBox(Centre - extent, Centre + extent);
+}
+
+
 Vector3 Sphere::GetNormal(const Ray& ray, float distance) const
 {
   Vector3 intersection;
@@ -114,3 +140,15 @@ Vector3 Sphere::GetNormal(const Ray& ray, float distance) const
 }
 
 
+void Sphere::CompleteHit(const Ray& ray, HitRecord& hit) const
+{
+	hit.Normal = Vector3::Normalize((hit.Point - Centre) * (1.0f / Radius));
+
+	// longitude around the Y axis and latitude from the top, both over 0 to 1
+	const float pi = 3.14159265358979f;
+	float latitude = std::max(-1.0f, std::min(1.0f, hit.Normal.Y));
+	hit.U = 0.5f + (float)atan2(hit.Normal.Z, hit.Normal.X) / (2.0f * pi);
+	hit.V = 0.5f - (float)asin(latitude) / pi;
+}
+
+
@@ -15,7 +15,10 @@ public:
 	Sphere();
 
 	virtual bool Trace(const Ray& ray, float& distance) const;
+	virtual SimdMask TracePacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance) const;
 	virtual Vector3 GetNormal(const Ray& ray, float distance) const;
+	virtual void CompleteHit(const Ray& ray, HitRecord& hit) const;
+	virtual BoundingBox GetBounds() const;
 };
 
 
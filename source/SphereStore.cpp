@@ -0,0 +1,278 @@
+#include "SphereStore.h"
+
+
+void SphereStore::Clear()
+{
+	centres.clear();
+	radii.clear();
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	radiusSq.clear();
+	ids.clear();
+	bounds.clear();
+	slots.clear();
+	moved.clear();
+	hierarchy.Clear();
+}
+
+
+void SphereStore::Add(const Vector3& centre, float radius)
+{
+	centres.push_back(centre);
+	radii.push_back(radius);
+}
+
+
+void SphereStore::SetBounds(boost::uint32_t id)
+{
+	Vector3 extent(radii[id], radii[id], radii[id]);
+	bounds[id] = BoundingBox(centres[id] - extent, centres[id] + extent);
+}
+
+
+void SphereStore::WriteSlot(boost::uint32_t slot, boost::uint32_t id)
+{
+	centreX[slot] = centres[id].X;
+	centreY[slot] = centres[id].Y;
+	centreZ[slot] = centres[id].Z;
+	radiusSq[slot] = radii[id] * radii[id];
+	ids[slot] = id;
+	slots[id] = slot;
+}
+
+
+void SphereStore::Build()
+{
+	bounds.resize(centres.size());
+	for (boost::uint32_t i=0; i<centres.size(); ++i)
+		SetBounds(i);
+
+	hierarchy.Build(bounds, LEAF_SIZE);
+	moved.clear();
+
+	// the padding never hits anything, as its radius squared is negative
+	const BVH::IndexContainer_t& order = hierarchy.GetIndices();
+	std::size_t size = order.size() + SimdFloat::Width;
+	centreX.assign(size, 0.0f);
+	centreY.assign(size, 0.0f);
+	centreZ.assign(size, 0.0f);
+	radiusSq.assign(size, -1.0f);
+	ids.assign(size, 0);
+	slots.resize(centres.size());
+
+	for (boost::uint32_t i=0; i<order.size(); ++i)
+		WriteSlot(i, order[i]);
+}
+
+
+void SphereStore::Update(boost::uint32_t id, const Vector3& centre, float radius)
+{
+	centres[id] = centre;
+	radii[id] = radius;
+	SetBounds(id);
+	WriteSlot(slots[id], id);
+	moved.push_back(id);
+}
+
+
+bool SphereStore::Refit(float rebuildThreshold)
+{
+	if (moved.empty())
+		return false;
+
+	hierarchy.Refit(bounds, moved);
+	moved.clear();
+
+	if (hierarchy.GetCost() <= hierarchy.GetBuildCost() * rebuildThreshold)
+		return false;
+
+	Build();
+	return true;
+}
+
+
+// The kernels follow Sphere::Trace operation for operation, so they find exactly the same hits.
+// A leaf is tested a whole vector at a time, with the lanes past its end masked off.
+class SphereStore::LeafIntersector
+{
+private:
+	const SphereStore& store;
+	SimdVector3 origin, direction;
+
+public:
+	boost::uint32_t Slot;
+
+	LeafIntersector(const SphereStore& store, const Ray& ray)
+		: store(store), origin(ray.Origin), direction(ray.Direction), Slot(0)
+	{}
+
+	inline bool operator()(boost::uint32_t first, boost::uint32_t count, float& distance)
+	{
+		bool hit = false;
+
+		const boost::uint32_t end = first + count;
+		for (boost::uint32_t slot=first; slot<end; slot+=SimdFloat::Width)
+		{
+			SimdMask valid = SimdMask::FirstLanes(end - slot);
+			SimdVector3 centre(SimdFloat::Load(&store.centreX[slot]), SimdFloat::Load(&store.centreY[slot]), SimdFloat::Load(&store.centreZ[slot]));
+			SimdVector3 rayToSphereCenter = centre - origin;
+
+			SimdFloat closestApproach = SimdVector3::Dot(rayToSphereCenter, direction);
+			SimdVector3 perpendicular = rayToSphereCenter - direction * closestApproach;
+			SimdFloat halfCord2 = SimdFloat::Load(&store.radiusSq[slot]) - perpendicular.LengthSq();
+			SimdFloat hitDistance = closestApproach - SimdFloat::Sqrt(halfCord2);
+
+			int bits = (valid & (closestApproach >= 0.0f) & (halfCord2 >= 0.0f) & (hitDistance < distance)).GetBits();
+			if (bits == 0)
+				continue;
+
+			float distances[SimdFloat::Width];
+			hitDistance.Store(distances);
+			for (int lane=0; lane<SimdFloat::Width; ++lane)
+			{
+				if ((bits & (1 << lane)) && distances[lane] < distance)
+				{
+					distance = distances[lane];
+					Slot = slot + lane;
+					hit = true;
+				}
+			}
+		}
+
+		return hit;
+	}
+};
+
+
+class SphereStore::OcclusionLeafIntersector
+{
+private:
+	const SphereStore& store;
+	SimdVector3 origin, direction;
+
+public:
+	// the sphere that blocked the ray
+	boost::uint32_t Id;
+
+	OcclusionLeafIntersector(const SphereStore& store, const Ray& ray)
+		: store(store), origin(ray.Origin), direction(ray.Direction), Id(0)
+	{}
+
+	inline bool Blocked(boost::uint32_t slot, const SimdMask& hit)
+	{
+		if (!hit.Any())
+			return false;
+
+		int bits = hit.GetBits();
+		int lane = 0;
+		while ((bits & (1 << lane)) == 0)
+			++lane;
+
+		Id = store.ids[slot + lane];
+		return true;
+	}
+
+	inline bool operator()(boost::uint32_t first, boost::uint32_t count, float maxDistance)
+	{
+		const boost::uint32_t end = first + count;
+		for (boost::uint32_t slot=first; slot<end; slot+=SimdFloat::Width)
+		{
+			SimdMask valid = SimdMask::FirstLanes(end - slot);
+			SimdVector3 centre(SimdFloat::Load(&store.centreX[slot]), SimdFloat::Load(&store.centreY[slot]), SimdFloat::Load(&store.centreZ[slot]));
+			SimdVector3 rayToSphereCenter = centre - origin;
+
+			SimdFloat closestApproach = SimdVector3::Dot(rayToSphereCenter, direction);
+			SimdVector3 perpendicular = rayToSphereCenter - direction * closestApproach;
+			SimdFloat halfCord2 = SimdFloat::Load(&store.radiusSq[slot]) - perpendicular.LengthSq();
+			SimdFloat hitDistance = closestApproach - SimdFloat::Sqrt(halfCord2);
+
+			SimdMask hit = valid & (closestApproach >= 0.0f) & (halfCord2 >= 0.0f) & (hitDistance >= 0.0f) & (hitDistance < maxDistance);
+			if (Blocked(slot, hit))
+				return true;
+		}
+
+		return false;
+	}
+};
+
+
+// Packets test each sphere of the leaf against every lane in turn
+class SphereStore::PacketLeafIntersector
+{
+private:
+	const SphereStore& store;
+	const RayPacket& packet;
+	boost::uint32_t* id;
+
+public:
+	PacketLeafIntersector(const SphereStore& store, const RayPacket& packet, boost::uint32_t* id)
+		: store(store), packet(packet), id(id)
+	{}
+
+	inline SimdMask operator()(boost::uint32_t first, boost::uint32_t count, const SimdMask& lanes, SimdFloat& distance)
+	{
+		SimdMask leafHit(false);
+
+		for (boost::uint32_t slot=first; slot<first + count; ++slot)
+		{
+			SimdVector3 rayToSphereCenter = SimdVector3(SimdFloat(store.centreX[slot]), SimdFloat(store.centreY[slot]), SimdFloat(store.centreZ[slot])) - packet.Origin;
+
+			SimdFloat closestApproach = SimdVector3::Dot(rayToSphereCenter, packet.Direction);
+			SimdVector3 perpendicular = rayToSphereCenter - packet.Direction * closestApproach;
+			SimdFloat halfCord2 = SimdFloat(store.radiusSq[slot]) - perpendicular.LengthSq();
+			SimdFloat hitDistance = closestApproach - SimdFloat::Sqrt(halfCord2);
+
+			SimdMask hit = lanes & (closestApproach >= 0.0f) & (halfCord2 >= 0.0f) & (hitDistance < distance);
+			int bits = hit.GetBits();
+			if (bits == 0)
+				continue;
+
+			distance = SimdFloat::Select(hit, hitDistance, distance);
+			for (int lane=0; bits != 0; ++lane, bits >>= 1)
+			{
+				if (bits & 1)
+					id[lane] = store.ids[slot];
+			}
+			leafHit = leafHit | hit;
+		}
+
+		return leafHit;
+	}
+};
+
+
+bool SphereStore::Intersect(const Ray& ray, float& distance, boost::uint32_t& id) const
+{
+	LeafIntersector intersector(*this, ray);
+	if (!hierarchy.IntersectLeaves(ray, distance, intersector))
+		return false;
+
+	id = ids[intersector.Slot];
+	return true;
+}
+
+
+bool SphereStore::Occludes(const Ray& ray, float maxDistance) const
+{
+	OcclusionLeafIntersector intersector(*this, ray);
+	return hierarchy.IntersectAnyLeaves(ray, maxDistance, intersector);
+}
+
+
+bool SphereStore::Occludes(const Ray& ray, float maxDistance, boost::uint32_t& id) const
+{
+	OcclusionLeafIntersector intersector(*this, ray);
+	if (!hierarchy.IntersectAnyLeaves(ray, maxDistance, intersector))
+		return false;
+
+	id = intersector.Id;
+	return true;
+}
+
+
+SimdMask SphereStore::IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t id[]) const
+{
+	PacketLeafIntersector intersector(*this, packet, id);
+	return hierarchy.IntersectPacketLeaves(packet, active, distance, intersector);
+}
@@ -0,0 +1,69 @@
+
+
+#ifndef SPHERESTORE_H
+#define SPHERESTORE_H
+
+#include "BVH.h"
+#include "RayPacket.h"
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+// Spheres packed as structure of arrays, with their own hierarchy. The arrays are kept in hierarchy
+// order so the spheres in a leaf are contiguous and one ray is tested against a whole vector of them
+// at a time, with no virtual calls or pointer chasing. Spheres are identified by the order they were added.
+class SphereStore
+{
+public:
+	static const int LEAF_SIZE = 8;
+
+private:
+	std::vector<Vector3> centres;
+	std::vector<float> radii;
+	std::vector<BoundingBox> bounds;
+
+	// hierarchy order, padded by a vector width so kernels can always load whole vectors
+	std::vector<float> centreX, centreY, centreZ, radiusSq;
+	std::vector<boost::uint32_t> ids;
+	BVH hierarchy;
+
+	// where each sphere is in the arrays, and the spheres moved since the hierarchy was last fitted
+	std::vector<boost::uint32_t> slots;
+	std::vector<boost::uint32_t> moved;
+
+	void SetBounds(boost::uint32_t id);
+	void WriteSlot(boost::uint32_t slot, boost::uint32_t id);
+
+	class LeafIntersector;
+	class OcclusionLeafIntersector;
+	class PacketLeafIntersector;
+
+public:
+	void Clear();
+	void Add(const Vector3& centre, float radius);
+	// must be called after adding spheres and before tracing
+	void Build();
+
+	// Moves a sphere. Refit must be called before tracing again
+	void Update(boost::uint32_t id, const Vector3& centre, float radius);
+	// Fits the hierarchy around the spheres moved since it was built or last fitted, or rebuilds it if
+	// refitting leaves its cost more than rebuildThreshold times what it was when built. Returns true
+	// if it rebuilt
+	bool Refit(float rebuildThreshold);
+
+	inline std::size_t GetCount() const { return centres.size(); }
+	inline bool IsEmpty() const { return centres.empty(); }
+	inline BoundingBox GetBounds() const { return hierarchy.GetBounds(); }
+
+	// Closest hit. Lowers distance and returns the id of the sphere if one is hit closer than distance
+	bool Intersect(const Ray& ray, float& distance, boost::uint32_t& id) const;
+	bool Occludes(const Ray& ray, float maxDistance) const;
+	// also gives the id of a sphere which blocks the ray
+	bool Occludes(const Ray& ray, float maxDistance, boost::uint32_t& id) const;
+	// Closest hits for a packet. id is written for each lane in the returned mask
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t id[]) const;
+};
+
+
+#endif
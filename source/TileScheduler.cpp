@@ -0,0 +1,355 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+
+namespace
+{
+	typedef boost::chrono::duration<double> Seconds_t;
+
+	// A tile is split if it took more than this many times the mean tile last time...
+	const double SPLIT_COST_FACTOR = 4.0;
+	// ...or more than this fraction of a thread's share of the run, as the threads left waiting at the
+	// end of a run wait for about as long as the last task takes
+	const double SPLIT_SHARE_FRACTION = 1.0 / 50.0;
+}
+
+
+TileScheduler::TileScheduler(unsigned int threadCount)
+	: threadCount(ResolveThreadCount(threadCount)), generation(0), activeWorkers(0), stopping(false), running(false), order(ORDER_ROWS),
+	splitSize(0), tileCount(0), costs(NULL), queues(new WorkQueue[this->threadCount]), cancelled(false)
+{
+	for (unsigned int i=0; i<this->threadCount; ++i)
+		workers.create_thread(boost::bind(&TileScheduler::WorkerLoop, this, i));
+}
+
+
+unsigned int TileScheduler::ResolveThreadCount(unsigned int threadCount)
+{
+	return threadCount == 0 ? std::max(1u, boost::thread::hardware_concurrency()) : threadCount;
+}
+
+
+TileScheduler::~TileScheduler()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	workers.join_all();
+}
+
+
+void TileScheduler::Run(const TileContainer_t& tiles, const TileFunc_t& func, TileCosts_t* costs)
+{
+	Start(tiles, func, costs);
+	Wait();
+}
+
+
+void TileScheduler::Start(const TileContainer_t& tiles, const TileFunc_t& func, TileCosts_t* costs)
+{
+	Wait();
+
+	boost::unique_lock<boost::mutex> lock(mutex);
+
+	this->tileFunc = func;
+	this->costs = costs;
+	MakeTasks(tiles, costs);
+
+	// each thread starts with an equal run of the tasks, which in any order but rows is a compact area
+	for (unsigned int i=0; i<threadCount; ++i)
+	{
+		queues[i].Next = tasks.size() * i / threadCount;
+		queues[i].End = tasks.size() * (i + 1) / threadCount;
+	}
+
+	cancelled = false;
+	error = boost::exception_ptr();
+	activeWorkers = threadCount;
+	running = true;
+	runStart = Clock_t::now();
+	++generation;
+
+	workAvailable.notify_all();
+}
+
+
+bool TileScheduler::IsFinished()
+{
+	boost::unique_lock<boost::mutex> lock(mutex);
+	return activeWorkers == 0;
+}
+
+
+void TileScheduler::Wait()
+{
+	boost::unique_lock<boost::mutex> lock(mutex);
+
+	while (activeWorkers > 0)
+		workDone.wait(lock);
+
+	if (!running)
+		return;
+
+	running = false;
+	tileFunc.clear();
+
+	// the times of a run that stopped part way would make the tiles it never reached look cheap
+	if (costs)
+	{
+		costs->assign(cancelled ? 0 : tileCount, 0.0);
+		if (!cancelled)
+		{
+			for (std::size_t i=0; i<tasks.size(); ++i)
+				(*costs)[taskTiles[i]] += taskCosts[i];
+		}
+		costs = NULL;
+	}
+
+	if (error)
+	{
+		boost::exception_ptr rethrow = error;
+		error = boost::exception_ptr();
+		boost::rethrow_exception(rethrow);
+	}
+}
+
+
+void TileScheduler::Cancel()
+{
+	cancelled = true;
+	Wait();
+}
+
+
+// the positions in tiles of each tile, in the order they are handed out
+std::vector<std::size_t> TileScheduler::SortTiles(const TileContainer_t& tiles) const
+{
+	std::vector<std::size_t> result(tiles.size());
+	if (order == ORDER_ROWS)
+	{
+		for (std::size_t i=0; i<tiles.size(); ++i)
+			result[i] = i;
+		return result;
+	}
+
+	std::vector< std::pair<boost::uint64_t, std::size_t> > keys(tiles.size());
+	for (std::size_t i=0; i<tiles.size(); ++i)
+		keys[i] = std::make_pair(SpaceFillingCurve::GetIndex(order, tiles[i].X, tiles[i].Y), i);
+	std::sort(keys.begin(), keys.end());
+
+	for (std::size_t i=0; i<keys.size(); ++i)
+		result[i] = keys[i].second;
+	return result;
+}
+
+
+void TileScheduler::MakeTasks(const TileContainer_t& tiles, const TileCosts_t* lastCosts)
+{
+	tileCount = tiles.size();
+	tasks.clear();
+	taskTiles.clear();
+
+	// splitting only helps if there are other threads to take the parts
+	double limit = 0.0;
+	if (splitSize > 0 && threadCount > 1 && lastCosts && lastCosts->size() == tiles.size() && !tiles.empty())
+	{
+		double total = 0.0;
+		for (std::size_t i=0; i<lastCosts->size(); ++i)
+			total += (*lastCosts)[i];
+
+		limit = std::min(SPLIT_COST_FACTOR * total / tiles.size(), SPLIT_SHARE_FRACTION * total / threadCount);
+	}
+
+	const std::vector<std::size_t> sorted = SortTiles(tiles);
+	for (std::size_t i=0; i<sorted.size(); ++i)
+	{
+		std::size_t before = tasks.size();
+		AddTask(tiles[sorted[i]], sorted[i], limit > 0.0 ? (*lastCosts)[sorted[i]] : 0.0, limit);
+		if (tasks.size() > before + 1)
+			++statistics.SplitTiles;
+	}
+
+	taskCosts.assign(tasks.size(), 0.0);
+	statistics.Tasks += tasks.size();
+}
+
+
+// Adds the tile as a task, or if its cost is over the limit, its halves or quarters, each split again
+// while its share of the cost is still over it. Parts are assumed to cost the same
+void TileScheduler::AddTask(const Tile& tile, std::size_t index, double cost, double limit)
+{
+	if (limit > 0.0 && cost > limit)
+	{
+		// the width and height of the top left part, rounded up to a whole number of the smallest parts
+		int left = (tile.Width / 2 + splitSize - 1) / splitSize * splitSize;
+		int top = (tile.Height / 2 + splitSize - 1) / splitSize * splitSize;
+		bool across = left < tile.Width, down = top < tile.Height;
+
+		if (across || down)
+		{
+			if (!across)
+				left = tile.Width;
+			if (!down)
+				top = tile.Height;
+
+			double partCost = cost / ((across ? 2 : 1) * (down ? 2 : 1));
+			AddTask(Tile(tile.X, tile.Y, left, top), index, partCost, limit);
+			if (across)
+				AddTask(Tile(tile.X + left, tile.Y, tile.Width - left, top), index, partCost, limit);
+			if (down)
+			{
+				AddTask(Tile(tile.X, tile.Y + top, left, tile.Height - top), index, partCost, limit);
+				if (across)
+					AddTask(Tile(tile.X + left, tile.Y + top, tile.Width - left, tile.Height - top), index, partCost, limit);
+			}
+			return;
+		}
+	}
+
+	tasks.push_back(tile);
+	taskTiles.push_back(index);
+}
+
+
+void TileScheduler::WorkerLoop(unsigned int thread)
+{
+	unsigned int seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (!stopping && generation == seenGeneration)
+				workAvailable.wait(lock);
+
+			if (stopping)
+				return;
+
+			seenGeneration = generation;
+		}
+
+		ProcessTiles(thread);
+
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			if (--activeWorkers == 0)
+			{
+				++statistics.Runs;
+				statistics.ThreadSeconds += threadCount * Seconds_t(Clock_t::now() - runStart).count();
+				workDone.notify_all();
+			}
+		}
+	}
+}
+
+
+void TileScheduler::ProcessTiles(unsigned int thread)
+{
+	double busy = 0.0;
+	boost::uint64_t steals = 0;
+	std::size_t task;
+
+	while (!cancelled && TakeTask(thread, task, steals))
+	{
+		Clock_t::time_point start = Clock_t::now();
+		try
+		{
+			tileFunc(tasks[task]);
+		}
+		catch (...)
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			if (!error)
+				error = boost::current_exception();
+			cancelled = true;
+		}
+
+		// each task is only ever taken by one thread, so its cost can be written without locking
+		taskCosts[task] = Seconds_t(Clock_t::now() - start).count();
+		busy += taskCosts[task];
+	}
+
+	boost::unique_lock<boost::mutex> lock(mutex);
+	statistics.BusySeconds += busy;
+	statistics.Steals += steals;
+}
+
+
+// Takes the next task from the front of the thread's own deque or, once that is empty, steals the back
+// half of the deque with the most left, the tasks its owner would have reached last. Returns false
+// when every deque is empty
+bool TileScheduler::TakeTask(unsigned int thread, std::size_t& task, boost::uint64_t& steals)
+{
+	WorkQueue& own = queues[thread];
+	{
+		boost::unique_lock<boost::mutex> lock(own.Mutex);
+		if (own.Next < own.End)
+		{
+			task = own.Next++;
+			return true;
+		}
+	}
+
+	while (true)
+	{
+		unsigned int victim = thread;
+		std::size_t most = 0;
+		for (unsigned int i=0; i<threadCount; ++i)
+		{
+			if (i == thread)
+				continue;
+
+			boost::unique_lock<boost::mutex> lock(queues[i].Mutex);
+			if (queues[i].End - queues[i].Next > most)
+			{
+				most = queues[i].End - queues[i].Next;
+				victim = i;
+			}
+		}
+
+		if (most == 0)
+			return false;
+
+		std::size_t first, last;
+		{
+			// the victim may have taken some since they were counted, so they are counted again
+			boost::unique_lock<boost::mutex> lock(queues[victim].Mutex);
+			std::size_t left = queues[victim].End - queues[victim].Next;
+			if (left == 0)
+				continue;
+
+			last = queues[victim].End;
+			first = last - (left + 1) / 2;
+			queues[victim].End = first;
+		}
+
+		// only this thread adds to its own deque, and nobody steals from it while it is empty
+		boost::unique_lock<boost::mutex> lock(own.Mutex);
+		task = first;
+		own.Next = first + 1;
+		own.End = last;
+		++steals;
+		return true;
+	}
+}
+
+
+TileScheduler::TileContainer_t TileScheduler::SplitIntoTiles(int width, int height, int tileSize)
+{
+	TileContainer_t result;
+	result.reserve(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+
+	for (int y=0; y<height; y+=tileSize)
+	{
+		for (int x=0; x<width; x+=tileSize)
+		{
+			result.push_back(Tile(x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)));
+		}
+	}
+
+	return result;
+}
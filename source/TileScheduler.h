@@ -0,0 +1,159 @@
+
+
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <vector>
+
+#include "SpaceFillingCurve.h"
+
+#include <boost/function.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/scoped_array.hpp>
+
+
+class Tile
+{
+public:
+	inline Tile(int x = 0, int y = 0, int width = 0, int height = 0)
+		: X(x), Y(y), Width(width), Height(height)
+	{}
+
+	int X, Y, Width, Height;
+};
+
+
+// How the work of the runs since the statistics were reset was shared between the threads
+class SchedulerStatistics
+{
+public:
+	// tasks are the tiles and parts of tiles handed out; steals are the times a thread with none left
+	// took some from another
+	boost::uint64_t Runs, Tasks, SplitTiles, Steals;
+	// time spent in the tile function by all the threads, and the time the runs took times the threads,
+	// so the difference is how long threads waited for the last ones to finish
+	double BusySeconds, ThreadSeconds;
+
+	inline SchedulerStatistics()
+		: Runs(0), Tasks(0), SplitTiles(0), Steals(0), BusySeconds(0.0), ThreadSeconds(0.0)
+	{}
+};
+
+
+// Runs a function over a list of tiles using a fixed pool of worker threads. Each tile is handed to
+// exactly one worker, so a tile function may write to its own tile's pixels without locking.
+// A run either blocks (Run), or is started in the background and later waited for or cancelled.
+//
+// Each thread has a deque of its own, dealt a run of consecutive tiles, which it takes from the front
+// of; a thread whose deque is empty steals the back half of the fullest other one. Threads so mostly
+// trace tiles near the ones they traced before, and only contend for tiles at the end of a run, when
+// some parts of the frame have turned out to cost more than others. Given the time each tile took
+// the last time it was traced, a tile which took far longer than the others is split into parts, so
+// one expensive tile does not leave the other threads waiting at the end.
+class TileScheduler
+{
+public:
+	typedef boost::function<void (const Tile&)> TileFunc_t;
+	typedef std::vector<Tile> TileContainer_t;
+	// seconds spent on each tile of a run, in the order they were given
+	typedef std::vector<double> TileCosts_t;
+
+private:
+	typedef boost::chrono::steady_clock Clock_t;
+
+	// a thread's deque, which is always a run of consecutive tasks
+	class WorkQueue
+	{
+	public:
+		boost::mutex Mutex;
+		std::size_t Next, End;
+
+		inline WorkQueue() : Next(0), End(0) {}
+	};
+
+	boost::thread_group workers;
+	unsigned int threadCount;
+
+	boost::mutex mutex;
+	boost::condition_variable workAvailable, workDone;
+	unsigned int generation;
+	unsigned int activeWorkers;
+	bool stopping, running;
+
+	TileFunc_t tileFunc;
+	CURVE_ORDER order;
+	int splitSize;
+	// the tiles and parts of tiles of this run, the tile each is or is part of, and the time each took
+	TileContainer_t tasks;
+	std::vector<std::size_t> taskTiles;
+	std::vector<double> taskCosts;
+	std::size_t tileCount;
+	TileCosts_t* costs;
+	boost::scoped_array<WorkQueue> queues;
+	boost::atomic<bool> cancelled;
+	boost::exception_ptr error;
+
+	Clock_t::time_point runStart;
+	SchedulerStatistics statistics;
+
+	std::vector<std::size_t> SortTiles(const TileContainer_t& tiles) const;
+	void MakeTasks(const TileContainer_t& tiles, const TileCosts_t* lastCosts);
+	void AddTask(const Tile& tile, std::size_t index, double cost, double limit);
+	void WorkerLoop(unsigned int thread);
+	void ProcessTiles(unsigned int thread);
+	bool TakeTask(unsigned int thread, std::size_t& task, boost::uint64_t& steals);
+
+	TileScheduler(const TileScheduler& copy);
+	TileScheduler& operator = (const TileScheduler& copy);
+
+public:
+	// threadCount of 0 sizes the pool to the number of hardware threads
+	explicit TileScheduler(unsigned int threadCount = 0);
+	~TileScheduler();
+
+	inline unsigned int GetThreadCount() const { return threadCount; }
+
+	// the number of threads a scheduler constructed with threadCount will use
+	static unsigned int ResolveThreadCount(unsigned int threadCount);
+
+	// Tiles are handed out in the order of this curve through their top left corners, so that those
+	// traced at about the same time, on one thread or on neighbouring ones, are near each other. Rows,
+	// the default, keeps the order they were given in
+	inline void SetOrder(CURVE_ORDER order) { this->order = order; }
+	inline CURVE_ORDER GetOrder() const { return order; }
+
+	// Parts of split tiles are no smaller than partSize pixels a side, and start a multiple of it from
+	// the tile's corner. 0, the default, never splits tiles
+	inline void SetSplitSize(int partSize) { splitSize = partSize; }
+	inline int GetSplitSize() const { return splitSize; }
+
+	// Traces every tile and blocks until they are all done. If a tile function throws, the
+	// remaining tiles are abandoned and the first exception is rethrown on the calling thread.
+	//
+	// With costs, the time each tile takes is stored there once the run is done, and if they hold the
+	// times of a run of as many tiles, expensive tiles are split. The tile function is then given parts
+	// of tiles as well as whole ones, and parts of one tile can be traced at the same time
+	void Run(const TileContainer_t& tiles, const TileFunc_t& func, TileCosts_t* costs = NULL);
+
+	// Starts tracing the tiles in the background and returns immediately. Waits for any earlier run first
+	void Start(const TileContainer_t& tiles, const TileFunc_t& func, TileCosts_t* costs = NULL);
+	// true once every tile of the last run is done, or there is no run in progress
+	bool IsFinished();
+	// Blocks until the run in progress is done, rethrowing the first exception a tile function threw
+	void Wait();
+	// Abandons the tiles no worker has started yet, then waits for the ones in progress
+	void Cancel();
+
+	// only to be read or reset while no run is in progress
+	inline const SchedulerStatistics& GetStatistics() const { return statistics; }
+	inline void ResetStatistics() { statistics = SchedulerStatistics(); }
+
+	static TileContainer_t SplitIntoTiles(int width, int height, int tileSize);
+};
+
+
+#endif
@@ -12,9 +12,53 @@ public:
 	Vector3 A, B, C;
 
 	Triangle();
+
+	// Moller-Trumbore ray/triangle test, shared with Mesh. Returns the hit distance and the
+	// barycentric coordinates of the hit relative to b and c.
+	static inline bool Intersect(const Vector3& a, const Vector3& b, const Vector3& c, const Ray& ray, float& distance, float& u, float& v)
+	{
+		Vector3 edge1 = b - a;
+		Vector3 edge2 = c - a;
+		Vector3 pvec = Vector3::Cross(ray.Direction, edge2);
+
+		float det = Vector3::Dot(edge1, pvec);
+
+		if(det > -0.000001f && det < 0.000001f)
+		{
+			return false;
+		}
+
+		float invDet = 1.0f/det;
+
+		Vector3 tvec = ray.Origin - a;
+
+		u = Vector3::Dot(tvec, pvec) * invDet;
+		if(u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		Vector3 qvec = Vector3::Cross(tvec, edge1);
+
+		v = Vector3::Dot(ray.Direction, qvec) * invDet;
+		if(v < 0.0f || (u + v) > 1.0f)
+		{
+			return false;
+		}
+
+		distance = Vector3::Dot(edge2, qvec) * invDet;
+		if(distance < 0.0f)
+		{
+			return false;
+		}
+
+		return true;
+	}
 	
 	bool Trace(const Ray& ray, float& distance) const;
 	Vector3 GetNormal(const Ray& ray, float distance) const;
+	void CompleteHit(const Ray& ray, HitRecord& hit) const;
+	BoundingBox GetBounds() const;
 	
 };
 
@@ -0,0 +1,358 @@
+#include "TriangleStore.h"
+#include "CacheStream.h"
+
+
+void TriangleStore::Clear()
+{
+	triangleCount = 0;
+	corners.clear();
+	aX.clear(); aY.clear(); aZ.clear();
+	edge1X.clear(); edge1Y.clear(); edge1Z.clear();
+	edge2X.clear(); edge2Y.clear(); edge2Z.clear();
+	ids.clear();
+	bounds.clear();
+	slots.clear();
+	moved.clear();
+	hierarchy.Clear();
+}
+
+
+void TriangleStore::Reserve(std::size_t count)
+{
+	corners.reserve(count * 3);
+}
+
+
+void TriangleStore::Add(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+	corners.push_back(a);
+	corners.push_back(b);
+	corners.push_back(c);
+	++triangleCount;
+}
+
+
+void TriangleStore::SetBounds(boost::uint32_t id)
+{
+	bounds[id] = BoundingBox();
+	bounds[id].Expand(corners[id * 3]);
+	bounds[id].Expand(corners[id * 3 + 1]);
+	bounds[id].Expand(corners[id * 3 + 2]);
+}
+
+
+void TriangleStore::WriteSlot(boost::uint32_t slot, boost::uint32_t id)
+{
+	const Vector3& a = corners[id * 3];
+	Vector3 edge1 = corners[id * 3 + 1] - a;
+	Vector3 edge2 = corners[id * 3 + 2] - a;
+
+	aX[slot] = a.X; aY[slot] = a.Y; aZ[slot] = a.Z;
+	edge1X[slot] = edge1.X; edge1Y[slot] = edge1.Y; edge1Z[slot] = edge1.Z;
+	edge2X[slot] = edge2.X; edge2Y[slot] = edge2.Y; edge2Z[slot] = edge2.Z;
+	ids[slot] = id;
+	slots[id] = slot;
+}
+
+
+void TriangleStore::Build()
+{
+	bounds.resize(triangleCount);
+	for (boost::uint32_t i=0; i<triangleCount; ++i)
+		SetBounds(i);
+
+	hierarchy.Build(bounds, LEAF_SIZE);
+	moved.clear();
+
+	// the padding is degenerate, so never hits anything
+	const BVH::IndexContainer_t& order = hierarchy.GetIndices();
+	std::size_t size = order.size() + SimdFloat::Width;
+	PackedArray<float>* arrays[] = { &aX, &aY, &aZ, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z };
+	for (int i=0; i<9; ++i)
+		arrays[i]->assign(size, 0.0f);
+	ids.assign(size, 0);
+	slots.resize(triangleCount);
+
+	for (boost::uint32_t i=0; i<order.size(); ++i)
+		WriteSlot(i, order[i]);
+}
+
+
+void TriangleStore::Update(boost::uint32_t id, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+	corners[id * 3] = a;
+	corners[id * 3 + 1] = b;
+	corners[id * 3 + 2] = c;
+	SetBounds(id);
+	WriteSlot(slots[id], id);
+	moved.push_back(id);
+}
+
+
+bool TriangleStore::Refit(float rebuildThreshold)
+{
+	if (moved.empty())
+		return false;
+
+	hierarchy.Refit(bounds, moved);
+	moved.clear();
+
+	if (hierarchy.GetCost() <= hierarchy.GetBuildCost() * rebuildThreshold)
+		return false;
+
+	Build();
+	return true;
+}
+
+
+void TriangleStore::Write(CacheWriter& writer) const
+{
+	writer.Write<boost::uint64_t>(triangleCount);
+	hierarchy.Write(writer);
+
+	const PackedArray<float>* arrays[] = { &aX, &aY, &aZ, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z };
+	for (int i=0; i<9; ++i)
+		writer.WriteArray(*arrays[i]);
+	writer.WriteArray(ids);
+}
+
+
+void TriangleStore::Map(CacheReader& reader)
+{
+	Clear();
+	triangleCount = (std::size_t)reader.Read<boost::uint64_t>();
+	hierarchy.Map(reader, triangleCount);
+
+	PackedArray<float>* arrays[] = { &aX, &aY, &aZ, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z };
+	for (int i=0; i<9; ++i)
+	{
+		reader.MapArray(*arrays[i]);
+		// the kernels load whole vectors, so need the padding of this build's vector width
+		if (arrays[i]->size() < triangleCount + SimdFloat::Width)
+			throw reader.Error("Triangles were cached for a narrower vector width");
+	}
+	reader.MapArray(ids);
+	if (ids.size() != aX.size() || hierarchy.GetIndices().size() != triangleCount)
+		throw reader.Error("Triangle arrays differ in length");
+	reader.CheckIndices(ids, triangleCount, triangleCount, "Triangle refers to a triangle which does not exist");
+}
+
+
+namespace
+{
+	inline SimdVector3 Cross(const SimdVector3& first, const SimdVector3& second)
+	{
+		return SimdVector3(first.Y * second.Z - second.Y * first.Z,
+			first.Z * second.X - second.Z * first.X,
+			first.X * second.Y - second.X * first.Y);
+	}
+
+
+	// Triangle::Intersect for a vector of triangles or rays, operation for operation, so it finds
+	// exactly the same hits. Returns the lanes that hit
+	inline SimdMask Intersect(const SimdVector3& a, const SimdVector3& edge1, const SimdVector3& edge2,
+		const SimdVector3& origin, const SimdVector3& direction, SimdFloat& distance, SimdFloat& u, SimdFloat& v)
+	{
+		SimdVector3 pvec = Cross(direction, edge2);
+		SimdFloat det = SimdVector3::Dot(edge1, pvec);
+		SimdMask hit = (det <= -0.000001f) | (det >= 0.000001f);
+
+		SimdFloat invDet = SimdFloat(1.0f) / det;
+		SimdVector3 tvec = origin - a;
+		u = SimdVector3::Dot(tvec, pvec) * invDet;
+		hit = hit & (u >= 0.0f) & (u <= 1.0f);
+
+		SimdVector3 qvec = Cross(tvec, edge1);
+		v = SimdVector3::Dot(direction, qvec) * invDet;
+		hit = hit & (v >= 0.0f) & ((u + v) <= 1.0f);
+
+		distance = SimdVector3::Dot(edge2, qvec) * invDet;
+		return hit & (distance >= 0.0f);
+	}
+}
+
+
+// A leaf is tested a whole vector at a time, with the lanes past its end masked off.
+class TriangleStore::LeafIntersector
+{
+private:
+	const TriangleStore& store;
+	SimdVector3 origin, direction;
+
+public:
+	boost::uint32_t Slot;
+	float U, V;
+
+	LeafIntersector(const TriangleStore& store, const Ray& ray)
+		: store(store), origin(ray.Origin), direction(ray.Direction), Slot(0), U(0.0f), V(0.0f)
+	{}
+
+	inline bool operator()(boost::uint32_t first, boost::uint32_t count, float& distance)
+	{
+		bool hit = false;
+
+		const boost::uint32_t end = first + count;
+		for (boost::uint32_t slot=first; slot<end; slot+=SimdFloat::Width)
+		{
+			SimdMask valid = SimdMask::FirstLanes(end - slot);
+			SimdVector3 a(SimdFloat::Load(&store.aX[slot]), SimdFloat::Load(&store.aY[slot]), SimdFloat::Load(&store.aZ[slot]));
+			SimdVector3 edge1(SimdFloat::Load(&store.edge1X[slot]), SimdFloat::Load(&store.edge1Y[slot]), SimdFloat::Load(&store.edge1Z[slot]));
+			SimdVector3 edge2(SimdFloat::Load(&store.edge2X[slot]), SimdFloat::Load(&store.edge2Y[slot]), SimdFloat::Load(&store.edge2Z[slot]));
+
+			SimdFloat t, u, v;
+			SimdMask triangleHit = valid & ::Intersect(a, edge1, edge2, origin, direction, t, u, v);
+			int bits = (triangleHit & (t < distance)).GetBits();
+			if (bits == 0)
+				continue;
+
+			float distances[SimdFloat::Width], us[SimdFloat::Width], vs[SimdFloat::Width];
+			t.Store(distances);
+			u.Store(us);
+			v.Store(vs);
+			for (int lane=0; lane<SimdFloat::Width; ++lane)
+			{
+				if ((bits & (1 << lane)) && distances[lane] < distance)
+				{
+					distance = distances[lane];
+					Slot = slot + lane;
+					U = us[lane];
+					V = vs[lane];
+					hit = true;
+				}
+			}
+		}
+
+		return hit;
+	}
+};
+
+
+class TriangleStore::OcclusionLeafIntersector
+{
+private:
+	const TriangleStore& store;
+	SimdVector3 origin, direction;
+
+public:
+	// the triangle that blocked the ray
+	boost::uint32_t Id;
+
+	OcclusionLeafIntersector(const TriangleStore& store, const Ray& ray)
+		: store(store), origin(ray.Origin), direction(ray.Direction), Id(0)
+	{}
+
+	inline bool Blocked(boost::uint32_t slot, const SimdMask& hit)
+	{
+		if (!hit.Any())
+			return false;
+
+		int bits = hit.GetBits();
+		int lane = 0;
+		while ((bits & (1 << lane)) == 0)
+			++lane;
+
+		Id = store.ids[slot + lane];
+		return true;
+	}
+
+	inline bool operator()(boost::uint32_t first, boost::uint32_t count, float maxDistance)
+	{
+		const boost::uint32_t end = first + count;
+		for (boost::uint32_t slot=first; slot<end; slot+=SimdFloat::Width)
+		{
+			SimdMask valid = SimdMask::FirstLanes(end - slot);
+			SimdVector3 a(SimdFloat::Load(&store.aX[slot]), SimdFloat::Load(&store.aY[slot]), SimdFloat::Load(&store.aZ[slot]));
+			SimdVector3 edge1(SimdFloat::Load(&store.edge1X[slot]), SimdFloat::Load(&store.edge1Y[slot]), SimdFloat::Load(&store.edge1Z[slot]));
+			SimdVector3 edge2(SimdFloat::Load(&store.edge2X[slot]), SimdFloat::Load(&store.edge2Y[slot]), SimdFloat::Load(&store.edge2Z[slot]));
+
+			SimdFloat t, u, v;
+			SimdMask hit = valid & ::Intersect(a, edge1, edge2, origin, direction, t, u, v);
+			if (Blocked(slot, hit & (t < maxDistance)))
+				return true;
+		}
+
+		return false;
+	}
+};
+
+
+// Packets test each triangle of the leaf against every lane in turn
+class TriangleStore::PacketLeafIntersector
+{
+private:
+	const TriangleStore& store;
+	const RayPacket& packet;
+	boost::uint32_t* id;
+
+public:
+	PacketLeafIntersector(const TriangleStore& store, const RayPacket& packet, boost::uint32_t* id)
+		: store(store), packet(packet), id(id)
+	{}
+
+	inline SimdMask operator()(boost::uint32_t first, boost::uint32_t count, const SimdMask& lanes, SimdFloat& distance)
+	{
+		SimdMask leafHit(false);
+
+		for (boost::uint32_t slot=first; slot<first + count; ++slot)
+		{
+			SimdVector3 a(SimdFloat(store.aX[slot]), SimdFloat(store.aY[slot]), SimdFloat(store.aZ[slot]));
+			SimdVector3 edge1(SimdFloat(store.edge1X[slot]), SimdFloat(store.edge1Y[slot]), SimdFloat(store.edge1Z[slot]));
+			SimdVector3 edge2(SimdFloat(store.edge2X[slot]), SimdFloat(store.edge2Y[slot]), SimdFloat(store.edge2Z[slot]));
+
+			SimdFloat t, u, v;
+			SimdMask hit = lanes & ::Intersect(a, edge1, edge2, packet.Origin, packet.Direction, t, u, v);
+			hit = hit & (t < distance);
+			int bits = hit.GetBits();
+			if (bits == 0)
+				continue;
+
+			distance = SimdFloat::Select(hit, t, distance);
+			for (int lane=0; bits != 0; ++lane, bits >>= 1)
+			{
+				if (bits & 1)
+					id[lane] = store.ids[slot];
+			}
+			leafHit = leafHit | hit;
+		}
+
+		return leafHit;
+	}
+};
+
+
+bool TriangleStore::Intersect(const Ray& ray, float& distance, boost::uint32_t& id, float& u, float& v) const
+{
+	LeafIntersector intersector(*this, ray);
+	if (!hierarchy.IntersectLeaves(ray, distance, intersector))
+		return false;
+
+	id = ids[intersector.Slot];
+	u = intersector.U;
+	v = intersector.V;
+	return true;
+}
+
+
+bool TriangleStore::Occludes(const Ray& ray, float maxDistance) const
+{
+	OcclusionLeafIntersector intersector(*this, ray);
+	return hierarchy.IntersectAnyLeaves(ray, maxDistance, intersector);
+}
+
+
+bool TriangleStore::Occludes(const Ray& ray, float maxDistance, boost::uint32_t& id) const
+{
+	OcclusionLeafIntersector intersector(*this, ray);
+	if (!hierarchy.IntersectAnyLeaves(ray, maxDistance, intersector))
+		return false;
+
+	id = intersector.Id;
+	return true;
+}
+
+
+SimdMask TriangleStore::IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t id[]) const
+{
+	PacketLeafIntersector intersector(*this, packet, id);
+	return hierarchy.IntersectPacketLeaves(packet, active, distance, intersector);
+}
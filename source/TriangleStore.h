@@ -0,0 +1,81 @@
+
+
+#ifndef TRIANGLESTORE_H
+#define TRIANGLESTORE_H
+
+#include "BVH.h"
+#include "RayPacket.h"
+#include "PackedArray.h"
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+
+// Triangles packed as structure of arrays, with their own hierarchy. Each triangle is stored as its
+// first corner and two edges, in hierarchy order, so a leaf's triangles are tested against a ray a
+// whole vector at a time. Triangles are identified by the order they were added.
+class TriangleStore
+{
+public:
+	static const int LEAF_SIZE = 8;
+
+private:
+	std::size_t triangleCount;
+	// the corners as added, which are only needed to build the packed arrays and so are not kept by a
+	// store read from a scene cache
+	std::vector<Vector3> corners;
+	std::vector<BoundingBox> bounds;
+
+	// hierarchy order, padded by a vector width so kernels can always load whole vectors
+	PackedArray<float> aX, aY, aZ, edge1X, edge1Y, edge1Z, edge2X, edge2Y, edge2Z;
+	PackedArray<boost::uint32_t> ids;
+	BVH hierarchy;
+
+	// where each triangle is in the arrays, and the triangles moved since the hierarchy was last fitted
+	std::vector<boost::uint32_t> slots;
+	std::vector<boost::uint32_t> moved;
+
+	void SetBounds(boost::uint32_t id);
+	void WriteSlot(boost::uint32_t slot, boost::uint32_t id);
+
+	class LeafIntersector;
+	class OcclusionLeafIntersector;
+	class PacketLeafIntersector;
+
+public:
+	TriangleStore() : triangleCount(0) {}
+
+	void Clear();
+	void Reserve(std::size_t count);
+	void Add(const Vector3& a, const Vector3& b, const Vector3& c);
+	// must be called after adding triangles and before tracing
+	void Build();
+
+	// Moves a triangle. Refit must be called before tracing again
+	void Update(boost::uint32_t id, const Vector3& a, const Vector3& b, const Vector3& c);
+	// Fits the hierarchy around the triangles moved since it was built or last fitted, or rebuilds it
+	// if refitting leaves its cost more than rebuildThreshold times what it was when built. Returns
+	// true if it rebuilt
+	bool Refit(float rebuildThreshold);
+
+	// Writes the built store to a scene cache, and reads one back. A store read back traces straight
+	// from the cache's memory, which must stay mapped while it is used, and cannot be changed
+	void Write(CacheWriter& writer) const;
+	void Map(CacheReader& reader);
+
+	inline std::size_t GetCount() const { return triangleCount; }
+	inline bool IsEmpty() const { return triangleCount == 0; }
+	inline BoundingBox GetBounds() const { return hierarchy.GetBounds(); }
+
+	// Closest hit. Lowers distance and returns the triangle's id and the barycentric coordinates of the
+	// hit, as Triangle::Intersect, if one is hit closer than distance
+	bool Intersect(const Ray& ray, float& distance, boost::uint32_t& id, float& u, float& v) const;
+	bool Occludes(const Ray& ray, float maxDistance) const;
+	// also gives the id of a triangle which blocks the ray
+	bool Occludes(const Ray& ray, float maxDistance, boost::uint32_t& id) const;
+	// Closest hits for a packet. id is written for each lane in the returned mask
+	SimdMask IntersectPacket(const RayPacket& packet, const SimdMask& active, SimdFloat& distance, boost::uint32_t id[]) const;
+};
+
+
+#endif